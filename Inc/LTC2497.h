@@ -15,9 +15,6 @@
 #pragma once
 #include "i2c.h"
 
-#define ADC_ADDRESS_ONE					0x14
-#define ADC_ADDRESS_TWO					0x56
-
 #define SELECT_BYTE_PREAMBLE_BITS		0x02 << 6
 #define SELECT_BYTE_ENABLE_BIT			0x01 << 5
 #define SELECT_BYTE_DIFF_INPUT			0x00 << 4
@@ -34,6 +31,23 @@
 #define SETUP_BYTE_1X_SPEED				0x00 << 3
 #define SETUP_BYTE_2X_SPEED				0x01 << 3
 
+#define LTC2497_DATA_LENGTH				4		/**< Bytes read per conversion result */
+#define LTC2497_CHANNEL_NONE			0xFF	/**< Channel of the conversion is unknown */
+#define LTC2497_CHANNEL_TEMP			0x10	/**< Internal temperature sensor, selected like a channel */
+#define LTC2497_CONVERSION_TIME_1X_MS	150		/**< Worst case conversion time, 1X speed */
+#define LTC2497_CONVERSION_TIME_2X_MS	75		/**< Worst case conversion time, 2X speed */
+#define LTC2497_XFER_RETRIES			2		/**< Restarts of transaction failed by bus error */
+#define LTC2497_POLL_MIN_MS				1		/**< First delay after address NACK, doubled on every next one */
+#define LTC2497_POLL_MAX_MS				32		/**< Limit of the delay between readiness polls */
+
+#define LTC2497_DATA_SIG_BIT			(1UL << 23)		/**< Sign bit of the conversion result, set for positive input */
+#define LTC2497_DATA_MSB_BIT			(1UL << 22)		/**< Most significant bit of the result */
+#define LTC2497_DATA_SUB_LSB_BITS		6				/**< Zero bits below LSB of the result */
+#define LTC2497_CODE_FULL_SCALE			(1L << 16)		/**< Code of the full scale input, VREF/2 */
+#define LTC2497_VREF_UV					5000000			/**< Default reference voltage, microvolts */
+#define LTC2497_TEMP_UV_PER_K			1400			/**< Temperature sensor output, proportional to absolute temperature */
+#define LTC2497_TEMP_Q					8				/**< Temperature fractional bits, kelvin */
+
 
 typedef enum
 {
@@ -60,6 +74,14 @@ typedef enum
 	LTC2497_TEMP_OUTPUT_ON				= SETUP_BYTE_TEMP_OUTPUT_ON
 } LTC2497_TEMP_OUTPUT;
 
+/**@brief Status of decoded conversion result. */
+typedef enum
+{
+	LTC2497_STATUS_OK					= 0,
+	LTC2497_STATUS_OVERRANGE			= 1,	/**< Input is at or above +FS, code is clamped */
+	LTC2497_STATUS_UNDERRANGE			= 2		/**< Input is below -FS, code is clamped */
+} LTC2497_STATUS;
+
 /**@brief LTC2497 setup structure. This contains all options needed for
  *        initialization of the module*/
 typedef struct 
@@ -69,47 +91,255 @@ typedef struct
 	uint8_t			temp;
 } LTC2497_setup_t;
 
+/**@brief LTC2497 instance. Keeps transfer buffers of the chip, so they
+ *        stay valid while non-blocking transaction is in progress.
+ *
+ * @details Chip returns result of the previous conversion in the same 
+ *          transaction which selects channel of the next one. Instance 
+ *          tracks which channel is being converted, so every result is
+ *          tagged with the channel it actually belongs to.
+ *
+ *          Chip doesn't acknowledge it's address until conversion is 
+ *          finished. Instance measures time from conversion start to the
+ *          first acknowledged transaction, so the next transaction can be
+ *          started when the chip is expected to be ready instead of after
+ *          the worst case conversion time.*/
+typedef struct
+{
+	uint8_t				bus;				/**< I2C bus index */
+	uint8_t				address;
+	uint8_t				setup_byte;			/**< Setup byte of the chip, restored after temperature conversion */
+	bool				setup_changed;		/**< Setup byte is to be sent by the next select transaction */
+	uint8_t				tx_data[2];
+	uint8_t				rx_data[LTC2497_DATA_LENGTH];
+	uint8_t				pending_channel;	/**< Channel being converted now */
+	uint8_t				result_channel;		/**< Channel of the data in rx_data */
+	uint8_t				next_channel;		/**< Channel selected by transaction in progress */
+	uint8_t				polls;				/**< Address NACKs since the conversion start */
+	uint32_t			conversion_start;	/**< Application timer counter at the conversion start */
+	uint32_t			latency_ticks;		/**< Estimated conversion time, application timer ticks */
+	twi_callback_t		callback;
+	void *				p_context;
+	twi_transaction_t	transaction;
+} ltc2497_t;
+
 
 /**
   * @brief  Selects single channel to futher interaction with.
   *
   *
+  * @param  bus - I2C bus index
   * @param  address - I2C address of LTC2497 module
   * @param  channel - number of channel to select
   * 
   * @retval TX operation result code
   */
-ret_code_t ltc2497_select_single_channel(uint8_t address, uint8_t channel);
+ret_code_t ltc2497_select_single_channel(uint8_t bus, uint8_t address, uint8_t channel);
 
 /**
   * @brief  Selects differential channel to futher interaction with.
   *
   *
+  * @param[in]	bus			I2C bus index
   * @param[in]	address		I2C address of LTC2497 module
   * @param[in]  channel		number of channel to select
   * 
   * @retval TX operation result code
   */
-ret_code_t ltc2497_select_diff_channel(uint8_t address, uint8_t channel, uint8_t polarity);
+ret_code_t ltc2497_select_diff_channel(uint8_t bus, uint8_t address, uint8_t channel, uint8_t polarity);
 
 /**
   * @brief  Initializes LTC2497 chip.
   *
   *
+  * @param[in]  bus			I2C bus index
   * @param[in]  address		I2C address of LTC2497 module
   * @param[in]  setup		structure with chip init parameters
   * 
   * @retval		TX operation result code
   */
-ret_code_t ltc2497_setup(uint8_t address, LTC2497_setup_t* setup);
+ret_code_t ltc2497_setup(uint8_t bus, uint8_t address, LTC2497_setup_t* setup);
 
 /**
   * @brief  reads data form LTC2497 using pre-selected channel
   *
   *
+  * @param[in]  bus			I2C bus index
   * @param[in]  address		I2C address of LTC2497 module
   * @param[out] channel		data which have been read
   * 
   * @retval		TX operation result code
   */
-ret_code_t ltc_read_data(uint8_t address, uint8_t* data);
+ret_code_t ltc_read_data(uint8_t bus, uint8_t address, uint8_t* data);
+
+/**
+  * @brief  Initializes LTC2497 instance and sets up the chip.
+  *
+  *
+  * @param[out] p_ltc		LTC2497 instance
+  * @param[in]  bus			I2C bus index
+  * @param[in]  address		I2C address of LTC2497 module
+  * @param[in]  setup		structure with chip init parameters
+  * 
+  * @retval		TX operation result code
+  */
+ret_code_t ltc2497_init(ltc2497_t * p_ltc, uint8_t bus, uint8_t address, LTC2497_setup_t* setup);
+
+/**
+  * @brief  Changes setup of the chip without a transaction of it's own.
+  *         New setup byte is sent by the next select transaction, so the
+  *         conversion started by it is the first one with the new setup.
+  *         Must not be called while transaction of the chip is in progress.
+  *
+  *
+  * @param[in]	p_ltc		LTC2497 instance
+  * @param[in]  setup		structure with new chip parameters
+  */
+void ltc2497_setup_set(ltc2497_t * p_ltc, LTC2497_setup_t const * setup);
+
+/**
+  * @brief  Returns conversion time for given chip setup.
+  *
+  *
+  * @param[in]  setup		structure with chip init parameters
+  * 
+  * @retval		Conversion time in milliseconds
+  */
+uint32_t ltc2497_conversion_time_ms(LTC2497_setup_t const * setup);
+
+/**
+  * @brief  Returns delay before the next transaction of the chip. Right
+  *         after transaction it is the time left until conversion is 
+  *         expected to be finished. After address NACK delay starts 
+  *         from LTC2497_POLL_MIN_MS and doubles with every next NACK.
+  *
+  *
+  * @param[in]	p_ltc		LTC2497 instance
+  * 
+  * @retval		Delay in application timer ticks
+  */
+uint32_t ltc2497_ready_wait_ticks(ltc2497_t const * p_ltc);
+
+/**
+  * @brief  Checks if conversion started by the last transaction is 
+  *         expected to be still in progress. Chip found converting by 
+  *         address NACK isn't expected anything about, it's polled.
+  *
+  *
+  * @param[in]	p_ltc		LTC2497 instance
+  * 
+  * @retval		true if conversion time estimate hasn't passed yet
+  */
+bool ltc2497_is_converting(ltc2497_t const * p_ltc);
+
+/**
+  * @brief  Returns measured conversion time of the chip. Estimate starts
+  *         from the worst case and follows the chip: it is lowered a bit
+  *         after every conversion found finished on the first poll, and 
+  *         set to the measured time when the chip had to be polled again.
+  *
+  *
+  * @param[in]	p_ltc		LTC2497 instance
+  * 
+  * @retval		Conversion time in application timer ticks
+  */
+uint32_t ltc2497_conversion_latency_get(ltc2497_t const * p_ltc);
+
+/**
+  * @brief  Selects differential channel without waiting for transaction 
+  *         to be finished. Conversion starts after the stop condition.
+  *
+  *
+  * @param[in]	p_ltc		LTC2497 instance
+  * @param[in]  channel		number of channel to select or LTC2497_CHANNEL_TEMP
+  * @param[in]  polarity	channel polarity
+  * @param[in]  callback	function to be called on transaction completion
+  * @param[in]  p_context	context passed to callback
+  * 
+  * @retval		TX operation result code
+  */
+ret_code_t ltc2497_select_diff_channel_async(ltc2497_t * p_ltc, uint8_t channel, uint8_t polarity, 
+											 twi_callback_t callback, void * p_context);
+
+/**
+  * @brief  Reads result of the previous conversion to p_ltc->rx_data and 
+  *         selects differential channel of the next one in the single
+  *         TX-RX transaction. Next conversion starts after the stop condition.
+  *         Channel of the data read is put to p_ltc->result_channel.
+  *
+  *
+  * @param[in]	p_ltc		LTC2497 instance
+  * @param[in]  channel		number of channel to select or LTC2497_CHANNEL_TEMP
+  * @param[in]  polarity	channel polarity
+  * @param[in]  callback	function to be called on transaction completion
+  * @param[in]  p_context	context passed to callback
+  * 
+  * @retval		TX operation result code
+  */
+ret_code_t ltc2497_read_and_select_next(ltc2497_t * p_ltc, uint8_t channel, uint8_t polarity, 
+										twi_callback_t callback, void * p_context);
+
+/**
+  * @brief  Reads conversion result to p_ltc->rx_data without waiting for 
+  *         transaction to be finished. Chip starts conversion of the same
+  *         channel after the stop condition.
+  *
+  *
+  * @param[in]	p_ltc		LTC2497 instance
+  * @param[in]  callback	function to be called on transaction completion
+  * @param[in]  p_context	context passed to callback
+  * 
+  * @retval		RX operation result code
+  */
+ret_code_t ltc2497_read_data_async(ltc2497_t * p_ltc, twi_callback_t callback, void * p_context);
+
+/**
+  * @brief  Converts voltage of the temperature sensor to temperature.
+  *
+  *
+  * @param[in]	uv			sensor voltage, microvolts
+  * 
+  * @retval		Temperature in kelvin, Q LTC2497_TEMP_Q
+  */
+int32_t ltc2497_uv_to_temp(int32_t uv);
+
+/**
+  * @brief  Decodes conversion result read from the chip to signed code.
+  *         Result has inverted sign bit followed by 17 bit value, so
+  *         code is in range -FS-1 (underrange) to +FS (overrange).
+  *
+  *
+  * @param[in]	p_data		LTC2497_DATA_LENGTH bytes read from the chip
+  * @param[out]	p_status	LTC2497_STATUS of the result, may be NULL
+  * 
+  * @retval		Signed code, LTC2497_CODE_FULL_SCALE is VREF/2
+  */
+int32_t ltc2497_code_get(uint8_t const * p_data, uint8_t * p_status);
+
+/**
+  * @brief  Converts signed code to microvolts.
+  *
+  *
+  * @param[in]	code		signed code
+  * @param[in]  vref_uv		reference voltage, microvolts
+  * 
+  * @retval		Input voltage, microvolts
+  */
+int32_t ltc2497_code_to_uv(int32_t code, uint32_t vref_uv);
+
+/**
+  * @brief  Decodes results of several conversions, e.g. whole frame. 
+  *         Codes are taken first and converted to microvolts in separate
+  *         pass over contiguous array, so both loops stay short and 
+  *         branchless.
+  *
+  *
+  * @param[in]	p_data		results read from the chip
+  * @param[in]  count		number of results
+  * @param[in]  vref_uv		reference voltage, microvolts
+  * @param[out]	p_codes		signed codes, may be NULL
+  * @param[out]	p_uv		input voltages, microvolts
+  * @param[out]	p_status	LTC2497_STATUS of every result, may be NULL
+  */
+void ltc2497_decode_batch(uint8_t const (* p_data)[LTC2497_DATA_LENGTH], uint8_t count, uint32_t vref_uv,
+						  int32_t * p_codes, int32_t * p_uv, uint8_t * p_status);
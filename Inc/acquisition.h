@@ -0,0 +1,295 @@
+/** 
+ * @file
+ * acquisition.h
+ * 
+ * @brief Event-driven ADC acquisition
+ *
+ * This file declares acquisition engine, which reads LTC2497 channels
+ * without blocking the CPU. Channels are read by pipelined transactions
+ * (read previous conversion, select next channel) separated by conversion
+ * wait, driven by TWI completion callbacks and application timer events.
+ * 
+ * Any number of ADC chips up to ACQ_ADC_MAX is supported, chip count,
+ * buses and addresses are given on init. Chips on different buses are
+ * read in parallel.
+ * 
+ * Three modes are supported: single sample of the given channel, 
+ * frame scan, which sweeps all enabled channels of all ADCs back
+ * to back at configurable frame rate, and stream of single channel,
+ * which is paced by hardware timer. Stream is available only to the
+ * application which gives a stream handler on init, the firmware 
+ * application sends it's blocks by the Stream characteristic.
+ * 
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "LTC2497.h"
+#include "frame_ring.h"
+
+#define ACQ_ADC_MAX					8		/**< Maximum number of ADC chips on all buses */
+#define ACQ_CHANNELS_PER_ADC		8
+#define ACQ_CHANNEL_MAX				(ACQ_ADC_MAX * ACQ_CHANNELS_PER_ADC)
+
+#define ACQ_CHANNEL_BIT(channel)	((acq_channel_mask_t)1 << (channel))
+
+#define ACQ_SELECT_ATTEMPTS			10		/**< Number of transaction attempts while chip is busy converting, covers worst case conversion with polling backoff */
+
+#define ACQ_DEGRADE_ERRORS			3		/**< Frames in a row channel or chip fails to be read before it is degraded */
+#define ACQ_DEGRADE_PROBE_FRAMES	64		/**< Degraded channels are tried again once per this number of frames */
+
+#define ACQ_FRAME_INTERVAL_MS		760		/**< Default frame interval, fits interleaved sweep of all channels at 2X speed */
+
+#define ACQ_TEMP_FRAME_INTERVAL		16		/**< Chip temperature is converted once per this number of frames */
+#define ACQ_TEMP_FILTER_SHIFT		2		/**< Temperature filter weight of the new conversion, 1/2^shift */
+
+#define ACQ_STREAM_TIMER_INSTANCE	1		/**< TIMER instance pacing the stream */
+#define ACQ_STREAM_BLOCK_SIZE		16		/**< Samples passed to stream handler at once */
+#define ACQ_STREAM_XFER_TIME_US		500		/**< Upper bound of single read transaction time */
+#define ACQ_STREAM_RELEASE_MS		2		/**< Delay of bus release after stream stop, lets last transaction finish */
+
+#define ACQ_FRAME_RING_SIZE			4		/**< Frames buffered for the main loop, power of two */
+#define ACQ_SCHED_EVENT_DATA_SIZE	12		/**< Scheduler event data size needed by the engine, for APP_SCHED_INIT */
+
+
+/**@brief Bit mask of channels, bit number is channel number. */
+typedef uint64_t acq_channel_mask_t;
+
+
+/**@brief Order in which ADC chips are swept. */
+typedef enum
+{
+	ACQ_SCHEDULE_SEQUENTIAL,		/**< Chips are swept one after another */
+	ACQ_SCHEDULE_INTERLEAVED		/**< Chips are swept concurrently, while one is read the others convert */
+} acq_schedule_t;
+
+
+/**@brief Frame of samples taken during one sweep. */
+typedef struct
+{
+	uint32_t		timestamp;										/**< Application timer counter at the frame start */
+	uint32_t		sequence;										/**< Frame number since scan start */
+	acq_channel_mask_t	channel_mask;								/**< Channels successfully read in this frame */
+	acq_channel_mask_t	range_mask;									/**< Channels read over or under range */
+	acq_channel_mask_t	degraded_mask;								/**< Channels skipped by scan because of repeated failures */
+	uint8_t			data[ACQ_CHANNEL_MAX][LTC2497_DATA_LENGTH];	/**< Data read from ADC, indexed by channel */
+	int32_t			value[ACQ_CHANNEL_MAX];						/**< Calibrated input voltage in microvolts, indexed by channel */
+	int32_t			temperature[ACQ_ADC_MAX];						/**< Filtered chip temperature, kelvin, Q LTC2497_TEMP_Q, CAL_TEMP_UNKNOWN before the first conversion */
+} acq_frame_t;
+
+
+/**@brief Acquisition statistics. */
+typedef struct
+{
+	uint32_t		ticks;						/**< Application timer ticks since scan start, samples per second are counted over it */
+	uint32_t		samples[ACQ_ADC_MAX];		/**< Samples read from each chip */
+	uint32_t		polls[ACQ_ADC_MAX];		/**< Transactions of each chip NACKed because conversion wasn't finished */
+	uint32_t		latency[ACQ_ADC_MAX];		/**< Measured conversion time of each chip, application timer ticks */
+	uint32_t		frames;						/**< Frames finished */
+	uint32_t		frame_overruns;				/**< Frames skipped because previous sweep was not finished in time */
+	uint32_t		errors[ACQ_CHANNEL_MAX];	/**< Frames in which each channel failed to be read */
+	acq_channel_mask_t	degraded_mask;			/**< Channels skipped by scan because of repeated failures */
+	uint32_t		queue_drops;				/**< Frames and samples dropped because scheduler queue was full */
+	uint16_t		queue_peak;					/**< High-water mark of the scheduler queue */
+	frame_ring_stats_t	ring;					/**< Frame ring counters, frames lost by the ring policy are counted there */
+} acq_stats_t;
+
+
+/**@brief Block of stream samples. Samples are taken exactly one period
+ *        apart. Slot of the sample which couldn't be read has it's bit 
+ *        set in missed mask and it's data is zeroed, so spacing of the
+ *        samples is kept. */
+typedef struct
+{
+	uint32_t		sequence;										/**< Block number since stream start */
+	uint32_t		period_us;										/**< Sampling period */
+	uint8_t			channel;										/**< Sampled channel */
+	uint8_t			count;											/**< Number of slots in block, less than block size only for the last one */
+	uint16_t		missed_mask;									/**< Slots which weren't read */
+	uint8_t			data[ACQ_STREAM_BLOCK_SIZE][LTC2497_DATA_LENGTH];	/**< Data read from ADC, indexed by slot */
+} acq_stream_block_t;
+
+
+/**@brief Sample handler type. Called from main loop through app_scheduler
+ *        when sample is read or acquisition has failed.
+ *
+ * @param[in]	channel		channel number
+ * @param[in]	result		NRF_SUCCESS or TWI error code
+ * @param[in]	p_data		LTC2497_DATA_LENGTH bytes read from ADC
+ */
+typedef void(*acq_sample_handler_t)(uint8_t channel, ret_code_t result, uint8_t const * p_data);
+
+/**@brief Frame handler type. Called from main loop through app_scheduler
+ *        when sweep of all enabled channels is finished. Frames finished
+ *        meanwhile wait in the frame ring.
+ *
+ * @param[in]	p_frame		frame, valid only during the call
+ */
+typedef void(*acq_frame_handler_t)(acq_frame_t const * p_frame);
+
+/**@brief Stream handler type. Called from interrupt context when block of
+ *        stream samples is filled or stream is stopped. Block is refilled
+ *        one block time later, so it isn't deferred to the main loop.
+ *
+ * @param[in]	p_block		block, valid only during the call
+ */
+typedef void(*acq_stream_handler_t)(acq_stream_block_t const * p_block);
+
+
+/**@brief Acquisition init structure. */
+typedef struct
+{
+	LTC2497_setup_t			setup;				/**< ADC setup applied to all chips */
+	uint32_t				vref_uv;			/**< ADC reference voltage, microvolts */
+	uint8_t const *			p_buses;			/**< I2C bus of each chip, NULL if all chips are on bus 0 */
+	uint8_t const *			p_addresses;		/**< I2C addresses of the chips, e.g. from device registry */
+	uint8_t					adc_count;			/**< Number of chips, up to ACQ_ADC_MAX */
+	acq_schedule_t			schedule;			/**< Order of chip sweeping */
+	frame_ring_policy_t		ring_policy;		/**< Frame lost when main loop falls behind */
+	acq_sample_handler_t	sample_handler;		/**< Handler of single samples, may be NULL */
+	acq_frame_handler_t		frame_handler;		/**< Handler of scanned frames, may be NULL */
+	acq_stream_handler_t	stream_handler;		/**< Handler of stream blocks, NULL disables the stream and leaves it's TIMER and PPI channel free */
+} acq_init_t;
+
+
+/**
+  * @brief  Initializes acquisition engine and sets up ADC chips.
+  *         Application timer, app_scheduler and TWI must be initialized 
+  *         before, app_sched_execute() must be called from the main loop.
+  *         Chips which fail to set up are left in the array, so channel
+  *         numbers don't depend on chip failures.
+  *
+  * @param[in]  p_init		acquisition init structure
+  * 
+  * @retval		NRF_SUCCESS or error code
+  */
+ret_code_t acq_init(acq_init_t const * p_init);
+
+/**
+  * @brief  Starts acquisition of single channel. Returns immediately,
+  *         result is passed to sample handler.
+  *
+  * @param[in]  channel		channel number (0 - acq_channel_count_get()-1)
+  * 
+  * @retval		NRF_ERROR_BUSY if previous sample is still in progress,
+  *				otherwise operation result code
+  */
+ret_code_t acq_sample_start(uint8_t channel);
+
+/**
+  * @brief  Starts frame scan. Every frame interval all channels from the
+  *         mask are read back to back and passed to frame handler.
+  *
+  * @param[in]  channel_mask		bit mask of channels to scan
+  * @param[in]  frame_interval_ms	frame interval
+  * 
+  * @retval		NRF_SUCCESS or timer error code
+  */
+ret_code_t acq_scan_start(acq_channel_mask_t channel_mask, uint32_t frame_interval_ms);
+
+/**
+  * @brief  Stops frame scan. Frame in progress is dropped.
+  */
+void acq_scan_stop(void);
+
+/**
+  * @brief  Starts hardware paced stream of single channel. Reads are
+  *         started by TIMER compare event through PPI, so the samples
+  *         are spaced exactly regardless of the CPU and radio load.
+  *         Frame scan must be stopped.
+  *
+  * @param[in]  channel		channel number (0 - acq_channel_count_get()-1)
+  * @param[in]  period_us	sampling period, not less than conversion time
+  * 
+  * @retval		NRF_ERROR_NOT_SUPPORTED if engine has no stream handler,
+  *				NRF_ERROR_INVALID_STATE if scan is active,
+  *				NRF_ERROR_BUSY if acquisition is in progress,
+  *				otherwise operation result code
+  */
+ret_code_t acq_stream_start(uint8_t channel, uint32_t period_us);
+
+/**
+  * @brief  Stops the stream. Samples read so far are passed to stream 
+  *         handler, engine becomes free after ACQ_STREAM_RELEASE_MS.
+  */
+void acq_stream_stop(void);
+
+/**
+  * @brief  Changes mask of scanned channels. Takes effect from the next frame.
+  *
+  * @param[in]  channel_mask	bit mask of channels to scan
+  */
+void acq_channel_mask_set(acq_channel_mask_t channel_mask);
+
+/**
+  * @brief  Changes frame interval. Running scan is restarted with the new
+  *         interval after the sweep in progress, otherwise interval is
+  *         only stored.
+  *
+  * @param[in]  frame_interval_ms	frame interval, not less than acq_sweep_time_ms()
+  * 
+  * @retval		NRF_ERROR_INVALID_PARAM if the sweep of the scanned channels
+  *				doesn't fit the interval, otherwise NRF_SUCCESS or timer error code
+  */
+ret_code_t acq_frame_interval_set(uint32_t frame_interval_ms);
+
+/**
+  * @brief  Returns frame interval of the last scan start or change.
+  *
+  * @retval Frame interval in milliseconds
+  */
+uint32_t acq_frame_interval_get(void);
+
+/**
+  * @brief  Changes ADC setup of all chips, such as rejection frequency
+  *         and speed. Setup is applied when the next frame, sample or 
+  *         stream is started, so it doesn't change under the sweep in 
+  *         progress.
+  *
+  * @param[in]  p_setup		ADC setup
+  * 
+  * @retval		NRF_ERROR_INVALID_STATE if scan is running and the sweep of 
+  *				the scanned channels with this setup doesn't fit it's frame
+  *				interval, otherwise NRF_SUCCESS
+  */
+ret_code_t acq_setup_set(LTC2497_setup_t const * p_setup);
+
+/**
+  * @brief  Estimates the longest sweep of the scanned channels with the setup
+  *         of the next frame, for the schedule the engine was initialized with.
+  *         Frame interval shorter than that overruns every frame.
+  *
+  * @retval Sweep time in milliseconds
+  */
+uint32_t acq_sweep_time_ms(void);
+
+/**
+  * @brief  Returns number of ADC chips the engine was initialized with.
+  *
+  * @retval Number of chips
+  */
+uint8_t acq_adc_count_get(void);
+
+/**
+  * @brief  Returns number of channels of all chips. Channels of the chip
+  *         are numbered after channels of the chips before it.
+  *
+  * @retval Number of channels
+  */
+uint8_t acq_channel_count_get(void);
+
+/**
+  * @brief  Returns acquisition statistics. Counters are cleared on scan start,
+  *         so samples per second can be measured over the scan time.
+  *
+  * @param[out] p_stats		statistics
+  */
+void acq_stats_get(acq_stats_t * p_stats);
+
+/**
+  * @brief  Checks if sample or frame is in progress.
+  *
+  * @retval true if acquisition engine is busy
+  */
+bool acq_is_busy(void);
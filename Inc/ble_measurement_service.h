@@ -15,6 +15,7 @@
 #include <stdbool.h>
 #include "ble.h"
 #include "ble_srv_common.h"
+#include "frame_codec.h"
 
 #define MEASUREMENT_SERVICE_UUID_BASE			{0x25, 0x81, 0xE8, 0x8C, 0x72, 0x2E, 0x8F, 0x97,  \
                                                  0xEA, 0x11, 0x45, 0x29,  0x08, 0x91, 0xD3, 0x5B}
@@ -36,6 +37,52 @@
 #define MEASUREMENT_CH14_CHAR_UUID              0x140E
 #define MEASUREMENT_CH15_CHAR_UUID              0x140F
 #define MEASUREMENT_CH16_CHAR_UUID              0x1410
+#define MEASUREMENT_CAL_CHAR_UUID               0x1480
+#define MEASUREMENT_FRAME_CHAR_UUID             0x1481
+#define MEASUREMENT_LINK_CHAR_UUID              0x1482
+#define MEASUREMENT_CONTROL_CHAR_UUID           0x1483
+#define MEASUREMENT_STREAM_CHAR_UUID            0x1484
+
+#define BLE_MEAS_CHANNEL_MAX					64		/**< Channel n value characteristic is MEASUREMENT_CH01_CHAR_UUID + n */
+#define MEASUREMENT_CAL_CHAR_MAX_LEN			17		/**< Calibration record of single channel */
+#define MEASUREMENT_LINK_CHAR_MAX_LEN			16		/**< Link profile, connection parameters, PHY and throughput */
+#define MEASUREMENT_CONTROL_CHAR_MAX_LEN		9		/**< Opcode and the longest parameter, channel bitmap */
+
+/* Control point: write with response of opcode followed by it's parameters, 
+ * little endian. Command is executed before the response, which carries 
+ * success or one of the BLE_MEAS_CTRL_ERR_ codes. */
+#define BLE_MEAS_CTRL_ERR_OPCODE				(BLE_GATT_STATUS_ATTERR_APP_BEGIN + 0)	/**< Unknown opcode */
+#define BLE_MEAS_CTRL_ERR_PARAM					(BLE_GATT_STATUS_ATTERR_APP_BEGIN + 1)	/**< Parameter out of range */
+#define BLE_MEAS_CTRL_ERR_STATE					(BLE_GATT_STATUS_ATTERR_APP_BEGIN + 2)	/**< Command not allowed now */
+#define BLE_MEAS_CTRL_ERR_FAILED				(BLE_GATT_STATUS_ATTERR_APP_BEGIN + 3)	/**< Command failed */
+
+/* Frame notification: sequence (2 bytes), timestamp (3 bytes), channel bitmap 
+ * (1 bit per channel of the service, bit n is channel n) and 3 byte signed 
+ * microvolts of every channel in the bitmap in ascending order, all little 
+ * endian. Frame which doesn't fit single notification is split, parts 
+ * have the same sequence and timestamp and disjoint bitmaps. Delta encoding 
+ * packs the frame as described in frame_codec.h. */
+#define BLE_MEAS_TX_QUEUE_SIZE					8		/**< Frame notifications waiting for SoftDevice buffers */
+#define BLE_MEAS_HVN_TX_QUEUE_SIZE				8		/**< SoftDevice notification queue, hvn_tx_queue_size of the connection */
+#define BLE_MEAS_SCHED_EVENT_DATA_SIZE			8		/**< Scheduler event data size needed by the service, for APP_SCHED_INIT */
+
+#define BLE_MEAS_ATT_HEADER_LEN					3		/**< Opcode and handle of the notification */
+#define BLE_MEAS_FRAME_HEADER_LEN				5		/**< Sequence and timestamp */
+#define BLE_MEAS_FRAME_VALUE_LEN				3		/**< Signed microvolts, saturated */
+#define BLE_MEAS_FRAME_MASK_LEN(channel_count)	(((channel_count) + 7) / 8)
+#define MEASUREMENT_FRAME_CHAR_MAX_LEN			(BLE_MEAS_FRAME_HEADER_LEN + BLE_MEAS_FRAME_MASK_LEN(BLE_MEAS_CHANNEL_MAX) + \
+												 BLE_MEAS_CHANNEL_MAX * BLE_MEAS_FRAME_VALUE_LEN)
+
+/* Stream notification: block sequence (2 bytes), channel (1 byte), first slot
+ * of the part (1 byte), missed slots of the part (2 bytes, bit 0 is the first
+ * slot) and 4 bytes read from the ADC for every slot, all little endian. 
+ * Slots are one sampling period apart, slot which wasn't read is zeroed. 
+ * Block which doesn't fit single notification is split, slot count of the
+ * part is given by it's length. */
+#define BLE_MEAS_STREAM_HEADER_LEN				6		/**< Block sequence, channel, first slot and missed slots */
+#define BLE_MEAS_STREAM_SLOT_LEN				4		/**< Data of single sample as read from the ADC */
+#define BLE_MEAS_STREAM_SLOT_MAX				16		/**< Slots of single block, bits of the missed mask */
+#define MEASUREMENT_STREAM_CHAR_MAX_LEN			(BLE_MEAS_STREAM_HEADER_LEN + BLE_MEAS_STREAM_SLOT_MAX * BLE_MEAS_STREAM_SLOT_LEN)
 
 
 /**@brief   Macro for defining a Measurement Service instance.
@@ -56,10 +103,88 @@ typedef enum
 	BLE_MEAS_EVT_NOTIFICATION_ENABLED,
 	BLE_MEAS_EVT_NOTIFICATION_DISABLED,
 	BLE_MEAS_EVT_DISCONNECTED,
-	BLE_MEAS_EVT_CONNECTED
+	BLE_MEAS_EVT_CONNECTED,
+	BLE_MEAS_EVT_CAL_WRITTEN,
+	BLE_MEAS_EVT_FRAME_NOTIFICATION_ENABLED,
+	BLE_MEAS_EVT_FRAME_NOTIFICATION_DISABLED
 } ble_meas_evt_type_t;
 
 
+/**@brief Control point opcodes. */
+typedef enum
+{
+	BLE_MEAS_CTRL_OP_CHANNEL_MASK		= 0x01,		/**< Channels of the Frame characteristic, bitmap of 1 - 8 bytes, missing bytes are zero */
+	BLE_MEAS_CTRL_OP_FRAME_INTERVAL		= 0x02,		/**< Frame interval, 2 bytes, milliseconds */
+	BLE_MEAS_CTRL_OP_ENCODING			= 0x03,		/**< Frame encoding, 1 byte, ble_meas_encoding_t */
+	BLE_MEAS_CTRL_OP_FILTER				= 0x04,		/**< ADC filter, 1 byte rejection (ble_meas_rejection_t), 1 byte speed (ble_meas_speed_t) */
+	BLE_MEAS_CTRL_OP_STREAM				= 0x05,		/**< 1 byte, 1 starts the frame scan, 0 stops it */
+	BLE_MEAS_CTRL_OP_DEADBAND			= 0x06,		/**< Dead band: 1 byte channel (0xFF for all), 2 bytes microvolts, 
+													 2 bytes per mille of the value, 2 bytes keepalive milliseconds */
+	BLE_MEAS_CTRL_OP_HW_STREAM			= 0x07		/**< Hardware paced stream of single channel to the Stream characteristic:
+													 1 byte channel (BLE_MEAS_HW_STREAM_STOP stops it), 4 bytes period in
+													 microseconds. Frame scan must be stopped first */
+} ble_meas_ctrl_op_t;
+
+#define BLE_MEAS_HW_STREAM_STOP					0xFF	/**< Channel of BLE_MEAS_CTRL_OP_HW_STREAM which stops the stream */
+
+
+/**@brief Frame encodings. */
+typedef enum
+{
+	BLE_MEAS_ENCODING_ABSOLUTE			= 0x00,		/**< 3 byte signed microvolts of every channel */
+	BLE_MEAS_ENCODING_DELTA				= 0x01,		/**< Zigzag varint differences with keyframes, frame_codec.h */
+	BLE_MEAS_ENCODING_COUNT
+} ble_meas_encoding_t;
+
+
+/**@brief Mains frequency rejected by the ADC filter. */
+typedef enum
+{
+	BLE_MEAS_REJECTION_50_60_HZ			= 0x00,
+	BLE_MEAS_REJECTION_50_HZ			= 0x01,
+	BLE_MEAS_REJECTION_60_HZ			= 0x02
+} ble_meas_rejection_t;
+
+
+/**@brief ADC speed, 2X skips offset calibration of every conversion. */
+typedef enum
+{
+	BLE_MEAS_SPEED_1X					= 0x00,
+	BLE_MEAS_SPEED_2X					= 0x01
+} ble_meas_speed_t;
+
+
+/**@brief Decoded control point command. */
+typedef struct
+{
+	uint8_t							opcode;					/**< ble_meas_ctrl_op_t */
+	union
+	{
+		uint64_t					channel_mask;
+		uint16_t					frame_interval_ms;
+		uint8_t						encoding;
+		struct
+		{
+			uint8_t					rejection;
+			uint8_t					speed;
+		}							filter;
+		bool						start;
+		struct
+		{
+			uint8_t					channel;
+			uint16_t				abs_uv;
+			uint16_t				rel_permille;
+			uint16_t				max_silence_ms;
+		}							deadband;
+		struct
+		{
+			uint8_t					channel;
+			uint32_t				period_us;
+		}							hw_stream;
+	}								params;
+} ble_meas_ctrl_cmd_t;
+
+
 /**@brief Measurement Service event. */
 typedef struct
 {
@@ -74,6 +199,12 @@ typedef struct ble_meas_s ble_meas_t;
 /**@brief Measurement Service event handler type. */
 typedef void(*ble_meas_evt_handler_t)(ble_meas_t * p_cus, ble_meas_evt_t * p_evt);
 
+/**@brief Control point command handler type. Called from BLE event context before
+ *        the write response, result is mapped to the BLE_MEAS_CTRL_ERR_ codes:
+ *        NRF_ERROR_INVALID_PARAM and NRF_ERROR_NOT_SUPPORTED to parameter error,
+ *        NRF_ERROR_INVALID_STATE and NRF_ERROR_BUSY to state error. */
+typedef ret_code_t(*ble_meas_ctrl_handler_t)(ble_meas_t * p_meas, ble_meas_ctrl_cmd_t const * p_cmd);
+
 	
 /**@brief Measurement Service init structure. This contains all options and data needed for
  *        initialization of the service.*/
@@ -82,16 +213,55 @@ typedef struct
 	ble_meas_evt_handler_t          evt_handler;            /**< Event handler to be called for handling events in the Custom Service. */
 	uint8_t							initial_value;          /**< Initial value */
 	ble_srv_cccd_security_mode_t	value_char_attr_md;     /**< Initial security level for Measurement characteristics attribute */
+	uint8_t							channel_count;			/**< Number of the value characteristics, not more than BLE_MEAS_CHANNEL_MAX */
+	ble_meas_ctrl_handler_t			ctrl_handler;			/**< Handler of the control point commands, commands fail with BLE_MEAS_CTRL_ERR_STATE if NULL */
 	
 } ble_meas_init_t;
 
 
+/**@brief Frame or stream notification waiting to be passed to the SoftDevice. */
+typedef struct
+{
+	uint16_t						handle;					/**< Value handle of the characteristic notified */
+	uint16_t						length;
+	bool							last;					/**< Last part of the frame */
+	uint8_t							data[MEASUREMENT_FRAME_CHAR_MAX_LEN];
+} ble_meas_tx_packet_t;
+
+
+/**@brief Frame transmission counters. */
+typedef struct
+{
+	uint32_t						frames;					/**< Frames and stream blocks passed to the SoftDevice whole */
+	uint32_t						dropped;				/**< Frames and stream blocks lost because the queue was full or notification failed */
+	uint32_t						completed;				/**< Notifications sent, from BLE_GATTS_EVT_HVN_TX_COMPLETE */
+	uint32_t						bytes;					/**< Frame data passed to the SoftDevice */
+} ble_meas_tx_stats_t;
+
+
 /**@brief Measurement Service structure. This contains various status information for the service. */
 struct ble_meas_s
 {
 	ble_meas_evt_handler_t          evt_handler;            /**< Event handler to be called for handling events in the Custom Service. */
 	uint16_t                        service_handle;         /**< Handle of Measurement Service (as provided by the BLE stack). */
-	ble_gatts_char_handles_t		value_handles[16];	    /**< Handles related to the Measurement Value characteristic. */
+	ble_gatts_char_handles_t		value_handles[BLE_MEAS_CHANNEL_MAX];	/**< Handles related to the Measurement Value characteristic. */
+	uint8_t							channel_count;			/**< Number of the value characteristics. */
+	ble_gatts_char_handles_t		cal_handles;			/**< Handles related to the Calibration characteristic. */
+	ble_gatts_char_handles_t		frame_handles;			/**< Handles related to the Frame characteristic. */
+	ble_gatts_char_handles_t		link_handles;			/**< Handles related to the Link characteristic. */
+	ble_gatts_char_handles_t		ctrl_handles;			/**< Handles related to the Control Point characteristic. */
+	ble_gatts_char_handles_t		stream_handles;			/**< Handles related to the Stream characteristic. */
+	ble_meas_ctrl_handler_t			ctrl_handler;			/**< Handler of the control point commands. */
+	uint8_t							encoding;				/**< Frame encoding, ble_meas_encoding_t. */
+	frame_encoder_t					encoder;				/**< State of the delta encoding. */
+	uint16_t						max_payload;			/**< Notification payload which fits ATT MTU. */
+	bool							frame_notification;		/**< Frame notification enabled by the client. */
+	bool							stream_notification;	/**< Stream notification enabled by the client. */
+	ble_meas_tx_packet_t			tx_queue[BLE_MEAS_TX_QUEUE_SIZE];	/**< Frame notifications waiting for SoftDevice buffers. */
+	uint8_t							tx_head;
+	uint8_t							tx_tail;
+	uint8_t							tx_count;
+	ble_meas_tx_stats_t				tx_stats;
 	uint16_t						conn_handle;            /**< Handle of the current connection (as provided by the BLE stack, is BLE_CONN_HANDLE_INVALID if not in a connection). */
 	uint8_t							uuid_type; 
 };
@@ -100,6 +270,27 @@ struct ble_meas_s
 
 
 
+/**@brief Block of stream samples to be notified. */
+typedef struct
+{
+	uint32_t						sequence;				/**< Block number, low 16 bits are sent */
+	uint8_t							channel;				/**< Sampled channel */
+	uint8_t							count;					/**< Number of slots, not more than BLE_MEAS_STREAM_SLOT_MAX */
+	uint16_t						missed_mask;			/**< Slots which weren't read */
+	uint8_t const *					p_data;					/**< BLE_MEAS_STREAM_SLOT_LEN bytes of every slot */
+} ble_meas_stream_block_t;
+
+
+/**@brief Frame of channel values to be notified at once. */
+typedef struct
+{
+	uint32_t						sequence;				/**< Frame number, low 16 bits are sent */
+	uint32_t						timestamp;				/**< Application timer ticks, 24 bits */
+	uint64_t						channel_mask;			/**< Channels to be sent */
+	int32_t const *					p_values;				/**< Values in microvolts, indexed by channel */
+} ble_meas_frame_t;
+
+
 typedef struct ble_char_init
 {
 	uint8_t							char_prop_read;
@@ -150,4 +341,109 @@ void ble_meas_on_ble_evt(ble_evt_t const * p_ble_evt, void * p_context);
  * @return      NRF_SUCCESS on success, otherwise an error code.
  */
 
-uint32_t ble_meas_value_update(ble_meas_t * p_cus, uint8_t* value, uint8_t value_char_num);
\ No newline at end of file
+uint32_t ble_meas_value_update(ble_meas_t * p_cus, uint8_t* value, uint8_t value_char_num);
+
+
+/**@brief Function for updating the calibration record value.
+ *
+ * @details The application calls this function on start and after every write of the 
+ *          Calibration characteristic, so reading it returns the selected record.
+ *
+ * @param[in]   p_meas         Measurement Service structure.
+ * @param[in]   p_data         Calibration record.
+ * @param[in]   length         Record length, not more than MEASUREMENT_CAL_CHAR_MAX_LEN.
+ *
+ * @return      NRF_SUCCESS on success, otherwise an error code.
+ */
+uint32_t ble_meas_cal_update(ble_meas_t * p_meas, uint8_t const * p_data, uint16_t length);
+
+
+/**@brief Function for sending the frame of channel values.
+ *
+ * @details Values of all channels in the mask are packed into Frame characteristic
+ *          notifications, as many as fit the payload size, and queued. Queue is passed
+ *          to the SoftDevice until it's buffers are full and resumed when they are sent.
+ *          Notification is sent only if the client has enabled it. Must be called from
+ *          the main loop.
+ *
+ * @param[in]   p_meas         Measurement Service structure.
+ * @param[in]   p_frame        Frame to be sent.
+ *
+ * @return      NRF_SUCCESS if frame is queued, NRF_ERROR_NO_MEM if queue is full,
+ *              otherwise an error code.
+ */
+uint32_t ble_meas_frame_send(ble_meas_t * p_meas, ble_meas_frame_t const * p_frame);
+
+
+/**@brief Function for sending the block of stream samples.
+ *
+ * @details Slots are packed into Stream characteristic notifications, as many as fit
+ *          the payload size, and queued with the frames. Block is queued whole or not
+ *          at all. Notification is sent only if the client has enabled it. Must be
+ *          called from the main loop.
+ *
+ * @param[in]   p_meas         Measurement Service structure.
+ * @param[in]   p_block        Block to be sent.
+ *
+ * @return      NRF_SUCCESS if block is queued, NRF_ERROR_NO_MEM if queue is full,
+ *              otherwise an error code.
+ */
+uint32_t ble_meas_stream_send(ble_meas_t * p_meas, ble_meas_stream_block_t const * p_block);
+
+
+/**@brief Function for setting the ATT MTU negotiated for the connection.
+ *
+ * @details The application calls this function on NRF_BLE_GATT_EVT_ATT_MTU_UPDATED, so the
+ *          frames are packed into notifications as large as the link allows. MTU returns
+ *          to the default on disconnect.
+ *
+ * @param[in]   p_meas         Measurement Service structure.
+ * @param[in]   att_mtu        Effective ATT MTU.
+ */
+void ble_meas_att_mtu_set(ble_meas_t * p_meas, uint16_t att_mtu);
+
+
+/**@brief Function for getting frame transmission counters.
+ *
+ * @param[in]   p_meas         Measurement Service structure.
+ * @param[out]  p_stats        Counters.
+ */
+void ble_meas_tx_stats_get(ble_meas_t const * p_meas, ble_meas_tx_stats_t * p_stats);
+
+
+/**@brief Function for getting delta encoding counters, compression ratio included.
+ *
+ * @param[in]   p_meas         Measurement Service structure.
+ * @param[out]  p_stats        Counters.
+ */
+void ble_meas_codec_stats_get(ble_meas_t const * p_meas, frame_codec_stats_t * p_stats);
+
+
+/**@brief Function for updating the link status value.
+ *
+ * @details The application calls this function when the link profile or connection
+ *          parameters change. Value is notified if the client has enabled it.
+ *
+ * @param[in]   p_meas         Measurement Service structure.
+ * @param[in]   p_data         Link status.
+ * @param[in]   length         Status length, not more than MEASUREMENT_LINK_CHAR_MAX_LEN.
+ *
+ * @return      NRF_SUCCESS on success, otherwise an error code.
+ */
+uint32_t ble_meas_link_update(ble_meas_t * p_meas, uint8_t const * p_data, uint16_t length);
+
+
+/**@brief Function for selecting the frame encoding.
+ *
+ * @details Encoding is switched from the main loop through app_scheduler, so it may be
+ *          called from BLE event context while frames are being sent. Frames handed
+ *          over before are sent in the old encoding, delta encoding starts with keyframe.
+ *          Encoding returns to BLE_MEAS_ENCODING_ABSOLUTE on disconnect.
+ *
+ * @param[in]   p_meas         Measurement Service structure.
+ * @param[in]   encoding       Frame encoding, ble_meas_encoding_t.
+ *
+ * @return      NRF_SUCCESS on success, NRF_ERROR_NOT_SUPPORTED if encoding is unknown,
+ *              NRF_ERROR_BUSY if scheduler queue is full.
+ */
+uint32_t ble_meas_encoding_set(ble_meas_t * p_meas, uint8_t encoding);
\ No newline at end of file
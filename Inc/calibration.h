@@ -0,0 +1,129 @@
+/**
+ * @file
+ * calibration.h
+ * 
+ * @brief Per-channel calibration
+ * 
+ * This file declares calibration table of the measurement channels and
+ * functions for it's use. Every channel has offset, gain, second order
+ * and temperature coefficient, which are applied to the input voltage 
+ * in fixed point:
+ * 
+ *     corrected = offset + gain * x + quad * x^2 - tempco * (T - Tref)
+ * 
+ * T is temperature of the ADC chip, Tref is temperature at which the
+ * table was taken. Temperature term removes drift of the sensors while
+ * the glove warms up.
+ * 
+ * Table is kept in flash by FDS, so it survives power cycle.
+ * 
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdk_errors.h"
+
+#define CAL_CHANNEL_COUNT			64
+
+#define CAL_GAIN_Q					16			/**< Gain fractional bits, 1 << CAL_GAIN_Q is gain of 1.0 */
+#define CAL_QUAD_Q					48			/**< Second order coefficient fractional bits, per microvolt */
+#define CAL_TEMPCO_Q				8			/**< Temperature coefficient fractional bits, microvolts per kelvin */
+#define CAL_TEMP_Q					8			/**< Temperature fractional bits, kelvin */
+
+#define CAL_FILE_ID					0x1CA1		/**< FDS file of the calibration table */
+#define CAL_RECORD_KEY				0x0001		/**< FDS record key of the calibration table */
+
+#define CAL_CHANNEL_RECORD_LENGTH	17			/**< Channel number followed by channel coefficients, as written over BLE */
+#define CAL_TEMP_REF_RECORD_LENGTH	5			/**< CAL_TEMP_REF_RECORD followed by reference temperature */
+#define CAL_TEMP_REF_RECORD			0xFF		/**< First byte of the reference temperature record */
+#define CAL_SELECT_RECORD_LENGTH	1			/**< Channel number or CAL_TEMP_REF_RECORD, selects record to be read */
+#define CAL_RECORD_MAX_LENGTH		CAL_CHANNEL_RECORD_LENGTH
+#define CAL_TEMP_UNKNOWN			INT32_MIN	/**< Temperature isn't measured, temperature term is skipped */
+
+
+/**@brief Calibration coefficients of single channel. */
+typedef struct
+{
+	int32_t			offset_uv;		/**< Offset, microvolts */
+	int32_t			gain;			/**< Gain, Q CAL_GAIN_Q */
+	int32_t			quad;			/**< Second order coefficient, Q CAL_QUAD_Q per microvolt */
+	int32_t			tempco;			/**< Temperature coefficient, microvolts per kelvin, Q CAL_TEMPCO_Q */
+} cal_coeff_t;
+
+
+/**@brief Calibration table of all channels. */
+typedef struct
+{
+	cal_coeff_t		channel[CAL_CHANNEL_COUNT];
+	int32_t			temp_ref;		/**< Reference temperature, kelvin, Q CAL_TEMP_Q */
+} cal_table_t;
+
+
+/**
+  * @brief  Initializes FDS and loads calibration table from flash. Waits
+  *         until the table is loaded, so it must be called after
+  *         SoftDevice is enabled and before acquisition starts.
+  *         If table isn't found, all channels are left uncalibrated.
+  *
+  * @retval		NRF_SUCCESS or FDS error code
+  */
+ret_code_t cal_init(void);
+
+/**
+  * @brief  Applies calibration of the channel to the input voltage.
+  *
+  * @param[in]  channel		channel number (0 - CAL_CHANNEL_COUNT-1)
+  * @param[in]  uv			input voltage, microvolts
+  * @param[in]  temp		ADC chip temperature, kelvin, Q CAL_TEMP_Q, 
+  *						or CAL_TEMP_UNKNOWN
+  *
+  * @retval		Corrected voltage, microvolts
+  */
+int32_t cal_apply(uint8_t channel, int32_t uv, int32_t temp);
+
+/**
+  * @brief  Changes calibration of the channel and stores the table to
+  *         flash. Write is finished in background.
+  *
+  * @param[in]  channel		channel number (0 - CAL_CHANNEL_COUNT-1)
+  * @param[in]  p_coeff		channel coefficients
+  *
+  * @retval		NRF_ERROR_INVALID_PARAM if channel is out of range,
+  *				otherwise FDS operation result code
+  */
+ret_code_t cal_channel_set(uint8_t channel, cal_coeff_t const * p_coeff);
+
+/**
+  * @brief  Changes calibration from record written over BLE: channel 
+  *         number followed by offset, gain, second order and temperature 
+  *         coefficient, or CAL_TEMP_REF_RECORD followed by reference 
+  *         temperature. Values are little endian. Record of the first
+  *         byte only changes nothing. Written record becomes selected
+  *         for cal_record_read().
+  *
+  * @param[in]  p_record	record data
+  * @param[in]  length		record length
+  *
+  * @retval		NRF_ERROR_INVALID_LENGTH, NRF_ERROR_INVALID_PARAM 
+  *				or cal_channel_set() result code
+  */
+ret_code_t cal_record_write(uint8_t const * p_record, uint16_t length);
+
+/**
+  * @brief  Gets the record selected by the last cal_record_write(), in
+  *         the same format. Table of all channels is too large for single
+  *         BLE attribute, so it is read one record at time.
+  *
+  * @param[out] p_record	record data, CAL_RECORD_MAX_LENGTH bytes
+  *
+  * @retval		Record length
+  */
+uint16_t cal_record_read(uint8_t * p_record);
+
+/**
+  * @brief  Returns calibration table, e.g. to be read over BLE.
+  *
+  * @retval		Calibration table
+  */
+cal_table_t const * cal_table_get(void);
@@ -0,0 +1,93 @@
+/**
+ * @file
+ * deadband.h
+ *
+ * @brief Per-channel change detection
+ *
+ * This file declares dead band filter, which decides what channels of
+ * the frame are worth sending. Channel value is compared with the last
+ * value sent, and channel is suppressed while the change stays inside
+ * the dead band:
+ *
+ *     |x - last| <= max(abs_uv, |last| * rel_permille / 1000)
+ *
+ * Channel suppressed for max_silence_ms is sent anyway, so the client
+ * can tell resting hand from the lost link. Suppressed channels are left
+ * out of the frame bitmap, so frames of a resting hand carry only the
+ * keepalives.
+ *
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdk_errors.h"
+
+#define DEADBAND_CHANNEL_COUNT		64
+#define DEADBAND_CHANNEL_ALL		0xFF		/**< Configures all channels at once */
+
+
+/**@brief Dead band of single channel. Zero thresholds send every value. */
+typedef struct
+{
+	uint16_t		abs_uv;				/**< Change up to this is suppressed, microvolts */
+	uint16_t		rel_permille;		/**< Change up to this part of the last value sent is suppressed, 1/1000 */
+	uint16_t		max_silence_ms;		/**< Channel is sent at least this often, 0 disables keepalive */
+} deadband_config_t;
+
+
+/**@brief Dead band statistics. */
+typedef struct
+{
+	uint32_t		checked;			/**< Channel values passed to the filter */
+	uint32_t		suppressed;			/**< Channel values left out */
+	uint32_t		keepalives;			/**< Channel values sent only because of the silence limit */
+} deadband_stats_t;
+
+
+/**
+  * @brief  Sets dead band of all channels and forgets the values sent.
+  *         May be called from interrupt.
+  *
+  * @param[in]  p_config	dead band of every channel
+  */
+void deadband_init(deadband_config_t const * p_config);
+
+/**
+  * @brief  Sets dead band of the channel. Takes effect from the next channel
+  *         checked. May be called from interrupt.
+  *
+  * @param[in]  channel		channel number (0 - DEADBAND_CHANNEL_COUNT-1)
+  *							or DEADBAND_CHANNEL_ALL
+  * @param[in]  p_config	dead band
+  *
+  * @retval		NRF_ERROR_INVALID_PARAM if channel doesn't exist,
+  *				otherwise NRF_SUCCESS
+  */
+ret_code_t deadband_config_set(uint8_t channel, deadband_config_t const * p_config);
+
+/**
+  * @brief  Forgets the values sent, so every channel of the next frame is
+  *         sent. Called when the client starts listening, may be called
+  *         from interrupt.
+  */
+void deadband_reset(void);
+
+/**
+  * @brief  Picks channels of the frame to be sent and takes their values
+  *         as the last values sent.
+  *
+  * @param[in]  channel_mask	channels read in the frame
+  * @param[in]  p_values		values, indexed by channel
+  * @param[in]  timestamp		application timer counter at the frame start
+  *
+  * @retval		Mask of channels to be sent
+  */
+uint64_t deadband_apply(uint64_t channel_mask, int32_t const * p_values, uint32_t timestamp);
+
+/**
+  * @brief  Gets dead band statistics.
+  *
+  * @param[out] p_stats		statistics
+  */
+void deadband_stats_get(deadband_stats_t * p_stats);
@@ -0,0 +1,158 @@
+/**
+ * @file
+ * device_registry.h
+ *
+ * @brief Registry of the devices on I2C bus
+ *
+ * This file declares registry of the devices found on the bus and
+ * functions for it's discovery. Only address ranges where a known
+ * device may be are probed, on all initialized buses in parallel, and
+ * probing runs asynchronously, so other initialization goes on
+ * meanwhile. Registry is kept in flash by FDS, so the next boot takes
+ * it from there without probing. Self-test measures transaction time
+ * of every device at each clock it supports and selects the fastest
+ * clock which works without errors. Clock selected is kept in the
+ * registry, so the test runs only after discovery or on request.
+ *
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdk_errors.h"
+#include "i2c.h"
+
+#define DEV_REGISTRY_SIZE			16			/**< Maximum number of the devices in registry */
+#define DEV_SELFTEST_XFERS			4			/**< Reads at each clock in self-test, every one waits for conversion */
+
+#define DEV_FILE_ID					0x1DE5		/**< FDS file of the registry */
+#define DEV_RECORD_KEY				0x0001		/**< FDS record key of the registry */
+
+
+/**@brief Device types */
+typedef enum
+{
+	DEV_TYPE_UNKNOWN = 0,
+	DEV_TYPE_LTC2497
+} dev_type_t;
+
+
+/**@brief Registry entry of single device. */
+typedef struct
+{
+	uint8_t			bus;			/**< I2C bus index */
+	uint8_t			address;		/**< 7 bit I2C address */
+	uint8_t			type;			/**< Device type, dev_type_t */
+	uint8_t			speed;			/**< Clock selected by self-test, TWI_SPEED_DEFAULT until tested */
+} dev_entry_t;
+
+
+/**@brief Self-test result of single device. */
+typedef struct
+{
+	uint8_t			speed;						/**< Selected clock, twi_speed_t */
+	uint8_t			errors[TWI_SPEED_COUNT];	/**< Reads failed at each clock, by bus error or by address NACK after all polls */
+	uint16_t		xfer_us[TWI_SPEED_COUNT];	/**< Average time of completed read at each clock, 0 if none completed or not tested */
+} dev_timing_t;
+
+
+/**@brief Devices found, in ascending bus and address order. */
+typedef struct
+{
+	uint8_t			count;
+	uint8_t			reserved[3];
+	dev_entry_t		device[DEV_REGISTRY_SIZE];
+} dev_registry_t;
+
+
+/**
+  * @brief  Initializes FDS and loads the registry saved by the last
+  *         discovery. Waits until the registry is loaded, so it must be
+  *         called after SoftDevice is enabled.
+  *
+  * @retval		NRF_SUCCESS or FDS error code
+  */
+ret_code_t dev_registry_init(void);
+
+/**
+  * @brief  Starts discovery of the devices. If registry was loaded from
+  *         flash and the cache is allowed, discovery finishes at once.
+  *         Otherwise candidate addresses are probed in background, and
+  *         changed registry is saved to flash. Buses to be probed must
+  *         be initialized.
+  *
+  * @param[in]  use_cache	registry loaded from flash may be used
+  *
+  * @retval		NRF_ERROR_BUSY if discovery or self-test is in progress,
+  *				otherwise NRF_SUCCESS
+  */
+ret_code_t dev_discovery_start(bool use_cache);
+
+/**
+  * @brief  Checks if discovery is in progress.
+  *
+  * @retval		true if probing isn't finished
+  */
+bool dev_discovery_is_busy(void);
+
+/**
+  * @brief  Returns the registry. It is valid when discovery isn't busy.
+  *
+  * @retval		Registry of the devices
+  */
+dev_registry_t const * dev_registry_get(void);
+
+/**
+  * @brief  Gets buses and addresses of the devices of given type.
+  *
+  * @param[in]  type			device type
+  * @param[out] p_buses		buses of the devices
+  * @param[out] p_addresses	addresses of the devices
+  * @param[in]  max_count		size of the arrays
+  *
+  * @retval		Number of devices
+  */
+uint8_t dev_registry_addresses_get(dev_type_t type, uint8_t * p_buses, uint8_t * p_addresses, uint8_t max_count);
+
+/**
+  * @brief  Starts self-test of all devices in registry, which sets the 
+  *         clock of each device. Every device is tested with single byte 
+  *         reads, conversion started by each read is waited out, and the
+  *         fastest clock at which all reads complete is selected. Takes
+  *         about DEV_SELFTEST_XFERS conversion times per clock and runs
+  *         in background, the devices must not be used until it finishes.
+  *         Clocks selected are saved with the registry. If every device
+  *         has a clock from the last test and the cache is allowed, the
+  *         clocks are set and the test finishes at once.
+  *
+  * @param[in]  use_cache	clocks saved with the registry may be used
+  *
+  * @retval		NRF_ERROR_BUSY if self-test is in progress,
+  *				NRF_ERROR_INVALID_STATE if discovery isn't finished,
+  *				otherwise NRF_SUCCESS
+  */
+ret_code_t dev_selftest_start(bool use_cache);
+
+/**
+  * @brief  Checks if self-test is in progress.
+  *
+  * @retval		true if the clocks aren't selected yet
+  */
+bool dev_selftest_is_busy(void);
+
+/**
+  * @brief  Returns self-test result of the device, e.g. for diagnostics.
+  *
+  * @param[in]  index		device index in registry
+  *
+  * @retval		Self-test result or NULL if index is out of range
+  */
+dev_timing_t const * dev_timing_get(uint8_t index);
+
+/**
+  * @brief  Removes registry from flash, e.g. when the device from registry
+  *         doesn't answer, so the next boot probes the bus again.
+  *
+  * @retval		NRF_SUCCESS or FDS error code
+  */
+ret_code_t dev_registry_invalidate(void);
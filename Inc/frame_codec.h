@@ -0,0 +1,230 @@
+/**
+ * @file
+ * frame_codec.h
+ *
+ * @brief Delta frame codec
+ *
+ * This file declares encoder and decoder of the delta encoded frames.
+ * Consecutive samples of a channel differ by a few LSB, so every channel
+ * is sent as difference from it's last value sent, zigzag mapped and
+ * written as variable length integer: 7 bits per byte, least significant
+ * first, high bit set in every byte but the last. Difference of a resting
+ * sensor takes one or two bytes instead of three.
+ *
+ * Frame which doesn't fit single packet is split, parts have the same
+ * sequence and timestamp and disjoint bitmaps. Packet layout, little
+ * endian:
+ *
+ *     sequence (2), timestamp (3), flags (1), reference sequence (2),
+ *     channel bitmap, varint of every channel in the bitmap
+ *
+ * Keyframe carries absolute value of every channel, the last value sent
+ * for the channels not read in the frame, so the decoder state equals the
+ * encoder state after it. Keyframe is sent periodically and on request,
+ * e.g. after packet was lost on the device. Delta frame names the frame
+ * it's differences refer to, so the decoder which has missed a frame or
+ * a part of it knows it's out of sync and skips packets until the next
+ * keyframe.
+ *
+ * Codec doesn't depend on the SDK, so the same sources build the decoder
+ * of the host.
+ *
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define FRAME_CODEC_CHANNEL_MAX			64
+#define FRAME_CODEC_KEYFRAME_INTERVAL	32			/**< Default frames between keyframes */
+
+#define FRAME_CODEC_HEADER_LEN			8			/**< Sequence, timestamp, flags and reference sequence */
+#define FRAME_CODEC_FLAGS_OFFSET		5
+#define FRAME_CODEC_FLAG_KEYFRAME		0x80		/**< Values are absolute */
+#define FRAME_CODEC_FLAG_LAST			0x40		/**< Last part of the frame */
+#define FRAME_CODEC_PART_MASK			0x3F		/**< Part number within the frame */
+#define FRAME_CODEC_MASK_LEN(channel_count)	(((channel_count) + 7) / 8)
+#define FRAME_CODEC_VALUE_MAX_LEN		4			/**< Varint of 24 bit value or difference of two */
+
+#define FRAME_CODEC_VALUE_MAX			0x7FFFFF	/**< Values are saturated to 24 bit signed */
+#define FRAME_CODEC_VALUE_MIN			(-0x800000)
+
+
+/**@brief Frame to be encoded. */
+typedef struct
+{
+	uint16_t		sequence;
+	uint32_t		timestamp;				/**< 24 bits are sent */
+	uint64_t		channel_mask;			/**< Channels read in the frame */
+	int32_t const *	p_values;				/**< Values, indexed by channel */
+} frame_codec_frame_t;
+
+
+/**@brief Encoder statistics. Compression ratio is values * 3 / value_bytes. */
+typedef struct
+{
+	uint32_t		frames;					/**< Frames committed */
+	uint32_t		keyframes;
+	uint32_t		values;					/**< Channel values committed */
+	uint32_t		value_bytes;			/**< Bytes taken by the values */
+} frame_codec_stats_t;
+
+
+/**@brief Encoder state. */
+typedef struct
+{
+	int32_t			reference[FRAME_CODEC_CHANNEL_MAX];	/**< Last value sent of every channel */
+	uint16_t		reference_sequence;		/**< Sequence of the last frame sent */
+	uint8_t			channel_count;
+	uint8_t			keyframe_interval;
+	uint8_t			frames_since_keyframe;
+	bool			keyframe_request;
+	uint32_t		pending_bytes;			/**< Value bytes of the frame being encoded */
+	frame_codec_stats_t	stats;
+} frame_encoder_t;
+
+
+/**@brief Decoder state. */
+typedef struct
+{
+	int32_t			value[FRAME_CODEC_CHANNEL_MAX];		/**< Last value of every channel */
+	uint16_t		sequence;				/**< Sequence of the frame being decoded or the last one */
+	uint8_t			channel_count;
+	uint8_t			next_part;
+	bool			synced;					/**< Values follow the encoder */
+	bool			complete;				/**< Last part of the frame was decoded */
+	uint32_t		skipped;				/**< Packets skipped while out of sync */
+} frame_decoder_t;
+
+
+/**@brief Result of packet decoding. */
+typedef enum
+{
+	FRAME_DECODE_OK = 0,
+	FRAME_DECODE_SKIPPED,					/**< Out of sync, waiting for keyframe */
+	FRAME_DECODE_INVALID					/**< Packet is truncated or malformed */
+} frame_decode_result_t;
+
+
+/**@brief Decoded packet. */
+typedef struct
+{
+	uint16_t		sequence;
+	uint32_t		timestamp;
+	uint64_t		channel_mask;			/**< Channels of the packet, values are in decoder value[] */
+	bool			keyframe;
+	bool			last;					/**< Last part of the frame */
+} frame_codec_part_t;
+
+
+/**
+  * @brief  Writes zigzag varint of the value.
+  *
+  * @param[in]  value		value
+  * @param[out] p_data		up to 5 bytes
+  *
+  * @retval		Number of bytes written
+  */
+uint8_t frame_codec_varint_put(int32_t value, uint8_t * p_data);
+
+/**
+  * @brief  Reads zigzag varint.
+  *
+  * @param[in]  p_data		data
+  * @param[in]  length		bytes available
+  * @param[out] p_value		value
+  *
+  * @retval		Number of bytes read, 0 if varint is truncated or too long
+  */
+uint8_t frame_codec_varint_get(uint8_t const * p_data, uint16_t length, int32_t * p_value);
+
+/**
+  * @brief  Saturates the value to 24 bit signed.
+  *
+  * @param[in]  value		value
+  *
+  * @retval		Saturated value
+  */
+int32_t frame_codec_limit(int32_t value);
+
+/**
+  * @brief  Initializes the encoder, the first frame is keyframe.
+  *
+  * @param[out] p_enc				encoder
+  * @param[in]  channel_count		number of channels, up to FRAME_CODEC_CHANNEL_MAX
+  * @param[in]  keyframe_interval	frames between keyframes, 0 sends keyframes on request only
+  */
+void frame_encoder_init(frame_encoder_t * p_enc, uint8_t channel_count, uint8_t keyframe_interval);
+
+/**
+  * @brief  Makes the next frame a keyframe. Called when sent packet was lost.
+  *
+  * @param[in]  p_enc		encoder
+  */
+void frame_encoder_keyframe_request(frame_encoder_t * p_enc);
+
+/**
+  * @brief  Checks if the next frame is to be keyframe.
+  *
+  * @param[in]  p_enc		encoder
+  *
+  * @retval		true if keyframe is due
+  */
+bool frame_encoder_keyframe_due(frame_encoder_t const * p_enc);
+
+/**
+  * @brief  Encodes next part of the frame. Encoder state is changed only
+  *         by frame_encoder_commit(), so the frame which couldn't be sent
+  *         is dropped without loss of sync.
+  *
+  * @param[in]     p_enc		encoder
+  * @param[in]     p_frame		frame
+  * @param[in]     keyframe		frame_encoder_keyframe_due() at the frame start
+  * @param[in]     part			part number, from 0
+  * @param[in,out] p_channel	first channel of the part, first channel of the next part on return
+  * @param[out]    p_data		packet
+  * @param[in]     max_length	packet size
+  *
+  * @retval		Packet length, 0 if no channels are left or they don't fit
+  */
+uint16_t frame_encoder_part_encode(frame_encoder_t * p_enc, frame_codec_frame_t const * p_frame, bool keyframe,
+								   uint8_t part, uint8_t * p_channel, uint8_t * p_data, uint16_t max_length);
+
+/**
+  * @brief  Marks the packet as the last part of the frame.
+  *
+  * @param[in,out] p_data	packet
+  */
+void frame_encoder_last_mark(uint8_t * p_data);
+
+/**
+  * @brief  Takes the frame as sent: it's values become reference of the
+  *         next frame.
+  *
+  * @param[in]  p_enc		encoder
+  * @param[in]  p_frame		frame
+  * @param[in]  keyframe	frame was encoded as keyframe
+  */
+void frame_encoder_commit(frame_encoder_t * p_enc, frame_codec_frame_t const * p_frame, bool keyframe);
+
+/**
+  * @brief  Initializes the decoder, packets are skipped until keyframe.
+  *
+  * @param[out] p_dec			decoder
+  * @param[in]  channel_count	number of channels of the encoder
+  */
+void frame_decoder_init(frame_decoder_t * p_dec, uint8_t channel_count);
+
+/**
+  * @brief  Decodes the packet. Values of the channels in the packet are
+  *         written to decoder value[].
+  *
+  * @param[in]  p_dec		decoder
+  * @param[in]  p_data		packet
+  * @param[in]  length		packet length
+  * @param[out] p_part		decoded packet header
+  *
+  * @retval		Decoding result
+  */
+frame_decode_result_t frame_decoder_part_decode(frame_decoder_t * p_dec, uint8_t const * p_data, uint16_t length,
+												frame_codec_part_t * p_part);
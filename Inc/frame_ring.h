@@ -0,0 +1,129 @@
+/**
+ * @file
+ * frame_ring.h
+ *
+ * @brief Lock-free single producer, single consumer ring of frames
+ *
+ * This file declares ring buffer passing frames from interrupt context
+ * (producer) to the main loop (consumer) without critical regions.
+ * Producer owns the head, consumer owns the tail, frames are copied in
+ * and out, so neither side holds a slot while the other runs. Size is
+ * power of two, indexes run freely and are masked on slot access.
+ *
+ * When the ring is full, policy decides which frame is lost: the new one,
+ * the oldest one, or, with decimation, every frame but each n-th one once
+ * the ring is half full, so the consumer catches up before it overflows.
+ * Dropping the oldest frame moves the tail from the producer, so the
+ * consumer commits it's read by compare-exchange and reads again if the
+ * frame was dropped under it.
+ *
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdk_common.h"
+#include "nrf_atomic.h"
+
+#define FRAME_RING_DECIMATION		2			/**< Default decimation, every n-th frame is kept while ring is over half full */
+
+
+/**@brief Policy applied when the consumer falls behind. */
+typedef enum
+{
+	FRAME_RING_DROP_NEWEST = 0,		/**< New frame isn't stored when the ring is full */
+	FRAME_RING_DROP_OLDEST,			/**< Oldest frame is replaced when the ring is full */
+	FRAME_RING_DECIMATE				/**< Frames are decimated when the ring is half full, new one is dropped when full */
+} frame_ring_policy_t;
+
+
+/**@brief Ring statistics. */
+typedef struct
+{
+	uint32_t		pushed;						/**< Frames stored */
+	uint32_t		popped;						/**< Frames taken by the consumer */
+	uint32_t		overruns;					/**< Frames lost because the ring was full */
+	uint32_t		decimated;					/**< Frames skipped by decimation */
+	uint16_t		peak;						/**< High-water mark of ring fill */
+} frame_ring_stats_t;
+
+
+/**@brief Ring instance. Use FRAME_RING_DEF to define it. */
+typedef struct
+{
+	uint8_t *			p_buffer;
+	uint16_t			element_size;
+	uint16_t			mask;					/**< Ring size - 1 */
+	nrf_atomic_u32_t	head;					/**< Next slot to be written, changed by producer only */
+	nrf_atomic_u32_t	tail;					/**< Next slot to be read */
+	frame_ring_policy_t	policy;
+	uint8_t				decimation;
+	uint8_t				decimation_count;
+	frame_ring_stats_t	stats;
+} frame_ring_t;
+
+
+/**@brief Macro for defining ring instance with static storage.
+ *
+ * @param	_name	name of the instance
+ * @param	_type	frame type
+ * @param	_size	number of frames, power of two
+ */
+#define FRAME_RING_DEF(_name, _type, _size)									\
+	STATIC_ASSERT(IS_POWER_OF_TWO(_size));									\
+	static _type CONCAT_2(_name, _buffer)[_size];							\
+	static frame_ring_t _name =												\
+	{																		\
+		.p_buffer     = (uint8_t *)CONCAT_2(_name, _buffer),				\
+		.element_size = sizeof(_type),										\
+		.mask         = (_size) - 1											\
+	}
+
+
+/**
+  * @brief  Empties the ring, clears statistics and sets the policy. Must
+  *         not be called while producer or consumer may use the ring.
+  *
+  * @param[in]  p_ring		ring instance
+  * @param[in]  policy		policy applied when the consumer falls behind
+  * @param[in]  decimation	every n-th frame is kept by FRAME_RING_DECIMATE
+  */
+void frame_ring_init(frame_ring_t * p_ring, frame_ring_policy_t policy, uint8_t decimation);
+
+/**
+  * @brief  Stores copy of the frame. Called by the producer only.
+  *
+  * @param[in]  p_ring		ring instance
+  * @param[in]  p_frame		frame, element_size bytes
+  *
+  * @retval		true if frame is stored
+  */
+bool frame_ring_push(frame_ring_t * p_ring, void const * p_frame);
+
+/**
+  * @brief  Takes copy of the oldest frame out of the ring. Called by the
+  *         consumer only.
+  *
+  * @param[in]  p_ring		ring instance
+  * @param[out] p_frame		frame, element_size bytes
+  *
+  * @retval		false if ring is empty
+  */
+bool frame_ring_pop(frame_ring_t * p_ring, void * p_frame);
+
+/**
+  * @brief  Returns number of frames in the ring.
+  *
+  * @param[in]  p_ring		ring instance
+  *
+  * @retval		Number of frames
+  */
+uint16_t frame_ring_count(frame_ring_t const * p_ring);
+
+/**
+  * @brief  Gets ring statistics.
+  *
+  * @param[in]  p_ring		ring instance
+  * @param[out] p_stats		statistics
+  */
+void frame_ring_stats_get(frame_ring_t const * p_ring, frame_ring_stats_t * p_stats);
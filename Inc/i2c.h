@@ -5,37 +5,164 @@
  * @brief I2C library for nRF52
  *
  * This file is a header of library for I2C protocol.
- * In fact, it's just a wrapper of default nRF52 SDK
- * I2C funcions.
+ * It's a wrapper of nRF52 TWIM driver, which works with EasyDMA
+ * and keeps a queue of pending transactions, so the CPU is free
+ * while transfers are in progress. Every TWIM instance is a separate
+ * bus with it's own pins and queue, so transfers on different buses
+ * go in parallel. TWIM shares peripheral resources with SPI, which is
+ * arbitrated by PRS, so bus may be released for other driver. Clock
+ * is selected per device and is switched between transactions, so
+ * slow and fast devices may share the bus.
  * 
  * @author Radchenko Evgeny
  * captain.97r@gmail.com
  */
 #pragma once
 
-#include "nrf_twi_mngr.h"
-#include "nrf_drv_twi.h"
-#include "nrfx_twi.h"
+#include "sdk_errors.h"
+#include "nrfx_twim.h"
 
-#define TWI_INSTANCE		0
-#define TWI_ADDRESSES		127
+#define TWI_BUS_COUNT		2		/**< TWIM0 and TWIM1 */
+#define TWI_ADDRESS_COUNT	128
+#define TWI_QUEUE_SIZE		8		/**< Maximum number of pending transactions of each bus */
+#define TWI_BUS_ERROR_LIMIT	4		/**< Bus errors in a row which start bus recovery */
+#define TWI_WATCHDOG_MS		50		/**< Transaction not finished for this time is stuck */
 
-#if USE_LEGACY_DRIVERS
-static const nrf_drv_twi_t m_twi_instance = NRF_DRV_TWI_INSTANCE(TWI_INSTANCE);
-#else
-static const nrfx_twi_t m_twi_instance = NRFX_TWI_INSTANCE(TWI_INSTANCE);
-#endif //USE_LEGACY_DRIVERS
+#define TWI_BUS0_SCL_PIN	26
+#define TWI_BUS0_SDA_PIN	25
+#define TWI_BUS1_SCL_PIN	31
+#define TWI_BUS1_SDA_PIN	30
+
+/**@brief I2C bus clock. */
+typedef enum
+{
+	TWI_SPEED_DEFAULT = 0,			/**< Default clock of the bus */
+	TWI_SPEED_100K,
+	TWI_SPEED_250K,
+	TWI_SPEED_400K,
+	TWI_SPEED_COUNT
+} twi_speed_t;
+
+/**@brief I2C transaction completion callback.
+ *
+ * @param[in]	result		NRF_SUCCESS or NRF_ERROR_DRV_TWI_ERR_ANACK/DNACK
+ * @param[in]	p_context	context given in the transaction
+ */
+typedef void(*twi_callback_t)(ret_code_t result, void * p_context);
+
+/**@brief I2C transaction. Transaction and descriptor buffers must stay 
+ *        valid and in RAM until the transaction is completed. */
+typedef struct
+{
+	nrfx_twim_xfer_desc_t		xfer;
+	uint32_t					flags;
+	twi_callback_t				callback;
+	void *						p_context;
+	uint8_t						bus;		/**< Bus index, 0 - TWI_BUS_COUNT-1 */
+	uint8_t						retries;	/**< Restarts after bus error, address NACK isn't retried */
+} twi_transaction_t;
+
+/**@brief I2C bus error statistics. */
+typedef struct
+{
+	uint32_t					errors;		/**< Transfers failed by bus error */
+	uint32_t					retries;	/**< Transfers restarted */
+	uint32_t					recoveries;	/**< Bus clears and TWIM reinitializations */
+} twi_stats_t;
+
+/**
+  * @brief  Configures I2C bus.
+  *
+  * @param[in]  bus			bus index
+  * @param[in]  scl_pin		SCL pin number
+  * @param[in]  sda_pin		SDA pin number
+  * @param[in]  speed		clock of devices without own clock setting
+  * 
+  * @retval		NRF_ERROR_BUSY if the peripheral is used by other driver,
+  *				NRF_ERROR_INVALID_PARAM if bus index or speed is invalid,
+  *				otherwise NRF_SUCCESS
+  */
+ret_code_t twi_init(uint8_t bus, uint32_t scl_pin, uint32_t sda_pin, twi_speed_t speed);
+
+/**
+  * @brief  Sets clock of the transactions with the device. Clock is
+  *         changed before the transaction, while the bus is idle.
+  *
+  * @param[in]  bus			bus index
+  * @param[in]  address		7 bit device address
+  * @param[in]  speed		device clock, TWI_SPEED_DEFAULT for bus default
+  * 
+  * @retval		NRF_ERROR_INVALID_PARAM if any parameter is invalid,
+  *				otherwise NRF_SUCCESS
+  */
+ret_code_t twi_device_speed_set(uint8_t bus, uint8_t address, twi_speed_t speed);
+
+/**
+  * @brief  Releases I2C bus, so the peripheral can be used by other
+  *         driver. Queue of the bus must be empty.
+  *
+  * @param[in]  bus			bus index
+  * 
+  * @retval		NRF_ERROR_BUSY if transaction is in progress,
+  *				otherwise NRF_SUCCESS
+  */
+ret_code_t twi_uninit(uint8_t bus);
+
+/**
+  * @brief  Puts I2C transaction to the queue of it's bus. Transaction 
+  *         is started immediately if the bus is free. Callback is called
+  *         from TWIM interrupt, with NRF_ERROR_TIMEOUT if the bus got 
+  *         stuck and was recovered.
+  *
+  * @param[in]  p_transaction	transaction to schedule
+  * 
+  * @retval		NRF_ERROR_INVALID_STATE if the bus isn't initialized,
+  *				NRF_ERROR_NO_MEM if the queue is full,
+  *				otherwise transfer start result code
+  */
+ret_code_t twi_schedule(twi_transaction_t const * p_transaction);
+
+/**
+  * @brief  Performs I2C transaction and waits for it's completion.
+  *         Must not be called from interrupt context.
+  *
+  * @param[in]  p_transaction	transaction to perform
+  * 
+  * @retval		Transaction result code
+  */
+ret_code_t twi_perform(twi_transaction_t const * p_transaction);
+
+/**
+  * @brief  Prepares transaction to be started by hardware (PPI) instead of
+  *         the CPU. Bus is taken exclusively until twi_triggered_stop(), 
+  *         transactions scheduled meanwhile wait in the queue. Callback is
+  *         called after every triggered transfer. May be called again 
+  *         from the callback to move the buffers.
+  *
+  * @param[in]  p_transaction	transaction, HOLD and REPEATED flags are added
+  * @param[out] p_start_task	address of TWIM start task to be triggered
+  * 
+  * @retval		NRF_ERROR_BUSY if other transaction is in progress,
+  *				otherwise transfer setup result code
+  */
+ret_code_t twi_triggered_setup(twi_transaction_t const * p_transaction, uint32_t * p_start_task);
 
 /**
-  * @brief  Configures I2C instance.
+  * @brief  Releases the bus taken by twi_triggered_setup() and starts 
+  *         queued transactions. Trigger must be disabled and the last 
+  *         triggered transfer finished.
   *
-  * @retval None
+  * @param[in]  bus			bus index
   */
-void twi_init(void);
+void twi_triggered_stop(uint8_t bus);
 
 /**
-  * @brief  Scans I2C for connected modules.
+  * @brief  Gets error statistics of the bus.
   *
-  * @retval Number of connected devices
+  * @param[in]  bus			bus index
+  * @param[out] p_stats		statistics
+  * 
+  * @retval		NRF_ERROR_INVALID_PARAM if bus index is invalid,
+  *				otherwise NRF_SUCCESS
   */
-uint8_t twi_scan(void);
\ No newline at end of file
+ret_code_t twi_stats_get(uint8_t bus, twi_stats_t * p_stats);
@@ -0,0 +1,119 @@
+/**
+ * @file
+ * link_profile.h
+ *
+ * @brief Connection parameter profiles
+ *
+ * This file declares named sets of connection parameters and functions
+ * for switching between them at runtime. Idle profile saves power with
+ * long interval and slave latency while nothing is streamed, streaming
+ * profile keeps the latency of the hand tracking low, bulk profile moves
+ * the blocks of the hardware paced stream, where latency doesn't matter.
+ * Central has the last word, so the parameters it has actually chosen
+ * are tracked from GAP events and reported along with the requested
+ * profile.
+ *
+ * 2M PHY is requested on connect and connection events are extended
+ * while there is data to send, so a streaming interval carries as many
+ * notifications as the radio time allows. PHY in use and measured
+ * throughput are reported as well.
+ *
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdk_errors.h"
+#include "ble.h"
+
+#define LINK_PROFILE_BLE_OBSERVER_PRIO	2		/**< Priority of the BLE event observer */
+#define LINK_STATUS_LENGTH				13		/**< Encoded status: profile, interval, latency, timeout, PHYs, throughput */
+#define LINK_PREFERRED_PHYS				BLE_GAP_PHY_2MBPS
+
+#define LINK_STREAMING_MIN_INTERVAL		6		/**< Streaming profile interval 7.5 ms in 1.25 ms units, NRF_SDH_BLE_GAP_EVENT_LENGTH must fill it */
+#define LINK_THROUGHPUT_INTERVAL_MS		1000	/**< Throughput is measured over this interval by the application */
+
+
+/**@brief Connection parameter profiles. */
+typedef enum
+{
+	LINK_PROFILE_IDLE = 0,			/**< 100 - 200 ms, slave latency 4 */
+	LINK_PROFILE_STREAMING,			/**< 7.5 - 15 ms, no slave latency */
+	LINK_PROFILE_BULK,				/**< 30 - 60 ms, long connection events, while hardware paced stream runs */
+	LINK_PROFILE_COUNT
+} link_profile_t;
+
+
+/**@brief Requested profile and parameters in use. */
+typedef struct
+{
+	uint8_t			profile;		/**< Requested profile, link_profile_t */
+	uint16_t		interval;		/**< Connection interval in use, 1.25 ms units, 0 if not connected */
+	uint16_t		latency;		/**< Slave latency in use */
+	uint16_t		timeout;		/**< Supervision timeout in use, 10 ms units */
+	uint8_t			tx_phy;			/**< PHY in use, BLE_GAP_PHY_1MBPS or BLE_GAP_PHY_2MBPS */
+	uint8_t			rx_phy;
+	uint32_t		throughput;		/**< Notification data sent, bytes per second */
+} link_status_t;
+
+
+/**@brief Handler of link status changes, called from BLE event context. */
+typedef void(*link_status_handler_t)(link_status_t const * p_status);
+
+
+/**
+  * @brief  Initializes the profiles. Idle profile is set as preferred
+  *         connection parameters, so it must be called before
+  *         ble_conn_params_init(). Enables connection event extension.
+  *
+  * @param[in]  handler		handler of the status changes, may be NULL
+  *
+  * @retval		NRF_SUCCESS or SoftDevice error code
+  */
+ret_code_t link_profile_init(link_status_handler_t handler);
+
+/**
+  * @brief  Requests connection parameters of the profile. Central is
+  *         asked by the connection parameters module, status changes
+  *         when the central has updated the parameters.
+  *
+  * @param[in]  conn_handle		connection handle
+  * @param[in]  profile			profile to be requested
+  *
+  * @retval		NRF_ERROR_INVALID_PARAM if profile is unknown,
+  *				otherwise ble_conn_params_change_conn_params() result code
+  */
+ret_code_t link_profile_set(uint16_t conn_handle, link_profile_t profile);
+
+/**
+  * @brief  Sets the throughput measured by the application and reports 
+  *         the status.
+  *
+  * @param[in]  bytes_per_s		notification data sent per second
+  */
+void link_throughput_set(uint32_t bytes_per_s);
+
+/**
+  * @brief  Returns connection parameters of the profile.
+  *
+  * @param[in]  profile			profile
+  *
+  * @retval		Connection parameters or NULL if profile is unknown
+  */
+ble_gap_conn_params_t const * link_profile_params_get(link_profile_t profile);
+
+/**
+  * @brief  Returns requested profile and parameters in use.
+  *
+  * @retval		Link status
+  */
+link_status_t const * link_status_get(void);
+
+/**
+  * @brief  Encodes link status for BLE, little endian.
+  *
+  * @param[out] p_data		LINK_STATUS_LENGTH bytes
+  *
+  * @retval		Encoded length
+  */
+uint16_t link_status_encode(uint8_t * p_data);
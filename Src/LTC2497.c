@@ -10,10 +10,28 @@
  * captain.97r@gmail.com
  */
 
+#include <string.h>
 #include "LTC2497.h"
+#include "app_timer.h"
+#include "nrf_delay.h"
 
+#define LTC2497_POLL_MIN_TICKS		APP_TIMER_TICKS(LTC2497_POLL_MIN_MS)
+#define LTC2497_POLL_MAX_TICKS		APP_TIMER_TICKS(LTC2497_POLL_MAX_MS)
+#define LTC2497_LATENCY_STEP_TICKS	(LTC2497_POLL_MIN_TICKS / 4)	/**< Estimate decrease after conversion found finished on the first poll */
 
-ret_code_t ltc2497_select_single_channel(uint8_t address, uint8_t channel)
+
+static ret_code_t ltc2497_tx(uint8_t bus, uint8_t address, uint8_t* payload, uint8_t length, bool no_stop)
+{
+	twi_transaction_t transaction = {
+		.xfer  = NRFX_TWIM_XFER_DESC_TX(address, payload, length),
+		.flags   = no_stop ? NRFX_TWIM_FLAG_TX_NO_STOP : 0,
+		.bus     = bus,
+		.retries = LTC2497_XFER_RETRIES
+	};
+	return twi_perform(&transaction);
+}
+
+ret_code_t ltc2497_select_single_channel(uint8_t bus, uint8_t address, uint8_t channel)
 {
 	
 	if (channel > 15)
@@ -23,31 +41,293 @@ ret_code_t ltc2497_select_single_channel(uint8_t address, uint8_t channel)
 		SELECT_BYTE_PREAMBLE_BITS | SELECT_BYTE_ENABLE_BIT | SELECT_BYTE_SINGLE_INPUT | channel, 
 		0x00
 	};
-	return nrf_drv_twi_tx(&m_twi_instance, address, payload, sizeof(payload), true); 
+	return ltc2497_tx(bus, address, payload, sizeof(payload), true); 
 }
 
-ret_code_t ltc2497_select_diff_channel(uint8_t address, uint8_t channel, uint8_t polarity)
+ret_code_t ltc2497_select_diff_channel(uint8_t bus, uint8_t address, uint8_t channel, uint8_t polarity)
 {
 	if (channel > 7)
 		return NRF_ERROR_INVALID_ADDR;
 	
 	uint8_t payload[2] = { SELECT_BYTE_PREAMBLE_BITS | SELECT_BYTE_ENABLE_BIT | SELECT_BYTE_DIFF_INPUT | polarity | channel, 
 						   0x00 };
-	return nrf_drv_twi_tx(&m_twi_instance, address, payload, sizeof(payload), true);
+	return ltc2497_tx(bus, address, payload, sizeof(payload), true);
 }
 
 
-ret_code_t ltc2497_setup(uint8_t address, LTC2497_setup_t* setup)
+ret_code_t ltc2497_setup(uint8_t bus, uint8_t address, LTC2497_setup_t* setup)
 {
 	uint8_t payload[2] = {
 		SELECT_BYTE_PREAMBLE_BITS | SELECT_BYTE_ENABLE_BIT, 
 		SETUP_BYTE_ENABLE_BIT | setup->freq | setup->speed | setup->temp
 	};
-	return nrf_drv_twi_tx(&m_twi_instance, address, payload, sizeof(payload), true); 
+	// Stop condition starts the conversion, so the chip is ready
+	// for the pipelined transactions afterwards
+	return ltc2497_tx(bus, address, payload, sizeof(payload), false); 
+}
+
+ret_code_t ltc_read_data(uint8_t bus, uint8_t address, uint8_t* data)
+{
+	twi_transaction_t transaction = {
+		.xfer    = NRFX_TWIM_XFER_DESC_RX(address, data, LTC2497_DATA_LENGTH),
+		.bus     = bus,
+		.retries = LTC2497_XFER_RETRIES
+	};
+	return twi_perform(&transaction);
+}
+
+uint32_t ltc2497_conversion_time_ms(LTC2497_setup_t const * setup)
+{
+	return (setup->speed == LTC2497_CONVERSION_SPEED_2X) ? LTC2497_CONVERSION_TIME_2X_MS 
+														 : LTC2497_CONVERSION_TIME_1X_MS;
+}
+
+/**@brief Returns worst case conversion time of the setup the chip is set to. */
+static uint32_t ltc2497_latency_max_ticks(ltc2497_t const * p_ltc)
+{
+	return ((p_ltc->setup_byte & SETUP_BYTE_2X_SPEED) != 0) ? APP_TIMER_TICKS(LTC2497_CONVERSION_TIME_2X_MS)
+															: APP_TIMER_TICKS(LTC2497_CONVERSION_TIME_1X_MS);
+}
+
+/**@brief Updates channel tracking of the instance and passes the result further. */
+static void ltc2497_xfer_done(ret_code_t result, void * p_context)
+{
+	ltc2497_t * p_ltc = (ltc2497_t *)p_context;
+	
+	if (result == NRF_ERROR_DRV_TWI_ERR_ANACK)
+	{
+		// Conversion is still in progress
+		if (p_ltc->polls < UINT8_MAX)
+			p_ltc->polls++;
+	}
+	
+	if (result == NRF_SUCCESS)
+	{
+		uint32_t now     = app_timer_cnt_get();
+		uint32_t elapsed = app_timer_cnt_diff_compute(now, p_ltc->conversion_start);
+		
+		// Polled again means conversion has finished not long before, 
+		// otherwise it may have been finished earlier than expected.
+		// Chip not answering for longer than the worst case conversion 
+		// was disconnected, the time tells nothing about the conversion
+		if (p_ltc->polls > 0)
+		{
+			if (elapsed <= ltc2497_latency_max_ticks(p_ltc))
+				p_ltc->latency_ticks = elapsed;
+		}
+		else if (p_ltc->latency_ticks > elapsed)
+			p_ltc->latency_ticks = elapsed;
+		else if (p_ltc->latency_ticks > LTC2497_LATENCY_STEP_TICKS)
+			p_ltc->latency_ticks -= LTC2497_LATENCY_STEP_TICKS;
+		
+		// Stop condition of the transaction has started the next conversion
+		p_ltc->conversion_start = now;
+		p_ltc->polls            = 0;
+		
+		switch (p_ltc->transaction.xfer.type)
+		{
+		case NRFX_TWIM_XFER_TX:
+			p_ltc->result_channel  = LTC2497_CHANNEL_NONE;
+			p_ltc->pending_channel = p_ltc->next_channel;
+			p_ltc->setup_changed   = false;
+			break;
+			
+		case NRFX_TWIM_XFER_RX:
+			p_ltc->result_channel  = p_ltc->pending_channel;
+			break;
+			
+		case NRFX_TWIM_XFER_TXRX:
+			p_ltc->result_channel  = p_ltc->pending_channel;
+			p_ltc->pending_channel = p_ltc->next_channel;
+			p_ltc->setup_changed   = false;
+			break;
+			
+		default:
+			break;
+		}
+	}
+	
+	if (p_ltc->callback != NULL)
+		p_ltc->callback(result, p_ltc->p_context);
+}
+
+static ret_code_t ltc2497_schedule(ltc2497_t * p_ltc, twi_callback_t callback, void * p_context)
+{
+	p_ltc->callback              = callback;
+	p_ltc->p_context             = p_context;
+	p_ltc->transaction.flags     = 0;
+	p_ltc->transaction.callback  = ltc2497_xfer_done;
+	p_ltc->transaction.p_context = p_ltc;
+	p_ltc->transaction.bus       = p_ltc->bus;
+	p_ltc->transaction.retries   = LTC2497_XFER_RETRIES;
+	
+	return twi_schedule(&p_ltc->transaction);
+}
+
+static void ltc2497_select_byte_set(ltc2497_t * p_ltc, uint8_t channel, uint8_t polarity)
+{
+	// Temperature sensor is selected by setup byte, input selection 
+	// is kept. Setup byte is written again after the sensor conversion
+	// and after the setup change
+	if (channel == LTC2497_CHANNEL_TEMP)
+	{
+		p_ltc->tx_data[0] = SELECT_BYTE_PREAMBLE_BITS | SELECT_BYTE_ENABLE_BIT;
+		p_ltc->tx_data[1] = p_ltc->setup_byte | SETUP_BYTE_TEMP_OUTPUT_ON;
+	}
+	else
+	{
+		p_ltc->tx_data[0] = SELECT_BYTE_PREAMBLE_BITS | SELECT_BYTE_ENABLE_BIT | SELECT_BYTE_DIFF_INPUT | polarity | channel;
+		p_ltc->tx_data[1] = (p_ltc->pending_channel == LTC2497_CHANNEL_TEMP || p_ltc->setup_changed) ? p_ltc->setup_byte : 0x00;
+	}
+	p_ltc->next_channel = channel;
+}
+
+ret_code_t ltc2497_init(ltc2497_t * p_ltc, uint8_t bus, uint8_t address, LTC2497_setup_t* setup)
+{
+	memset(p_ltc, 0, sizeof(ltc2497_t));
+	
+	p_ltc->bus             = bus;
+	p_ltc->address         = address;
+	p_ltc->pending_channel = LTC2497_CHANNEL_NONE;
+	p_ltc->result_channel  = LTC2497_CHANNEL_NONE;
+	p_ltc->latency_ticks   = APP_TIMER_TICKS(ltc2497_conversion_time_ms(setup));
+	p_ltc->setup_byte      = SETUP_BYTE_ENABLE_BIT | setup->freq | setup->speed | setup->temp;
+	
+	ret_code_t err_code;
+	uint32_t waited = 0;
+	
+	// Conversion started by the previous access must be finished first
+	for (;;)
+	{
+		err_code = ltc2497_setup(bus, address, setup);
+		if (err_code != NRF_ERROR_DRV_TWI_ERR_ANACK || waited >= LTC2497_CONVERSION_TIME_1X_MS)
+			break;
+		
+		nrf_delay_ms(LTC2497_POLL_MIN_MS);
+		waited += LTC2497_POLL_MIN_MS;
+	}
+	
+	p_ltc->conversion_start = app_timer_cnt_get();
+	
+	return err_code;
+}
+
+void ltc2497_setup_set(ltc2497_t * p_ltc, LTC2497_setup_t const * setup)
+{
+	p_ltc->setup_byte    = SETUP_BYTE_ENABLE_BIT | setup->freq | setup->speed | setup->temp;
+	p_ltc->setup_changed = true;
+	
+	// Estimate starts from the worst case of the new setup again
+	p_ltc->latency_ticks = APP_TIMER_TICKS(ltc2497_conversion_time_ms(setup));
 }
 
-ret_code_t ltc_read_data(uint8_t address, uint8_t* data)
+uint32_t ltc2497_ready_wait_ticks(ltc2497_t const * p_ltc)
 {
-	return nrf_drv_twi_rx(&m_twi_instance, address, data, 4);
+	uint32_t ticks;
+	
+	if (p_ltc->polls == 0)
+	{
+		uint32_t elapsed = app_timer_cnt_diff_compute(app_timer_cnt_get(), p_ltc->conversion_start);
+		
+		ticks = (p_ltc->latency_ticks > elapsed) ? (p_ltc->latency_ticks - elapsed) : 0;
+	}
+	else
+	{
+		ticks = LTC2497_POLL_MAX_TICKS;
+		if (p_ltc->polls <= 6)
+			ticks = MIN(LTC2497_POLL_MIN_TICKS << (p_ltc->polls - 1), LTC2497_POLL_MAX_TICKS);
+	}
+	
+	return MAX(ticks, APP_TIMER_MIN_TIMEOUT_TICKS);
+}
+
+bool ltc2497_is_converting(ltc2497_t const * p_ltc)
+{
+	if (p_ltc->polls > 0)
+		return false;
+	
+	return app_timer_cnt_diff_compute(app_timer_cnt_get(), p_ltc->conversion_start) < p_ltc->latency_ticks;
+}
+
+uint32_t ltc2497_conversion_latency_get(ltc2497_t const * p_ltc)
+{
+	return p_ltc->latency_ticks;
+}
+
+ret_code_t ltc2497_select_diff_channel_async(ltc2497_t * p_ltc, uint8_t channel, uint8_t polarity, 
+											 twi_callback_t callback, void * p_context)
+{
+	if (channel > 7 && channel != LTC2497_CHANNEL_TEMP)
+		return NRF_ERROR_INVALID_ADDR;
+	
+	ltc2497_select_byte_set(p_ltc, channel, polarity);
+	p_ltc->transaction.xfer = (nrfx_twim_xfer_desc_t)NRFX_TWIM_XFER_DESC_TX(p_ltc->address, p_ltc->tx_data, sizeof(p_ltc->tx_data));
+	
+	return ltc2497_schedule(p_ltc, callback, p_context);
+}
+
+ret_code_t ltc2497_read_and_select_next(ltc2497_t * p_ltc, uint8_t channel, uint8_t polarity, 
+										twi_callback_t callback, void * p_context)
+{
+	if (channel > 7 && channel != LTC2497_CHANNEL_TEMP)
+		return NRF_ERROR_INVALID_ADDR;
+	
+	ltc2497_select_byte_set(p_ltc, channel, polarity);
+	p_ltc->transaction.xfer = (nrfx_twim_xfer_desc_t)NRFX_TWIM_XFER_DESC_TXRX(p_ltc->address, 
+																				   p_ltc->tx_data, sizeof(p_ltc->tx_data), 
+																				   p_ltc->rx_data, sizeof(p_ltc->rx_data));
+	
+	return ltc2497_schedule(p_ltc, callback, p_context);
+}
+
+ret_code_t ltc2497_read_data_async(ltc2497_t * p_ltc, twi_callback_t callback, void * p_context)
+{
+	p_ltc->transaction.xfer = (nrfx_twim_xfer_desc_t)NRFX_TWIM_XFER_DESC_RX(p_ltc->address, p_ltc->rx_data, sizeof(p_ltc->rx_data));
+	
+	return ltc2497_schedule(p_ltc, callback, p_context);
+}
+
+int32_t ltc2497_code_get(uint8_t const * p_data, uint8_t * p_status)
+{
+	uint32_t raw = ((uint32_t)p_data[0] << 16) | ((uint32_t)p_data[1] << 8) | p_data[2];
+	
+	if (p_status != NULL)
+	{
+		uint32_t range_bits = raw & (LTC2497_DATA_SIG_BIT | LTC2497_DATA_MSB_BIT);
+		
+		if (range_bits == (LTC2497_DATA_SIG_BIT | LTC2497_DATA_MSB_BIT))
+			*p_status = LTC2497_STATUS_OVERRANGE;
+		else if (range_bits == 0)
+			*p_status = LTC2497_STATUS_UNDERRANGE;
+		else
+			*p_status = LTC2497_STATUS_OK;
+	}
+	
+	// Inverted sign bit gives 24 bit two's complement value, it is 
+	// sign-extended by shifting to the top of the word and back
+	return (int32_t)((raw ^ LTC2497_DATA_SIG_BIT) << 8) >> (8 + LTC2497_DATA_SUB_LSB_BITS);
 }
 
+int32_t ltc2497_uv_to_temp(int32_t uv)
+{
+	return (int32_t)(((int64_t)uv << LTC2497_TEMP_Q) / LTC2497_TEMP_UV_PER_K);
+}
+
+int32_t ltc2497_code_to_uv(int32_t code, uint32_t vref_uv)
+{
+	// Full scale code is VREF/2: uV = code * VREF / 2^17, rounded
+	return (int32_t)(((int64_t)code * vref_uv + LTC2497_CODE_FULL_SCALE) >> 17);
+}
+
+void ltc2497_decode_batch(uint8_t const (* p_data)[LTC2497_DATA_LENGTH], uint8_t count, uint32_t vref_uv,
+						  int32_t * p_codes, int32_t * p_uv, uint8_t * p_status)
+{
+	for (uint8_t i = 0; i < count; i++)
+		p_uv[i] = ltc2497_code_get(p_data[i], (p_status != NULL) ? &p_status[i] : NULL);
+	
+	if (p_codes != NULL)
+		memcpy(p_codes, p_uv, count * sizeof(int32_t));
+	
+	for (uint8_t i = 0; i < count; i++)
+		p_uv[i] = ltc2497_code_to_uv(p_uv[i], vref_uv);
+}
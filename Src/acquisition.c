@@ -0,0 +1,1107 @@
+/** 
+ * @file
+ * acquisition.c
+ * 
+ * @brief Event-driven ADC acquisition
+ *
+ * This file contains implementations of functions declared in 
+ * acquisition.h. Nothing here waits in a loop, every step is taken on 
+ * TWI or timer event.
+ * 
+ * Channels are read using LTC2497 pipelining: each transaction reads 
+ * result of the previous conversion and selects channel of the next one,
+ * so every channel costs one transaction and one conversion time. Sweep 
+ * of n channels of a chip is n+1 transactions: first one only selects
+ * (data of the conversion started before the frame is dropped), last one 
+ * only reads.
+ * 
+ * Once per ACQ_TEMP_FRAME_INTERVAL frames chip temperature sensor is 
+ * converted before the channels. Filtered temperature of the chip drives
+ * temperature term of the calibration of it's channels.
+ * 
+ * Every chip is swept by it's own state machine with it's own timer, so
+ * in interleaved schedule one chip is read while the others convert. 
+ * Transactions of different chips are serialized by the I2C queue.
+ * TWI and application timer interrupts have the same priority, so the 
+ * state machines never preempt each other.
+ * 
+ * Interrupts only do the bus I/O. Finished frame is copied to the frame
+ * ring and decoded, calibrated and passed to the application by 
+ * app_scheduler from the main loop, so notifications don't delay the
+ * next transaction and don't block other interrupts of the same priority.
+ * 
+ * Stream mode takes the CPU out of the sample timing. Channel is selected
+ * once, then TIMER compare event starts prepared read transaction through
+ * PPI every period. Read ends with stop condition, which starts the next
+ * conversion of the same channel, so conversions are spaced by the timer
+ * as well. Results are written to postincremented buffer, CPU only swaps
+ * the buffers when block is filled.
+ * 
+ */
+
+#include <string.h>
+#include "sdk_common.h"
+#include "acquisition.h"
+#include "calibration.h"
+#include "app_timer.h"
+#include "app_scheduler.h"
+#include "app_util_platform.h"
+#include "nrfx_timer.h"
+#include "nrfx_ppi.h"
+
+typedef enum
+{
+	ACQ_ADC_STATE_IDLE,
+	ACQ_ADC_STATE_TRANSFER,			/**< Transaction in progress */
+	ACQ_ADC_STATE_WAITING,			/**< Waiting for conversion or for transaction retry */
+	ACQ_ADC_STATE_DONE				/**< All chip channels of the frame are read */
+} acq_adc_state_t;
+
+typedef enum
+{
+	ACQ_MODE_SAMPLE,
+	ACQ_MODE_FRAME,
+	ACQ_MODE_STREAM
+} acq_mode_t;
+
+typedef enum
+{
+	ACQ_STREAM_STATE_IDLE,
+	ACQ_STREAM_STATE_SELECTING,		/**< Channel is being selected */
+	ACQ_STREAM_STATE_RUNNING,		/**< Reads are triggered by the timer */
+	ACQ_STREAM_STATE_STOPPING		/**< Trigger is disabled, bus is to be released */
+} acq_stream_state_t;
+
+/**@brief Single sample passed to the main loop. */
+typedef struct
+{
+	ret_code_t				result;
+	uint8_t					channel;
+	uint8_t					data[LTC2497_DATA_LENGTH];
+} acq_sample_event_t;
+
+/**@brief Acquisition state of single ADC chip. */
+typedef struct
+{
+	ltc2497_t				ltc;
+	app_timer_id_t			timer_id;
+	uint8_t					index;
+	acq_adc_state_t			state;
+	uint8_t					select_mask;		/**< Chip channels of the frame left to be selected */
+	uint8_t					selected_mask;		/**< Chip channels selected during the frame */
+	uint8_t					attempts;
+	bool					failed;				/**< Sweep of the chip was ended by error in this frame */
+	uint8_t					errors;				/**< Frames in a row the chip has failed before selecting any channel */
+	bool					temp_request;		/**< Temperature is to be converted in this frame */
+	bool					temp_selected;		/**< Temperature conversion was started in this frame */
+	int32_t					temp;				/**< Filtered chip temperature */
+} acq_adc_t;
+
+APP_TIMER_DEF(m_frame_timer_id);
+APP_TIMER_DEF(m_stream_release_timer_id);
+FRAME_RING_DEF(m_frame_ring, acq_frame_t, ACQ_FRAME_RING_SIZE);
+
+static app_timer_t				m_adc_timers[ACQ_ADC_MAX];
+static acq_adc_t				m_adc[ACQ_ADC_MAX];
+static uint8_t					m_adc_count;
+static uint8_t					m_channel_count;
+
+static volatile bool			m_busy;					/**< Frame or sample in progress */
+static acq_mode_t				m_mode;
+static acq_schedule_t			m_schedule;
+static uint8_t					m_adc_pending;			/**< Chips which haven't finished the frame */
+static ret_code_t				m_last_error;
+static uint32_t					m_conversion_us;
+static LTC2497_setup_t			m_setup_request;		/**< Setup to be applied on the next engine start */
+static volatile bool			m_setup_pending;
+static uint32_t					m_vref_uv;
+static acq_sample_handler_t		m_sample_handler;
+static acq_frame_handler_t		m_frame_handler;
+static acq_stream_handler_t		m_stream_handler;
+
+static volatile bool			m_scan_active;
+static volatile acq_channel_mask_t	m_scan_mask;
+static uint32_t					m_frame_interval_ms;
+static uint8_t					m_sample_channel;
+static uint32_t					m_frame_sequence;
+static acq_channel_mask_t		m_frame_request_mask;	/**< Channels to be read in the frame in progress */
+static acq_channel_mask_t		m_degraded_mask;
+static uint8_t					m_channel_errors[ACQ_CHANNEL_MAX];	/**< Frames in a row channel has failed */
+static uint32_t					m_scan_start;
+static acq_stats_t				m_stats;
+static acq_frame_t				m_frame;
+static acq_frame_t				m_frame_out;			/**< Frame taken out of the ring by the main loop */
+static volatile bool			m_drain_pending;		/**< Ring drain is queued in the scheduler */
+
+static const nrfx_timer_t		m_stream_timer = NRFX_TIMER_INSTANCE(ACQ_STREAM_TIMER_INSTANCE);
+static nrf_ppi_channel_t		m_stream_ppi_channel;
+static volatile acq_stream_state_t	m_stream_state;
+static acq_adc_t *				m_p_stream_adc;
+static uint8_t					m_stream_channel;
+static uint32_t					m_stream_sequence;
+static twi_transaction_t		m_stream_transaction;
+static acq_stream_block_t		m_stream_blocks[2];
+static uint8_t					m_stream_block;			/**< Block being filled */
+
+
+static void adc_start(acq_adc_t * p_adc);
+static void stream_select(void);
+
+STATIC_ASSERT(CAL_CHANNEL_COUNT == ACQ_CHANNEL_MAX);
+STATIC_ASSERT(CAL_TEMP_Q == LTC2497_TEMP_Q);
+STATIC_ASSERT(sizeof(acq_sample_event_t) <= ACQ_SCHED_EVENT_DATA_SIZE);
+
+/**@brief Converts frame data to calibrated voltages. */
+static void frame_decode(acq_frame_t * p_frame)
+{
+	uint8_t status[ACQ_CHANNEL_MAX];
+	
+	ltc2497_decode_batch(p_frame->data, m_channel_count, m_vref_uv, NULL, p_frame->value, status);
+	
+	p_frame->range_mask = 0;
+	
+	for (uint8_t channel = 0; channel < m_channel_count; channel++)
+	{
+		if (!(p_frame->channel_mask & ACQ_CHANNEL_BIT(channel)))
+			continue;
+		
+		if (status[channel] != LTC2497_STATUS_OK)
+			p_frame->range_mask |= ACQ_CHANNEL_BIT(channel);
+		
+		p_frame->value[channel] = cal_apply(channel, p_frame->value[channel], p_frame->temperature[channel / ACQ_CHANNELS_PER_ADC]);
+	}
+}
+
+/**@brief Updates error counters of the channels requested in the frame. 
+ *        Failed transaction ends the sweep of the whole chip, so only the
+ *        channel which was selected and not read is charged, channels not
+ *        reached are left as they are. Chip failing before any channel is
+ *        selected is charged as a whole. Channel or chip failing 
+ *        ACQ_DEGRADE_ERRORS frames in a row is degraded, so it doesn't slow
+ *        down the sweep of the others. Degraded channel read successfully 
+ *        is restored. */
+static void frame_health_update(void)
+{
+	for (uint8_t adc = 0; adc < m_adc_count; adc++)
+	{
+		acq_adc_t * p_adc = &m_adc[adc];
+		uint8_t first     = adc * ACQ_CHANNELS_PER_ADC;
+		uint8_t requested = (uint8_t)(m_frame_request_mask >> first);
+		uint8_t read      = (uint8_t)(m_frame.channel_mask >> first);
+		uint8_t lost      = p_adc->selected_mask & ~read;
+		
+		if (requested == 0)
+			continue;
+		
+		for (uint8_t channel = first; channel < first + ACQ_CHANNELS_PER_ADC; channel++)
+		{
+			uint8_t bit = 1u << (channel - first);
+			
+			if (!(requested & bit))
+				continue;
+			
+			if (read & bit)
+			{
+				m_channel_errors[channel] = 0;
+				m_degraded_mask &= ~ACQ_CHANNEL_BIT(channel);
+				continue;
+			}
+			
+			m_stats.errors[channel]++;
+			
+			if (!(lost & bit))
+				continue;
+			
+			if (m_channel_errors[channel] < ACQ_DEGRADE_ERRORS)
+				m_channel_errors[channel]++;
+			
+			if (m_channel_errors[channel] >= ACQ_DEGRADE_ERRORS)
+				m_degraded_mask |= ACQ_CHANNEL_BIT(channel);
+		}
+		
+		if (!p_adc->failed || lost != 0)
+		{
+			p_adc->errors = 0;
+			continue;
+		}
+		
+		if (p_adc->errors < ACQ_DEGRADE_ERRORS)
+			p_adc->errors++;
+		
+		if (p_adc->errors >= ACQ_DEGRADE_ERRORS)
+			m_degraded_mask |= (acq_channel_mask_t)requested << first;
+	}
+	
+	m_frame.degraded_mask = m_degraded_mask;
+	m_stats.degraded_mask = m_degraded_mask;
+}
+
+/**@brief Decodes the frames waiting in the ring and passes them to the 
+ *        application. Called from main loop. */
+static void frame_process(void * p_event_data, uint16_t event_size)
+{
+	UNUSED_PARAMETER(p_event_data);
+	UNUSED_PARAMETER(event_size);
+	
+	// Frame pushed after this point queues the drain again
+	m_drain_pending = false;
+	
+	while (frame_ring_pop(&m_frame_ring, &m_frame_out))
+	{
+		frame_decode(&m_frame_out);
+		
+		if (m_frame_handler != NULL && m_scan_active)
+			m_frame_handler(&m_frame_out);
+	}
+}
+
+/**@brief Passes the sample to the application. Called from main loop. */
+static void sample_process(void * p_event_data, uint16_t event_size)
+{
+	acq_sample_event_t const * p_event = (acq_sample_event_t const *)p_event_data;
+	
+	UNUSED_PARAMETER(event_size);
+	
+	m_sample_handler(p_event->channel, p_event->result, p_event->data);
+}
+
+/**@brief Hands finished frame or sample over to the main loop. */
+static void frame_finish(void)
+{
+	m_busy = false;
+	
+	if (m_mode == ACQ_MODE_SAMPLE)
+	{
+		if (m_sample_handler == NULL)
+			return;
+		
+		acq_sample_event_t event;
+		
+		event.channel = m_sample_channel;
+		event.result  = (m_frame.channel_mask & ACQ_CHANNEL_BIT(m_sample_channel)) ? NRF_SUCCESS : m_last_error;
+		memcpy(event.data, m_frame.data[m_sample_channel], LTC2497_DATA_LENGTH);
+		
+		if (app_sched_event_put(&event, sizeof(event), sample_process) != NRF_SUCCESS)
+			m_stats.queue_drops++;
+	}
+	else if (m_scan_active)
+	{
+		m_stats.frames++;
+		
+		frame_health_update();
+		
+		for (uint8_t adc = 0; adc < m_adc_count; adc++)
+			m_frame.temperature[adc] = m_adc[adc].temp;
+		
+		// Frame is copied, so the next sweep may start before the main 
+		// loop gets to it. Ring policy decides which frame is lost when
+		// main loop falls behind.
+		(void)frame_ring_push(&m_frame_ring, &m_frame);
+		
+		if (m_drain_pending)
+			return;
+		
+		m_drain_pending = true;
+		
+		if (app_sched_event_put(NULL, 0, frame_process) != NRF_SUCCESS)
+		{
+			m_drain_pending = false;
+			m_stats.queue_drops++;
+		}
+	}
+}
+
+/**@brief Finishes the chip sweep. Chip which has failed is left out of the frame. */
+static void adc_finish(acq_adc_t * p_adc, ret_code_t result)
+{
+	if (result != NRF_SUCCESS)
+	{
+		m_last_error  = result;
+		p_adc->failed = true;
+	}
+	
+	p_adc->state = ACQ_ADC_STATE_DONE;
+	
+	if (--m_adc_pending == 0)
+	{
+		frame_finish();
+		return;
+	}
+	
+	if (m_schedule == ACQ_SCHEDULE_SEQUENTIAL)
+	{
+		for (uint8_t adc = p_adc->index + 1; adc < m_adc_count; adc++)
+		{
+			if (m_adc[adc].state == ACQ_ADC_STATE_IDLE)
+			{
+				adc_start(&m_adc[adc]);
+				return;
+			}
+		}
+	}
+}
+
+/**@brief Checks if frame in progress has to be dropped because scan was stopped. */
+static bool frame_aborted(void)
+{
+	return (m_mode == ACQ_MODE_FRAME && !m_scan_active);
+}
+
+/**@brief Waits for conversion or retries the transaction later. */
+static void adc_wait(acq_adc_t * p_adc, uint32_t ticks)
+{
+	p_adc->state = ACQ_ADC_STATE_WAITING;
+	
+	ret_code_t err_code = app_timer_start(p_adc->timer_id, ticks, p_adc);
+	if (err_code != NRF_SUCCESS)
+		adc_finish(p_adc, err_code);
+}
+
+/**@brief Starts next transaction on the chip: reads previous conversion 
+ *        and selects next channel, or only reads the last one. */
+static void adc_step(acq_adc_t * p_adc);
+
+/**@brief Updates temperature model of the chip with the conversion read. */
+static void adc_temp_update(acq_adc_t * p_adc)
+{
+	int32_t code = ltc2497_code_get(p_adc->ltc.rx_data, NULL);
+	int32_t temp = ltc2497_uv_to_temp(ltc2497_code_to_uv(code, m_vref_uv));
+	
+	// Chip warms up slowly, filter only removes conversion noise
+	if (p_adc->temp == CAL_TEMP_UNKNOWN)
+		p_adc->temp = temp;
+	else
+		p_adc->temp += (temp - p_adc->temp) >> ACQ_TEMP_FILTER_SHIFT;
+}
+
+static void on_adc_xfer_done(ret_code_t result, void * p_context)
+{
+	acq_adc_t * p_adc = (acq_adc_t *)p_context;
+	
+	if (frame_aborted())
+	{
+		adc_finish(p_adc, NRF_ERROR_INVALID_STATE);
+		return;
+	}
+	
+	if (result == NRF_ERROR_DRV_TWI_ERR_ANACK)
+		m_stats.polls[p_adc->index]++;
+	
+	if (result == NRF_ERROR_DRV_TWI_ERR_ANACK && p_adc->attempts < ACQ_SELECT_ATTEMPTS)
+	{
+		// Chip doesn't acknowledge it's address while conversion is in progress
+		adc_wait(p_adc, ltc2497_ready_wait_ticks(&p_adc->ltc));
+		return;
+	}
+	
+	if (result != NRF_SUCCESS)
+	{
+		adc_finish(p_adc, result);
+		return;
+	}
+	
+	p_adc->attempts = 0;
+	
+	// Data of conversions started before the frame are dropped
+	uint8_t result_channel = p_adc->ltc.result_channel;
+	if (result_channel == LTC2497_CHANNEL_TEMP)
+	{
+		if (p_adc->temp_selected)
+			adc_temp_update(p_adc);
+	}
+	else if (result_channel != LTC2497_CHANNEL_NONE && (p_adc->selected_mask & (1u << result_channel)))
+	{
+		uint8_t channel = p_adc->index * ACQ_CHANNELS_PER_ADC + result_channel;
+		
+		memcpy(m_frame.data[channel], p_adc->ltc.rx_data, LTC2497_DATA_LENGTH);
+		m_frame.channel_mask |= ACQ_CHANNEL_BIT(channel);
+		m_stats.samples[p_adc->index]++;
+	}
+	
+	if (p_adc->ltc.transaction.xfer.type == NRFX_TWIM_XFER_RX)
+	{
+		// Last channel of the chip is read
+		adc_finish(p_adc, NRF_SUCCESS);
+		return;
+	}
+	
+	if (p_adc->ltc.pending_channel == LTC2497_CHANNEL_TEMP)
+	{
+		p_adc->temp_request  = false;
+		p_adc->temp_selected = true;
+	}
+	else
+	{
+		p_adc->select_mask   &= ~(1u << p_adc->ltc.pending_channel);
+		p_adc->selected_mask |=  (1u << p_adc->ltc.pending_channel);
+	}
+	
+	adc_wait(p_adc, ltc2497_ready_wait_ticks(&p_adc->ltc));
+}
+
+static void adc_step(acq_adc_t * p_adc)
+{
+	ret_code_t err_code;
+	
+	p_adc->state = ACQ_ADC_STATE_TRANSFER;
+	p_adc->attempts++;
+	
+	if (p_adc->temp_request)
+	{
+		err_code = ltc2497_read_and_select_next(&p_adc->ltc, LTC2497_CHANNEL_TEMP, LTC2497_DIFF_POLARITY_POSITIVE, on_adc_xfer_done, p_adc);
+	}
+	else if (p_adc->select_mask == 0)
+	{
+		err_code = ltc2497_read_data_async(&p_adc->ltc, on_adc_xfer_done, p_adc);
+	}
+	else
+	{
+		uint8_t channel = 0;
+		while (!(p_adc->select_mask & (1u << channel)))
+			channel++;
+		
+		err_code = ltc2497_read_and_select_next(&p_adc->ltc, channel, LTC2497_DIFF_POLARITY_POSITIVE, on_adc_xfer_done, p_adc);
+	}
+	
+	if (err_code != NRF_SUCCESS)
+	{
+		adc_finish(p_adc, err_code);
+	}
+}
+
+static void adc_start(acq_adc_t * p_adc)
+{
+	p_adc->attempts = 0;
+	
+	// Last read of the previous frame has started a conversion. It's waited
+	// for by the estimate, polling backoff would overshoot it and spoil the
+	// estimate as well
+	if (ltc2497_is_converting(&p_adc->ltc))
+	{
+		adc_wait(p_adc, ltc2497_ready_wait_ticks(&p_adc->ltc));
+		return;
+	}
+	
+	adc_step(p_adc);
+}
+
+static void adc_timeout_handler(void * p_context)
+{
+	acq_adc_t * p_adc = (acq_adc_t *)p_context;
+	
+	if (p_adc->state != ACQ_ADC_STATE_WAITING)
+		return;
+	
+	if (m_mode == ACQ_MODE_STREAM)
+	{
+		stream_select();
+		return;
+	}
+	
+	if (frame_aborted())
+	{
+		adc_finish(p_adc, NRF_ERROR_INVALID_STATE);
+		return;
+	}
+	
+	adc_step(p_adc);
+}
+
+/**@brief Applies setup requested by acq_setup_set() to all chips. Engine must be
+ *        locked, so no chip transaction is in progress. */
+static void setup_apply(void)
+{
+	LTC2497_setup_t setup;
+	
+	if (!m_setup_pending)
+		return;
+	
+	CRITICAL_REGION_ENTER();
+	setup = m_setup_request;
+	m_setup_pending = false;
+	CRITICAL_REGION_EXIT();
+	
+	m_conversion_us = ltc2497_conversion_time_ms(&setup) * 1000;
+	
+	for (uint8_t adc = 0; adc < m_adc_count; adc++)
+		ltc2497_setup_set(&m_adc[adc].ltc, &setup);
+}
+
+/**@brief Gets conversion time of the setup the next frame is swept with. */
+static uint32_t setup_conversion_us(void)
+{
+	uint32_t conversion_us;
+	
+	CRITICAL_REGION_ENTER();
+	conversion_us = m_setup_pending ? ltc2497_conversion_time_ms(&m_setup_request) * 1000 : m_conversion_us;
+	CRITICAL_REGION_EXIT();
+	
+	return conversion_us;
+}
+
+/**@brief Estimates the longest sweep of the channels in mask. Chip of n channels
+ *        converts n times, and once more in temperature frames, and takes n+2
+ *        transactions. Last read of the chip starts one more conversion, 
+ *        which the next sweep of the chip has to wait for. In interleaved 
+ *        schedule chips convert concurrently, while their transactions may 
+ *        be serialized by the bus, in sequential schedule chips follow one 
+ *        another and the conversion is waited for only by the single chip. */
+static uint32_t sweep_time_us(acq_channel_mask_t channel_mask, uint32_t conversion_us)
+{
+	uint32_t total_us          = 0;
+	uint32_t conversion_max_us = 0;
+	uint32_t transfers_us      = 0;
+	
+	for (uint8_t adc = 0; adc < m_adc_count; adc++)
+	{
+		uint8_t select_mask = (uint8_t)(channel_mask >> (adc * ACQ_CHANNELS_PER_ADC));
+		uint8_t channels    = 0;
+		
+		if (select_mask == 0)
+			continue;
+		
+		for (; select_mask != 0; select_mask &= select_mask - 1)
+			channels++;
+		
+		uint32_t adc_conversion_us = (channels + 1) * conversion_us;
+		uint32_t adc_transfers_us  = (channels + 2) * ACQ_STREAM_XFER_TIME_US;
+		
+		total_us          += adc_conversion_us + adc_transfers_us;
+		conversion_max_us  = MAX(conversion_max_us, adc_conversion_us + conversion_us);
+		transfers_us      += adc_transfers_us;
+	}
+	
+	if (m_schedule == ACQ_SCHEDULE_INTERLEAVED)
+		return conversion_max_us + transfers_us;
+	
+	return MAX(total_us, conversion_max_us + transfers_us);
+}
+
+/**@brief Reserves the engine for the new frame. */
+static bool frame_lock(void)
+{
+	bool busy;
+	
+	CRITICAL_REGION_ENTER();
+	busy = m_busy;
+	m_busy = true;
+	CRITICAL_REGION_EXIT();
+	
+	return !busy;
+}
+
+/**@brief Starts sweep of the channels in mask. Engine must be locked. */
+static void frame_start(acq_channel_mask_t channel_mask)
+{
+	setup_apply();
+	
+	m_frame.timestamp    = app_timer_cnt_get();
+	m_frame.channel_mask = 0;
+	m_frame_request_mask = channel_mask;
+	m_last_error         = NRF_ERROR_INVALID_STATE;
+	m_adc_pending        = 0;
+	
+	for (uint8_t adc = 0; adc < m_adc_count; adc++)
+	{
+		m_adc[adc].select_mask   = (uint8_t)(channel_mask >> (adc * ACQ_CHANNELS_PER_ADC));
+		m_adc[adc].selected_mask = 0;
+		m_adc[adc].failed        = false;
+		m_adc[adc].temp_selected = false;
+		m_adc[adc].temp_request  = (m_mode == ACQ_MODE_FRAME && m_adc[adc].select_mask != 0 &&
+									(m_frame.sequence % ACQ_TEMP_FRAME_INTERVAL) == 0);
+		m_adc[adc].state         = (m_adc[adc].select_mask != 0) ? ACQ_ADC_STATE_IDLE : ACQ_ADC_STATE_DONE;
+		
+		if (m_adc[adc].select_mask != 0)
+			m_adc_pending++;
+	}
+	
+	if (m_adc_pending == 0)
+	{
+		frame_finish();
+		return;
+	}
+	
+	// Counter is protected from reaching zero while chips are being started
+	m_adc_pending++;
+	
+	for (uint8_t adc = 0; adc < m_adc_count; adc++)
+	{
+		if (m_adc[adc].state != ACQ_ADC_STATE_IDLE)
+			continue;
+		
+		adc_start(&m_adc[adc]);
+		
+		if (m_schedule == ACQ_SCHEDULE_SEQUENTIAL)
+			break;
+	}
+	
+	if (--m_adc_pending == 0)
+		frame_finish();
+}
+
+/**@brief Starts sweep of all enabled channels. Called on each frame interval. */
+static void frame_timeout_handler(void * p_context)
+{
+	UNUSED_PARAMETER(p_context);
+	
+	if (!frame_lock())
+	{
+		m_stats.frame_overruns++;
+		return;
+	}
+	
+	acq_channel_mask_t channel_mask = m_scan_mask;
+	
+	m_mode           = ACQ_MODE_FRAME;
+	m_frame.sequence = m_frame_sequence++;
+	
+	// Degraded channels are tried now and then, so reconnected sensor comes back
+	if ((m_frame.sequence % ACQ_DEGRADE_PROBE_FRAMES) != 0)
+		channel_mask &= ~m_degraded_mask;
+	
+	frame_start(channel_mask);
+}
+
+/**@brief Prepares empty block to be filled. */
+static void stream_block_reset(uint8_t block)
+{
+	m_stream_blocks[block].sequence    = m_stream_sequence++;
+	m_stream_blocks[block].count       = 0;
+	m_stream_blocks[block].missed_mask = 0;
+}
+
+/**@brief Passes filled block to the application and switches to the other one. */
+static void stream_block_flush(void)
+{
+	acq_stream_block_t const * p_block = &m_stream_blocks[m_stream_block];
+	
+	if (p_block->count > 0 && m_stream_handler != NULL)
+		m_stream_handler(p_block);
+	
+	m_stream_block ^= 1;
+	stream_block_reset(m_stream_block);
+}
+
+/**@brief Points triggered read at the next slot of the block being filled. */
+static ret_code_t stream_arm(uint32_t * p_start_task)
+{
+	acq_stream_block_t * p_block = &m_stream_blocks[m_stream_block];
+	
+	m_stream_transaction.xfer.p_primary_buf = p_block->data[p_block->count];
+	
+	return twi_triggered_setup(&m_stream_transaction, p_start_task);
+}
+
+/**@brief Releases the bus and the engine, passes samples left to the application. */
+static void stream_release(void)
+{
+	twi_triggered_stop(m_p_stream_adc->ltc.bus);
+	stream_block_flush();
+	
+	m_p_stream_adc->state = ACQ_ADC_STATE_DONE;
+	m_stream_state = ACQ_STREAM_STATE_IDLE;
+	m_busy = false;
+}
+
+static void stream_release_timeout_handler(void * p_context)
+{
+	UNUSED_PARAMETER(p_context);
+	
+	stream_release();
+}
+
+/**@brief Called after every triggered read. */
+static void on_stream_xfer_done(ret_code_t result, void * p_context)
+{
+	UNUSED_PARAMETER(p_context);
+	
+	acq_stream_block_t * p_block = &m_stream_blocks[m_stream_block];
+	bool rearm = false;
+	
+	if (result == NRF_SUCCESS)
+	{
+		m_stats.samples[m_p_stream_adc->index]++;
+	}
+	else
+	{
+		// Slot is kept, so spacing of the following samples is preserved.
+		// Buffer is pointed at the next slot again, as failed transfer 
+		// doesn't advance it the same way successful one does
+		memset(p_block->data[p_block->count], 0, LTC2497_DATA_LENGTH);
+		p_block->missed_mask |= (1u << p_block->count);
+		rearm = true;
+	}
+	
+	if (++p_block->count == ACQ_STREAM_BLOCK_SIZE)
+	{
+		stream_block_flush();
+		rearm = true;
+	}
+	
+	if (rearm && m_stream_state == ACQ_STREAM_STATE_RUNNING)
+	{
+		uint32_t start_task;
+		
+		if (stream_arm(&start_task) != NRF_SUCCESS)
+			acq_stream_stop();
+	}
+}
+
+/**@brief Starts the timer, which triggers reads from now on. */
+static void stream_trigger_start(void)
+{
+	uint32_t start_task;
+	bool stopping;
+	
+	ret_code_t err_code = stream_arm(&start_task);
+	if (err_code != NRF_SUCCESS)
+	{
+		stream_release();
+		return;
+	}
+	
+	nrfx_timer_clear(&m_stream_timer);
+	nrfx_timer_extended_compare(&m_stream_timer, NRF_TIMER_CC_CHANNEL0, 
+								nrfx_timer_us_to_ticks(&m_stream_timer, m_stream_blocks[m_stream_block].period_us),
+								NRF_TIMER_SHORT_COMPARE0_CLEAR_MASK, false);
+	(void)nrfx_ppi_channel_assign(m_stream_ppi_channel, 
+								  nrfx_timer_compare_event_address_get(&m_stream_timer, NRF_TIMER_CC_CHANNEL0),
+								  start_task);
+	
+	CRITICAL_REGION_ENTER();
+	stopping = (m_stream_state == ACQ_STREAM_STATE_STOPPING);
+	if (!stopping)
+	{
+		m_stream_state = ACQ_STREAM_STATE_RUNNING;
+		(void)nrfx_ppi_channel_enable(m_stream_ppi_channel);
+		nrfx_timer_enable(&m_stream_timer);
+	}
+	CRITICAL_REGION_EXIT();
+	
+	if (stopping)
+		stream_release();
+}
+
+static void on_stream_select_done(ret_code_t result, void * p_context)
+{
+	acq_adc_t * p_adc = (acq_adc_t *)p_context;
+	
+	if (m_stream_state == ACQ_STREAM_STATE_STOPPING)
+	{
+		stream_release();
+		return;
+	}
+	
+	if (result == NRF_ERROR_DRV_TWI_ERR_ANACK && p_adc->attempts < ACQ_SELECT_ATTEMPTS)
+	{
+		p_adc->state = ACQ_ADC_STATE_WAITING;
+		
+		if (app_timer_start(p_adc->timer_id, ltc2497_ready_wait_ticks(&p_adc->ltc), p_adc) != NRF_SUCCESS)
+			stream_release();
+		return;
+	}
+	
+	if (result != NRF_SUCCESS)
+	{
+		m_last_error = result;
+		stream_release();
+		return;
+	}
+	
+	// Conversion of the selected channel is started by this transaction,
+	// first read is triggered one period later
+	stream_trigger_start();
+}
+
+/**@brief Selects stream channel. Started conversions go on the same channel. */
+static void stream_select(void)
+{
+	acq_adc_t * p_adc = m_p_stream_adc;
+	
+	if (m_stream_state == ACQ_STREAM_STATE_STOPPING)
+	{
+		stream_release();
+		return;
+	}
+	
+	p_adc->state = ACQ_ADC_STATE_TRANSFER;
+	p_adc->attempts++;
+	
+	ret_code_t err_code = ltc2497_select_diff_channel_async(&p_adc->ltc, m_stream_channel % ACQ_CHANNELS_PER_ADC, 
+															LTC2497_DIFF_POLARITY_POSITIVE, on_stream_select_done, p_adc);
+	if (err_code != NRF_SUCCESS)
+	{
+		m_last_error = err_code;
+		stream_release();
+	}
+}
+
+/**@brief Timer interrupt is never enabled, compare event is routed by PPI. */
+static void stream_timer_handler(nrf_timer_event_t event_type, void * p_context)
+{
+	UNUSED_PARAMETER(event_type);
+	UNUSED_PARAMETER(p_context);
+}
+
+/**@brief Prepares stream timer, PPI channel and read transaction. */
+static ret_code_t stream_init(void)
+{
+	ret_code_t err_code;
+	
+	const nrfx_timer_config_t timer_config = {
+		.frequency          = NRF_TIMER_FREQ_1MHz,
+		.mode               = NRF_TIMER_MODE_TIMER,
+		.bit_width          = NRF_TIMER_BIT_WIDTH_32,
+		.interrupt_priority = APP_IRQ_PRIORITY_LOW,
+		.p_context          = NULL
+	};
+	
+	err_code = nrfx_timer_init(&m_stream_timer, &timer_config, stream_timer_handler);
+	VERIFY_SUCCESS(err_code);
+	
+	err_code = nrfx_ppi_channel_alloc(&m_stream_ppi_channel);
+	VERIFY_SUCCESS(err_code);
+	
+	m_stream_transaction.xfer     = (nrfx_twim_xfer_desc_t)NRFX_TWIM_XFER_DESC_RX(0, NULL, LTC2497_DATA_LENGTH);
+	m_stream_transaction.flags    = NRFX_TWIM_FLAG_RX_POSTINC;
+	m_stream_transaction.callback = on_stream_xfer_done;
+	
+	return app_timer_create(&m_stream_release_timer_id, APP_TIMER_MODE_SINGLE_SHOT, stream_release_timeout_handler);
+}
+
+ret_code_t acq_init(acq_init_t const * p_init)
+{
+	ret_code_t err_code;
+	ret_code_t setup_result = NRF_SUCCESS;
+	
+	if (p_init->adc_count > ACQ_ADC_MAX)
+		return NRF_ERROR_INVALID_PARAM;
+	
+	m_adc_count        = p_init->adc_count;
+	m_channel_count    = m_adc_count * ACQ_CHANNELS_PER_ADC;
+	m_sample_handler   = p_init->sample_handler;
+	m_frame_handler    = p_init->frame_handler;
+	m_stream_handler   = p_init->stream_handler;
+	m_vref_uv          = p_init->vref_uv;
+	m_schedule         = p_init->schedule;
+	
+	frame_ring_init(&m_frame_ring, p_init->ring_policy, FRAME_RING_DECIMATION);
+	m_conversion_us    = ltc2497_conversion_time_ms(&p_init->setup) * 1000;
+	
+	m_frame_interval_ms = ACQ_FRAME_INTERVAL_MS;
+	m_setup_pending     = false;
+	
+	err_code = app_timer_create(&m_frame_timer_id, APP_TIMER_MODE_REPEATED, frame_timeout_handler);
+	VERIFY_SUCCESS(err_code);
+	
+	// Stream timer and PPI channel are taken only by application which streams
+	if (m_stream_handler != NULL)
+	{
+		err_code = stream_init();
+		VERIFY_SUCCESS(err_code);
+	}
+	
+	for (uint8_t adc = 0; adc < m_adc_count; adc++)
+	{
+		LTC2497_setup_t setup = p_init->setup;
+		
+		m_adc[adc].index    = adc;
+		m_adc[adc].state    = ACQ_ADC_STATE_DONE;
+		m_adc[adc].timer_id = &m_adc_timers[adc];
+		m_adc[adc].temp     = CAL_TEMP_UNKNOWN;
+		
+		err_code = app_timer_create(&m_adc[adc].timer_id, APP_TIMER_MODE_SINGLE_SHOT, adc_timeout_handler);
+		VERIFY_SUCCESS(err_code);
+		
+		// Failed chip keeps it's place, so channels of the others aren't renumbered
+		uint8_t bus = (p_init->p_buses != NULL) ? p_init->p_buses[adc] : 0;
+		
+		err_code = ltc2497_init(&m_adc[adc].ltc, bus, p_init->p_addresses[adc], &setup);
+		if (err_code != NRF_SUCCESS && setup_result == NRF_SUCCESS)
+			setup_result = err_code;
+	}
+	
+	return setup_result;
+}
+
+ret_code_t acq_sample_start(uint8_t channel)
+{
+	if (channel >= m_channel_count)
+		return NRF_ERROR_INVALID_PARAM;
+	
+	if (!frame_lock())
+		return NRF_ERROR_BUSY;
+	
+	m_mode           = ACQ_MODE_SAMPLE;
+	m_sample_channel = channel;
+	frame_start(ACQ_CHANNEL_BIT(channel));
+	
+	return NRF_SUCCESS;
+}
+
+ret_code_t acq_scan_start(acq_channel_mask_t channel_mask, uint32_t frame_interval_ms)
+{
+	if (m_stream_state != ACQ_STREAM_STATE_IDLE)
+		return NRF_ERROR_INVALID_STATE;
+	
+	m_scan_mask         = channel_mask;
+	m_frame_interval_ms = frame_interval_ms;
+	m_frame_sequence    = 0;
+	m_scan_start        = app_timer_cnt_get();
+	m_scan_active       = true;
+	
+	memset(&m_stats, 0, sizeof(m_stats));
+	
+	return app_timer_start(m_frame_timer_id, APP_TIMER_TICKS(frame_interval_ms), NULL);
+}
+
+void acq_scan_stop(void)
+{
+	m_scan_active = false;
+	(void)app_timer_stop(m_frame_timer_id);
+}
+
+ret_code_t acq_stream_start(uint8_t channel, uint32_t period_us)
+{
+	if (channel >= m_channel_count)
+		return NRF_ERROR_INVALID_PARAM;
+	
+	if (m_stream_handler == NULL)
+		return NRF_ERROR_NOT_SUPPORTED;
+	
+	if (m_scan_active)
+		return NRF_ERROR_INVALID_STATE;
+	
+	if (!frame_lock())
+		return NRF_ERROR_BUSY;
+	
+	// Read ends with stop condition starting the next conversion, so the 
+	// period must fit both. Conversion time is taken from the setup
+	// requested meanwhile.
+	setup_apply();
+	
+	if (period_us < m_conversion_us + ACQ_STREAM_XFER_TIME_US)
+	{
+		m_busy = false;
+		return NRF_ERROR_INVALID_PARAM;
+	}
+	
+	m_mode              = ACQ_MODE_STREAM;
+	m_stream_channel    = channel;
+	m_stream_sequence   = 0;
+	m_stream_block      = 0;
+	m_p_stream_adc      = &m_adc[channel / ACQ_CHANNELS_PER_ADC];
+	m_p_stream_adc->attempts = 0;
+	
+	m_stream_transaction.xfer.address = m_p_stream_adc->ltc.address;
+	m_stream_transaction.bus          = m_p_stream_adc->ltc.bus;
+	
+	for (uint8_t block = 0; block < 2; block++)
+	{
+		m_stream_blocks[block].channel   = channel;
+		m_stream_blocks[block].period_us = period_us;
+	}
+	stream_block_reset(m_stream_block);
+	
+	m_stream_state = ACQ_STREAM_STATE_SELECTING;
+	stream_select();
+	
+	return NRF_SUCCESS;
+}
+
+void acq_stream_stop(void)
+{
+	acq_stream_state_t state;
+	
+	CRITICAL_REGION_ENTER();
+	state = m_stream_state;
+	if (state == ACQ_STREAM_STATE_SELECTING || state == ACQ_STREAM_STATE_RUNNING)
+		m_stream_state = ACQ_STREAM_STATE_STOPPING;
+	CRITICAL_REGION_EXIT();
+	
+	// Selection in progress is finished by it's own event
+	if (state != ACQ_STREAM_STATE_RUNNING)
+		return;
+	
+	(void)nrfx_ppi_channel_disable(m_stream_ppi_channel);
+	nrfx_timer_disable(&m_stream_timer);
+	
+	// Read triggered just before may be still in progress
+	if (app_timer_start(m_stream_release_timer_id, APP_TIMER_TICKS(ACQ_STREAM_RELEASE_MS), NULL) != NRF_SUCCESS)
+		stream_release();
+}
+
+void acq_channel_mask_set(acq_channel_mask_t channel_mask)
+{
+	m_scan_mask = channel_mask;
+}
+
+ret_code_t acq_frame_interval_set(uint32_t frame_interval_ms)
+{
+	// Shorter interval would make every frame overrun
+	if (frame_interval_ms == 0 || frame_interval_ms * 1000 < sweep_time_us(m_scan_mask, setup_conversion_us()))
+		return NRF_ERROR_INVALID_PARAM;
+	
+	m_frame_interval_ms = frame_interval_ms;
+	
+	if (!m_scan_active)
+		return NRF_SUCCESS;
+	
+	// Sweep in progress is finished, the next one starts a new interval later
+	(void)app_timer_stop(m_frame_timer_id);
+	
+	return app_timer_start(m_frame_timer_id, APP_TIMER_TICKS(frame_interval_ms), NULL);
+}
+
+uint32_t acq_frame_interval_get(void)
+{
+	return m_frame_interval_ms;
+}
+
+ret_code_t acq_setup_set(LTC2497_setup_t const * p_setup)
+{
+	uint32_t conversion_us = ltc2497_conversion_time_ms(p_setup) * 1000;
+	
+	// Stopped scan takes the interval again on start
+	if (m_scan_active && m_frame_interval_ms * 1000 < sweep_time_us(m_scan_mask, conversion_us))
+		return NRF_ERROR_INVALID_STATE;
+	
+	CRITICAL_REGION_ENTER();
+	m_setup_request = *p_setup;
+	m_setup_pending = true;
+	CRITICAL_REGION_EXIT();
+	
+	return NRF_SUCCESS;
+}
+
+uint32_t acq_sweep_time_ms(void)
+{
+	return CEIL_DIV(sweep_time_us(m_scan_mask, setup_conversion_us()), 1000);
+}
+
+void acq_stats_get(acq_stats_t * p_stats)
+{
+	*p_stats = m_stats;
+	
+	p_stats->ticks = app_timer_cnt_diff_compute(app_timer_cnt_get(), m_scan_start);
+	p_stats->queue_peak = app_sched_queue_utilization_get();
+	frame_ring_stats_get(&m_frame_ring, &p_stats->ring);
+	
+	for (uint8_t adc = 0; adc < m_adc_count; adc++)
+		p_stats->latency[adc] = ltc2497_conversion_latency_get(&m_adc[adc].ltc);
+}
+
+bool acq_is_busy(void)
+{
+	return m_busy;
+}
+
+uint8_t acq_adc_count_get(void)
+{
+	return m_adc_count;
+}
+
+uint8_t acq_channel_count_get(void)
+{
+	return m_channel_count;
+}
@@ -17,11 +17,23 @@
 #include "nrf_gpio.h"
 #include "boards.h"
 #include "nrf_log.h"
+#include "app_scheduler.h"
 
 #include "ble_measurement_service.h"
 #include "ble_service_handler.h"
 
 
+/**@brief Encoding change passed to the main loop. */
+typedef struct
+{
+	ble_meas_t *	p_meas;
+	uint8_t			encoding;
+} ble_meas_encoding_event_t;
+
+STATIC_ASSERT(sizeof(ble_meas_encoding_event_t) <= BLE_MEAS_SCHED_EVENT_DATA_SIZE);
+STATIC_ASSERT(MEASUREMENT_STREAM_CHAR_MAX_LEN <= MEASUREMENT_FRAME_CHAR_MAX_LEN);	// Stream packets share the frame queue
+
+
 static void set_char_to_zero(ble_meas_t * p_meas, ble_gatts_attr_t * attr_char_value, uint8_t value_char_num)
 {
 	uint32_t            err_code;
@@ -29,15 +41,15 @@ static void set_char_to_zero(ble_meas_t * p_meas, ble_gatts_attr_t * attr_char_v
 	uint8_t init_val  = 0x00;
 	
 	memset(&gatts_value, 0, sizeof(gatts_value));
-
+	
 	
 	for (int i = 0; i < (attr_char_value->max_len) / (sizeof(uint8_t)); i++)
 	{
 		gatts_value.len     = sizeof(uint8_t);
 		gatts_value.offset  = i * sizeof(uint8_t);
 		gatts_value.p_value = &init_val;
-	
-	
+		
+		
 		err_code = sd_ble_gatts_value_set(p_meas->conn_handle,
 			p_meas->value_handles[value_char_num].value_handle,
 			&gatts_value);
@@ -64,13 +76,13 @@ static uint32_t value_char_add(ble_meas_t * p_meas, const ble_meas_init_t * p_me
 	ble_gatts_attr_md_t attr_md;
 	
 	memset(&cccd_md, 0, sizeof(cccd_md));
-
+	
 	BLE_GAP_CONN_SEC_MODE_SET_OPEN(&cccd_md.read_perm);
 	BLE_GAP_CONN_SEC_MODE_SET_OPEN(&cccd_md.write_perm);
 	cccd_md.vloc       = BLE_GATTS_VLOC_STACK;
-
+	
 	memset(&char_md, 0, sizeof(char_md));
-
+	
 	char_md.char_props.read   = p_char_init->char_prop_read;
 	char_md.char_props.write  = p_char_init->char_prop_write;
 	char_md.char_props.notify = p_char_init->char_prop_notify; 
@@ -79,27 +91,27 @@ static uint32_t value_char_add(ble_meas_t * p_meas, const ble_meas_init_t * p_me
 	char_md.p_user_desc_md    = NULL;
 	char_md.p_cccd_md         = NULL; 
 	char_md.p_sccd_md         = (p_char_init->char_prop_notify == 1) ? &cccd_md : NULL;
-		
+	
 	memset(&attr_md, 0, sizeof(attr_md));
-
+	
 	attr_md.read_perm  = p_meas_init->value_char_attr_md.read_perm;
 	attr_md.write_perm = p_meas_init->value_char_attr_md.write_perm;
 	attr_md.vloc       = BLE_GATTS_VLOC_STACK;
 	attr_md.rd_auth    = 0;
 	attr_md.wr_auth    = 0;
 	attr_md.vlen       = 0;
-
+	
 	ble_uuid.type = p_meas->uuid_type;
 	ble_uuid.uuid = p_char_init->ble_uuid;
-
+	
 	memset(&attr_char_value, 0, sizeof(attr_char_value));
-
+	
 	attr_char_value.p_uuid    = &ble_uuid;
 	attr_char_value.p_attr_md = &attr_md;
 	attr_char_value.init_len  = sizeof(uint8_t);
 	attr_char_value.init_offs = 0;
 	attr_char_value.max_len   = sizeof(uint8_t) * p_char_init->attr_char_max_len;
-
+	
 	err_code = sd_ble_gatts_characteristic_add(p_meas->service_handle,
 		&char_md,
 		&attr_char_value,
@@ -113,15 +125,157 @@ static uint32_t value_char_add(ble_meas_t * p_meas, const ble_meas_init_t * p_me
 	
 	NRF_LOG_INFO("Success!");
 	value_char_num++;
-
+	
 	return NRF_SUCCESS;
 }
 
-static uint32_t ble_chars_create(ble_meas_t * p_meas, const ble_meas_init_t * p_meas_init)
+/**@brief Function for adding the Calibration characteristic. Written value is single
+ *        channel record or record selection, read value is the selected record, so
+ *        the length is variable.
+ *
+ * @param[in]   p_meas       Measurement Service structure.
+ * @param[in]   p_meas_init  Information needed to initialize the service.
+ *
+ * @return      NRF_SUCCESS on success, otherwise an error code.
+ */
+static uint32_t cal_char_add(ble_meas_t * p_meas, const ble_meas_init_t * p_meas_init)
+{
+	ble_gatts_char_md_t char_md;
+	ble_gatts_attr_t    attr_char_value;
+	ble_uuid_t          ble_uuid;
+	ble_gatts_attr_md_t attr_md;
+	
+	memset(&char_md, 0, sizeof(char_md));
+	
+	char_md.char_props.read  = 1;
+	char_md.char_props.write = 1;
+	
+	memset(&attr_md, 0, sizeof(attr_md));
+	
+	attr_md.read_perm  = p_meas_init->value_char_attr_md.read_perm;
+	attr_md.write_perm = p_meas_init->value_char_attr_md.write_perm;
+	attr_md.vloc       = BLE_GATTS_VLOC_STACK;
+	attr_md.vlen       = 1;
+	
+	ble_uuid.type = p_meas->uuid_type;
+	ble_uuid.uuid = MEASUREMENT_CAL_CHAR_UUID;
+	
+	memset(&attr_char_value, 0, sizeof(attr_char_value));
+	
+	attr_char_value.p_uuid    = &ble_uuid;
+	attr_char_value.p_attr_md = &attr_md;
+	attr_char_value.init_len  = 0;
+	attr_char_value.max_len   = MEASUREMENT_CAL_CHAR_MAX_LEN;
+	
+	return sd_ble_gatts_characteristic_add(p_meas->service_handle,
+		&char_md,
+		&attr_char_value,
+		&p_meas->cal_handles);
+}
+
+/**@brief Function for adding read and notify characteristic of variable length, such as 
+ *        the Frame characteristic, which carries values of several channels.
+ *
+ * @param[in]   p_meas       Measurement Service structure.
+ * @param[in]   p_meas_init  Information needed to initialize the service.
+ * @param[in]   uuid         Characteristic UUID.
+ * @param[in]   max_len      Maximum value length.
+ * @param[out]  p_handles    Characteristic handles.
+ *
+ * @return      NRF_SUCCESS on success, otherwise an error code.
+ */
+static uint32_t notify_char_add(ble_meas_t * p_meas, const ble_meas_init_t * p_meas_init, 
+								uint16_t uuid, uint16_t max_len, ble_gatts_char_handles_t * p_handles)
+{
+	ble_gatts_char_md_t char_md;
+	ble_gatts_attr_md_t cccd_md;
+	ble_gatts_attr_t    attr_char_value;
+	ble_uuid_t          ble_uuid;
+	ble_gatts_attr_md_t attr_md;
+	
+	memset(&cccd_md, 0, sizeof(cccd_md));
+	
+	BLE_GAP_CONN_SEC_MODE_SET_OPEN(&cccd_md.read_perm);
+	BLE_GAP_CONN_SEC_MODE_SET_OPEN(&cccd_md.write_perm);
+	cccd_md.vloc = BLE_GATTS_VLOC_STACK;
+	
+	memset(&char_md, 0, sizeof(char_md));
+	
+	char_md.char_props.read   = 1;
+	char_md.char_props.notify = 1;
+	char_md.p_cccd_md         = &cccd_md;
+	
+	memset(&attr_md, 0, sizeof(attr_md));
+	
+	attr_md.read_perm  = p_meas_init->value_char_attr_md.read_perm;
+	attr_md.write_perm = p_meas_init->value_char_attr_md.write_perm;
+	attr_md.vloc       = BLE_GATTS_VLOC_STACK;
+	attr_md.vlen       = 1;
+	
+	ble_uuid.type = p_meas->uuid_type;
+	ble_uuid.uuid = uuid;
+	
+	memset(&attr_char_value, 0, sizeof(attr_char_value));
+	
+	attr_char_value.p_uuid    = &ble_uuid;
+	attr_char_value.p_attr_md = &attr_md;
+	attr_char_value.init_len  = 0;
+	attr_char_value.max_len   = max_len;
+	
+	return sd_ble_gatts_characteristic_add(p_meas->service_handle,
+		&char_md,
+		&attr_char_value,
+		p_handles);
+}
+
+/**@brief Function for adding the Control Point characteristic. Write is authorized, so
+ *        the command is executed before the response and it's result is returned by it.
+ *
+ * @param[in]   p_meas       Measurement Service structure.
+ * @param[in]   p_meas_init  Information needed to initialize the service.
+ *
+ * @return      NRF_SUCCESS on success, otherwise an error code.
+ */
+static uint32_t ctrl_char_add(ble_meas_t * p_meas, const ble_meas_init_t * p_meas_init)
 {
+	ble_gatts_char_md_t char_md;
+	ble_gatts_attr_t    attr_char_value;
+	ble_uuid_t          ble_uuid;
+	ble_gatts_attr_md_t attr_md;
+	
+	memset(&char_md, 0, sizeof(char_md));
+	
+	char_md.char_props.write = 1;
+	
+	memset(&attr_md, 0, sizeof(attr_md));
+	
+	BLE_GAP_CONN_SEC_MODE_SET_NO_ACCESS(&attr_md.read_perm);
+	attr_md.write_perm = p_meas_init->value_char_attr_md.write_perm;
+	attr_md.vloc       = BLE_GATTS_VLOC_STACK;
+	attr_md.wr_auth    = 1;
+	attr_md.vlen       = 1;
+	
+	ble_uuid.type = p_meas->uuid_type;
+	ble_uuid.uuid = MEASUREMENT_CONTROL_CHAR_UUID;
+	
+	memset(&attr_char_value, 0, sizeof(attr_char_value));
+	
+	attr_char_value.p_uuid    = &ble_uuid;
+	attr_char_value.p_attr_md = &attr_md;
+	attr_char_value.init_len  = 0;
+	attr_char_value.max_len   = MEASUREMENT_CONTROL_CHAR_MAX_LEN;
+	
+	return sd_ble_gatts_characteristic_add(p_meas->service_handle,
+		&char_md,
+		&attr_char_value,
+		&p_meas->ctrl_handles);
+}
 
+static uint32_t ble_chars_create(ble_meas_t * p_meas, const ble_meas_init_t * p_meas_init)
+{
+	
 	//Creating char for voltage value
-		
+	
 	uint32_t   err_code;
 	ble_char_init_t ble_char_init;
 	
@@ -132,16 +286,75 @@ static uint32_t ble_chars_create(ble_meas_t * p_meas, const ble_meas_init_t * p_
 	ble_char_init.ble_uuid = MEASUREMENT_SERVICE_UUID;
 	ble_char_init.attr_char_max_len = 4;
 	
-	for (int CHAR_UUID = MEASUREMENT_CH01_CHAR_UUID; CHAR_UUID <= MEASUREMENT_CH16_CHAR_UUID; CHAR_UUID++)
+	for (uint8_t channel = 0; channel < p_meas->channel_count; channel++)
 	{
-		ble_char_init.ble_uuid = CHAR_UUID;
+		ble_char_init.ble_uuid = MEASUREMENT_CH01_CHAR_UUID + channel;
 		
 		err_code = value_char_add(p_meas, p_meas_init, &ble_char_init);
 		if (err_code != NRF_SUCCESS)
 			return err_code;
 	}
 	
-	return NRF_SUCCESS;
+	err_code = cal_char_add(p_meas, p_meas_init);
+	VERIFY_SUCCESS(err_code);
+	
+	err_code = notify_char_add(p_meas, p_meas_init, MEASUREMENT_FRAME_CHAR_UUID, 
+							   MEASUREMENT_FRAME_CHAR_MAX_LEN, &p_meas->frame_handles);
+	VERIFY_SUCCESS(err_code);
+	
+	err_code = notify_char_add(p_meas, p_meas_init, MEASUREMENT_LINK_CHAR_UUID, 
+							   MEASUREMENT_LINK_CHAR_MAX_LEN, &p_meas->link_handles);
+	VERIFY_SUCCESS(err_code);
+	
+	err_code = notify_char_add(p_meas, p_meas_init, MEASUREMENT_STREAM_CHAR_UUID, 
+							   MEASUREMENT_STREAM_CHAR_MAX_LEN, &p_meas->stream_handles);
+	VERIFY_SUCCESS(err_code);
+	
+	return ctrl_char_add(p_meas, p_meas_init);
+}
+
+
+/**@brief Function for dropping the queued notifications, the encoding and the delta 
+ *        reference of the link from the main loop, where the queue and the encoder 
+ *        are changed.
+ */
+static void tx_reset_handler(void * p_event_data, uint16_t event_size)
+{
+	ble_meas_t * p_meas = *(ble_meas_t **)p_event_data;
+	
+	UNUSED_PARAMETER(event_size);
+	
+	p_meas->encoding = BLE_MEAS_ENCODING_ABSOLUTE;
+	frame_encoder_init(&p_meas->encoder, p_meas->channel_count, FRAME_CODEC_KEYFRAME_INTERVAL);
+	
+	p_meas->tx_head  = 0;
+	p_meas->tx_tail  = 0;
+	p_meas->tx_count = 0;
+}
+
+
+/**@brief Function for switching the frame encoding from the main loop, where the 
+ *        encoder is changed. Delta encoding starts again with keyframe.
+ */
+static void encoding_set_handler(void * p_event_data, uint16_t event_size)
+{
+	ble_meas_encoding_event_t const * p_event = (ble_meas_encoding_event_t const *)p_event_data;
+	
+	UNUSED_PARAMETER(event_size);
+	
+	p_event->p_meas->encoding = p_event->encoding;
+	frame_encoder_init(&p_event->p_meas->encoder, p_event->p_meas->channel_count, FRAME_CODEC_KEYFRAME_INTERVAL);
+}
+
+
+/**@brief Function for requesting the keyframe from the main loop, where the encoder
+ *        is changed.
+ */
+static void keyframe_request_handler(void * p_event_data, uint16_t event_size)
+{
+	UNUSED_PARAMETER(event_size);
+	
+	frame_encoder_keyframe_request(&(*(ble_meas_t **)p_event_data)->encoder);
 }
 
 
@@ -168,7 +381,17 @@ static void on_connect(ble_meas_t * p_meas, ble_evt_t const * p_ble_evt)
 static void on_disconnect(ble_meas_t * p_meas, ble_evt_t const * p_ble_evt)
 {
 	UNUSED_PARAMETER(p_ble_evt);
-	p_meas->conn_handle = BLE_CONN_HANDLE_INVALID;
+	p_meas->conn_handle         = BLE_CONN_HANDLE_INVALID;
+	p_meas->frame_notification  = false;
+	p_meas->stream_notification = false;
+	p_meas->max_payload         = BLE_GATT_ATT_MTU_DEFAULT - BLE_MEAS_ATT_HEADER_LEN;
+	
+	// Notifications queued for the link are useless for the next one. Queue 
+	// and encoder are changed only from the main loop, so they are reset there
+	if (app_sched_event_put(&p_meas, sizeof(p_meas), tx_reset_handler) != NRF_SUCCESS)
+	{
+		NRF_LOG_WARNING("Notification queue not reset");
+	}
 	
 	ble_meas_evt_t evt;
 	evt.evt_type = BLE_MEAS_EVT_DISCONNECTED;
@@ -183,14 +406,49 @@ static void on_disconnect(ble_meas_t * p_meas, ble_evt_t const * p_ble_evt)
 static void on_write(ble_meas_t * p_meas, ble_evt_t const * p_ble_evt)
 {
 	const ble_gatts_evt_write_t * p_evt_write = &p_ble_evt->evt.gatts_evt.params.write;
-
-	switch (p_evt_write->uuid.uuid)
+	
+	if (p_evt_write->handle == p_meas->cal_handles.value_handle)
 	{
+		if (p_meas->evt_handler != NULL)
+		{
+			ble_meas_evt_t evt;
+			
+			evt.evt_type    = BLE_MEAS_EVT_CAL_WRITTEN;
+			evt.p_evt_write = p_evt_write;
+			p_meas->evt_handler(p_meas, &evt);
+		}
+		return;
+	}
+	
+	if (p_evt_write->handle == p_meas->frame_handles.cccd_handle && p_evt_write->len == 2)
+	{
+		p_meas->frame_notification = ble_srv_is_notification_enabled(p_evt_write->data);
+		
+		// Client which starts listening has no reference of the deltas
+		if (p_meas->frame_notification)
+			(void)app_sched_event_put(&p_meas, sizeof(p_meas), keyframe_request_handler);
+		
+		if (p_meas->evt_handler != NULL)
+		{
+			ble_meas_evt_t evt;
+			
+			evt.evt_type    = p_meas->frame_notification ? BLE_MEAS_EVT_FRAME_NOTIFICATION_ENABLED
+														 : BLE_MEAS_EVT_FRAME_NOTIFICATION_DISABLED;
+			evt.p_evt_write = p_evt_write;
+			p_meas->evt_handler(p_meas, &evt);
+		}
+		return;
+	}
+	
+	if (p_evt_write->handle == p_meas->stream_handles.cccd_handle && p_evt_write->len == 2)
+	{
+		p_meas->stream_notification = ble_srv_is_notification_enabled(p_evt_write->data);
+		return;
 	}
 	
 	// Check if the handler of current event is exists
 	bool handler_found = false;
-	for (uint8_t handler = 0; handler < 16; handler++)
+	for (uint8_t handler = 0; handler < p_meas->channel_count; handler++)
 	{
 		if (p_evt_write->handle == p_meas->value_handles[handler].cccd_handle)
 		{
@@ -205,7 +463,7 @@ static void on_write(ble_meas_t * p_meas, ble_evt_t const * p_ble_evt)
 		if(p_meas->evt_handler != NULL)
 		{
 			ble_meas_evt_t evt;
-
+			
 			if (ble_srv_is_notification_enabled(p_evt_write->data))
 			{
 				evt.evt_type = BLE_MEAS_EVT_NOTIFICATION_ENABLED;
@@ -222,25 +480,352 @@ static void on_write(ble_meas_t * p_meas, ble_evt_t const * p_ble_evt)
 }
 
 
+/**@brief Function for decoding the control point command.
+ *
+ * @param[out]  p_cmd       Decoded command.
+ * @param[in]   p_data      Written value.
+ * @param[in]   length      Written value length.
+ *
+ * @return      BLE_GATT_STATUS_SUCCESS, BLE_MEAS_CTRL_ERR_OPCODE or invalid length status.
+ */
+static uint16_t ctrl_decode(ble_meas_ctrl_cmd_t * p_cmd, uint8_t const * p_data, uint16_t length)
+{
+	if (length == 0)
+	{
+		return BLE_GATT_STATUS_ATTERR_INVALID_ATT_VAL_LENGTH;
+	}
+	
+	uint8_t const * p_params = &p_data[1];
+	uint16_t params_length   = length - 1;
+	
+	memset(p_cmd, 0, sizeof(*p_cmd));
+	p_cmd->opcode = p_data[0];
+	
+	switch (p_cmd->opcode)
+	{
+	case BLE_MEAS_CTRL_OP_CHANNEL_MASK:
+		if (params_length == 0 || params_length > sizeof(uint64_t))
+			return BLE_GATT_STATUS_ATTERR_INVALID_ATT_VAL_LENGTH;
+		
+		for (uint8_t i = 0; i < params_length; i++)
+			p_cmd->params.channel_mask |= (uint64_t)p_params[i] << (8 * i);
+		break;
+		
+	case BLE_MEAS_CTRL_OP_FRAME_INTERVAL:
+		if (params_length != sizeof(uint16_t))
+			return BLE_GATT_STATUS_ATTERR_INVALID_ATT_VAL_LENGTH;
+		
+		p_cmd->params.frame_interval_ms = uint16_decode(p_params);
+		break;
+		
+	case BLE_MEAS_CTRL_OP_ENCODING:
+		if (params_length != 1)
+			return BLE_GATT_STATUS_ATTERR_INVALID_ATT_VAL_LENGTH;
+		
+		p_cmd->params.encoding = p_params[0];
+		break;
+		
+	case BLE_MEAS_CTRL_OP_FILTER:
+		if (params_length != 2)
+			return BLE_GATT_STATUS_ATTERR_INVALID_ATT_VAL_LENGTH;
+		
+		p_cmd->params.filter.rejection = p_params[0];
+		p_cmd->params.filter.speed     = p_params[1];
+		break;
+		
+	case BLE_MEAS_CTRL_OP_STREAM:
+		if (params_length != 1)
+			return BLE_GATT_STATUS_ATTERR_INVALID_ATT_VAL_LENGTH;
+		
+		p_cmd->params.start = (p_params[0] != 0);
+		break;
+		
+	case BLE_MEAS_CTRL_OP_HW_STREAM:
+		if (params_length != 5)
+			return BLE_GATT_STATUS_ATTERR_INVALID_ATT_VAL_LENGTH;
+		
+		p_cmd->params.hw_stream.channel   = p_params[0];
+		p_cmd->params.hw_stream.period_us = uint32_decode(&p_params[1]);
+		break;
+		
+	case BLE_MEAS_CTRL_OP_DEADBAND:
+		if (params_length != 7)
+			return BLE_GATT_STATUS_ATTERR_INVALID_ATT_VAL_LENGTH;
+		
+		p_cmd->params.deadband.channel        = p_params[0];
+		p_cmd->params.deadband.abs_uv         = uint16_decode(&p_params[1]);
+		p_cmd->params.deadband.rel_permille   = uint16_decode(&p_params[3]);
+		p_cmd->params.deadband.max_silence_ms = uint16_decode(&p_params[5]);
+		break;
+		
+	default:
+		return BLE_MEAS_CTRL_ERR_OPCODE;
+	}
+	
+	return BLE_GATT_STATUS_SUCCESS;
+}
+
+
+/**@brief Function for mapping the command handler result to the write response status. */
+static uint16_t ctrl_status_get(ret_code_t result)
+{
+	switch (result)
+	{
+	case NRF_SUCCESS:
+		return BLE_GATT_STATUS_SUCCESS;
+		
+	case NRF_ERROR_INVALID_PARAM:
+	case NRF_ERROR_NOT_SUPPORTED:
+		return BLE_MEAS_CTRL_ERR_PARAM;
+		
+	case NRF_ERROR_INVALID_STATE:
+	case NRF_ERROR_BUSY:
+		return BLE_MEAS_CTRL_ERR_STATE;
+		
+	default:
+		return BLE_MEAS_CTRL_ERR_FAILED;
+	}
+}
+
+
+/**@brief Function for handling the write of the Control Point characteristic. Command
+ *        is executed by the application handler and it's result is sent by the response.
+ *
+ * @param[in]   p_meas      Measurement Service structure.
+ * @param[in]   p_ble_evt   Event received from the BLE stack.
+ */
+static void on_rw_authorize_request(ble_meas_t * p_meas, ble_evt_t const * p_ble_evt)
+{
+	ble_gatts_evt_rw_authorize_request_t const * p_request = &p_ble_evt->evt.gatts_evt.params.authorize_request;
+	ble_gatts_evt_write_t const * p_evt_write = &p_request->request.write;
+	
+	if (p_request->type != BLE_GATTS_AUTHORIZE_TYPE_WRITE || 
+		p_evt_write->handle != p_meas->ctrl_handles.value_handle ||
+		p_evt_write->op != BLE_GATTS_OP_WRITE_REQ)
+	{
+		return;
+	}
+	
+	ble_meas_ctrl_cmd_t cmd;
+	ble_gatts_rw_authorize_reply_params_t reply;
+	
+	uint16_t status = ctrl_decode(&cmd, p_evt_write->data, p_evt_write->len);
+	
+	if (status == BLE_GATT_STATUS_SUCCESS)
+	{
+		status = (p_meas->ctrl_handler != NULL) ? ctrl_status_get(p_meas->ctrl_handler(p_meas, &cmd))
+												: BLE_MEAS_CTRL_ERR_STATE;
+	}
+	
+	memset(&reply, 0, sizeof(reply));
+	
+	reply.type                     = BLE_GATTS_AUTHORIZE_TYPE_WRITE;
+	reply.params.write.gatt_status = status;
+	reply.params.write.update      = (status == BLE_GATT_STATUS_SUCCESS);
+	reply.params.write.offset      = p_evt_write->offset;
+	reply.params.write.len         = p_evt_write->len;
+	reply.params.write.p_data      = p_evt_write->data;
+	
+	uint32_t err_code = sd_ble_gatts_rw_authorize_reply(p_ble_evt->evt.gatts_evt.conn_handle, &reply);
+	if (err_code != NRF_SUCCESS)
+	{
+		NRF_LOG_WARNING("Control point reply failed: %d", err_code);
+	}
+}
+
+
+/**@brief Function for sending single notification of the Frame or Stream characteristic. */
+static uint32_t packet_notify(ble_meas_t * p_meas, ble_meas_tx_packet_t * p_packet)
+{
+	ble_gatts_hvx_params_t hvx_params;
+	uint16_t length = p_packet->length;
+	
+	memset(&hvx_params, 0, sizeof(hvx_params));
+	
+	hvx_params.handle = p_packet->handle;
+	hvx_params.type   = BLE_GATT_HVX_NOTIFICATION;
+	hvx_params.p_len  = &length;
+	hvx_params.p_data = p_packet->data;
+	
+	return sd_ble_gatts_hvx(p_meas->conn_handle, &hvx_params);
+}
+
+
+/**@brief Function for encoding the value as 3 byte signed little endian, saturated. */
+static void frame_value_encode(int32_t value, uint8_t * p_data)
+{
+	if (value > 0x7FFFFF)
+		value = 0x7FFFFF;
+	if (value < -0x800000)
+		value = -0x800000;
+	
+	(void)uint24_encode((uint32_t)value, p_data);
+}
+
+
+/**@brief Function for passing queued notifications to the SoftDevice until it's buffers
+ *        are full. Sending is resumed by BLE_GATTS_EVT_HVN_TX_COMPLETE.
+ */
+static void tx_pump(ble_meas_t * p_meas)
+{
+	while (p_meas->tx_count > 0)
+	{
+		ble_meas_tx_packet_t * p_packet = &p_meas->tx_queue[p_meas->tx_tail];
+		
+		uint32_t err_code = packet_notify(p_meas, p_packet);
+		if (err_code == NRF_ERROR_RESOURCES)
+		{
+			return;
+		}
+		
+		if (err_code == NRF_SUCCESS)
+			p_meas->tx_stats.bytes += p_packet->length;
+		
+		if (p_packet->last)
+		{
+			if (err_code == NRF_SUCCESS)
+				p_meas->tx_stats.frames++;
+			else
+				p_meas->tx_stats.dropped++;
+		}
+		
+		// Deltas which follow the lost packet can't be decoded
+		if (err_code != NRF_SUCCESS && p_packet->handle == p_meas->frame_handles.value_handle)
+			frame_encoder_keyframe_request(&p_meas->encoder);
+		
+		p_meas->tx_tail = (p_meas->tx_tail + 1) % BLE_MEAS_TX_QUEUE_SIZE;
+		p_meas->tx_count--;
+	}
+}
+
+
+/**@brief Function for resuming the transmission from the main loop. */
+static void tx_pump_handler(void * p_event_data, uint16_t event_size)
+{
+	UNUSED_PARAMETER(event_size);
+	
+	tx_pump(*(ble_meas_t **)p_event_data);
+}
+
+
+/**@brief Function for handling the HVN TX Complete event. Queue is changed only from 
+ *        the main loop, so the transmission is resumed there.
+ *
+ * @param[in]   p_meas      Measurement Service structure.
+ * @param[in]   p_ble_evt   Event received from the BLE stack.
+ */
+static void on_hvn_tx_complete(ble_meas_t * p_meas, ble_evt_t const * p_ble_evt)
+{
+	p_meas->tx_stats.completed += p_ble_evt->evt.gatts_evt.params.hvn_tx_complete.count;
+	
+	if (p_meas->tx_count > 0)
+	{
+		(void)app_sched_event_put(&p_meas, sizeof(p_meas), tx_pump_handler);
+	}
+}
+
+
+/**@brief Function for queueing the frame in delta encoding. Encoder takes the frame as
+ *        reference only when it's queued whole.
+ */
+static uint32_t frame_delta_send(ble_meas_t * p_meas, ble_meas_frame_t const * p_frame)
+{
+	uint16_t max_length = MIN(p_meas->max_payload, MEASUREMENT_FRAME_CHAR_MAX_LEN);
+	uint8_t  head       = p_meas->tx_head;
+	uint8_t  count      = p_meas->tx_count;
+	uint8_t  channel    = 0;
+	uint8_t  part       = 0;
+	bool     keyframe   = frame_encoder_keyframe_due(&p_meas->encoder);
+	
+	frame_codec_frame_t const frame =
+	{
+		.sequence     = (uint16_t)p_frame->sequence,
+		.timestamp    = p_frame->timestamp,
+		.channel_mask = p_frame->channel_mask,
+		.p_values     = p_frame->p_values
+	};
+	
+	if (max_length < FRAME_CODEC_HEADER_LEN + FRAME_CODEC_MASK_LEN(p_meas->channel_count) + FRAME_CODEC_VALUE_MAX_LEN)
+	{
+		return NRF_ERROR_DATA_SIZE;
+	}
+	
+	// Keyframe carries every channel, delta frame the channels in the mask
+	while (channel < p_meas->channel_count && (keyframe || (frame.channel_mask >> channel) != 0))
+	{
+		if (count == BLE_MEAS_TX_QUEUE_SIZE)
+		{
+			p_meas->tx_stats.dropped++;
+			return NRF_ERROR_NO_MEM;
+		}
+		
+		ble_meas_tx_packet_t * p_packet = &p_meas->tx_queue[head];
+		
+		uint16_t length = frame_encoder_part_encode(&p_meas->encoder, &frame, keyframe, part, &channel,
+													p_packet->data, max_length);
+		// Channels left in the mask were all outside of the frame
+		if (length == 0)
+			break;
+		
+		p_packet->handle = p_meas->frame_handles.value_handle;
+		p_packet->length = length;
+		p_packet->last   = false;
+		
+		head = (head + 1) % BLE_MEAS_TX_QUEUE_SIZE;
+		count++;
+		part++;
+	}
+	
+	if (count == p_meas->tx_count)
+	{
+		return NRF_SUCCESS;
+	}
+	
+	ble_meas_tx_packet_t * p_last = &p_meas->tx_queue[(head + BLE_MEAS_TX_QUEUE_SIZE - 1) % BLE_MEAS_TX_QUEUE_SIZE];
+	
+	p_last->last = true;
+	frame_encoder_last_mark(p_last->data);
+	frame_encoder_commit(&p_meas->encoder, &frame, keyframe);
+	
+	p_meas->tx_head  = head;
+	p_meas->tx_count = count;
+	
+	tx_pump(p_meas);
+	
+	return NRF_SUCCESS;
+}
+
+
 uint32_t ble_meas_init(ble_meas_t * p_meas, const ble_meas_init_t * p_meas_init)
 {
 	if (p_meas == NULL || p_meas_init == NULL)
 	{
 		return NRF_ERROR_NULL;
 	}
-
+	
 	uint32_t   err_code;
 	ble_uuid_t ble_uuid;
 	
 	// Initialize service structure
 	p_meas->evt_handler				= p_meas_init->evt_handler;
 	p_meas->conn_handle				= BLE_CONN_HANDLE_INVALID;
+	p_meas->channel_count			= MIN(p_meas_init->channel_count, BLE_MEAS_CHANNEL_MAX);
+	p_meas->max_payload				= BLE_GATT_ATT_MTU_DEFAULT - BLE_MEAS_ATT_HEADER_LEN;
+	p_meas->frame_notification		= false;
+	p_meas->stream_notification		= false;
+	p_meas->ctrl_handler			= p_meas_init->ctrl_handler;
+	p_meas->encoding				= BLE_MEAS_ENCODING_ABSOLUTE;
+	frame_encoder_init(&p_meas->encoder, p_meas->channel_count, FRAME_CODEC_KEYFRAME_INTERVAL);
+	p_meas->tx_head					= 0;
+	p_meas->tx_tail					= 0;
+	p_meas->tx_count				= 0;
+	memset(&p_meas->tx_stats, 0, sizeof(p_meas->tx_stats));
 	
 	// Add Custom Service UUID
 	ble_uuid128_t base_uuid = { MEASUREMENT_SERVICE_UUID_BASE };
 	err_code =  sd_ble_uuid_vs_add(&base_uuid, &p_meas->uuid_type);
 	VERIFY_SUCCESS(err_code);
-
+	
 	ble_uuid.type = p_meas->uuid_type;
 	ble_uuid.uuid = MEASUREMENT_SERVICE_UUID;
 	
@@ -255,7 +840,7 @@ uint32_t ble_meas_init(ble_meas_t * p_meas, const ble_meas_init_t * p_meas_init)
 void ble_meas_on_ble_evt(ble_evt_t const * p_ble_evt, void * p_context)
 {
 	ble_meas_t * p_cus = (ble_meas_t *) p_context;
-    
+	
 	if (p_cus == NULL || p_ble_evt == NULL)
 	{
 		return;
@@ -266,7 +851,7 @@ void ble_meas_on_ble_evt(ble_evt_t const * p_ble_evt, void * p_context)
 	case BLE_GAP_EVT_CONNECTED:
 		on_connect(p_cus, p_ble_evt);
 		break;
-
+		
 	case BLE_GAP_EVT_DISCONNECTED:
 		on_disconnect(p_cus, p_ble_evt);
 		break;
@@ -274,7 +859,15 @@ void ble_meas_on_ble_evt(ble_evt_t const * p_ble_evt, void * p_context)
 	case BLE_GATTS_EVT_WRITE:
 		on_write(p_cus, p_ble_evt);
 		break;
-
+		
+	case BLE_GATTS_EVT_RW_AUTHORIZE_REQUEST:
+		on_rw_authorize_request(p_cus, p_ble_evt);
+		break;
+		
+	case BLE_GATTS_EVT_HVN_TX_COMPLETE:
+		on_hvn_tx_complete(p_cus, p_ble_evt);
+		break;
+		
 	default:
 		// No implementation needed.
 		break;
@@ -290,14 +883,14 @@ uint32_t ble_meas_value_update(ble_meas_t * p_cus, uint8_t* value, uint8_t value
 	
 	uint32_t err_code = NRF_SUCCESS;
 	ble_gatts_value_t gatts_value;
-
+	
 	// Initialize value struct.
 	memset(&gatts_value, 0, sizeof(gatts_value));
-
+	
 	gatts_value.len     = 4 * sizeof(uint8_t);
 	gatts_value.offset  = 0;
 	gatts_value.p_value = value;
-
+	
 	// Update database.
 	err_code = sd_ble_gatts_value_set(p_cus->conn_handle,
 		p_cus->value_handles[value_char_num].value_handle,
@@ -310,22 +903,274 @@ uint32_t ble_meas_value_update(ble_meas_t * p_cus, uint8_t* value, uint8_t value
 	if ((p_cus->conn_handle != BLE_CONN_HANDLE_INVALID)) 
 	{
 		ble_gatts_hvx_params_t hvx_params;
-
+		
 		memset(&hvx_params, 0, sizeof(hvx_params));
-
+		
 		hvx_params.handle = p_cus->value_handles[value_char_num].value_handle;
 		hvx_params.type   = BLE_GATT_HVX_NOTIFICATION;
 		hvx_params.offset = gatts_value.offset;
 		hvx_params.p_len  = &gatts_value.len;
 		hvx_params.p_data = gatts_value.p_value;
-
+		
 		err_code = sd_ble_gatts_hvx(p_cus->conn_handle, &hvx_params);
 	}
 	else
 	{
 		err_code = NRF_ERROR_INVALID_STATE;
 	}
-
+	
 	return err_code;
 	
-}
\ No newline at end of file
+}
+
+
+uint32_t ble_meas_cal_update(ble_meas_t * p_meas, uint8_t const * p_data, uint16_t length)
+{
+	if (p_meas == NULL)
+	{
+		return NRF_ERROR_NULL;
+	}
+	
+	ble_gatts_value_t gatts_value;
+	
+	memset(&gatts_value, 0, sizeof(gatts_value));
+	
+	gatts_value.len     = length;
+	gatts_value.offset  = 0;
+	gatts_value.p_value = (uint8_t *)p_data;
+	
+	return sd_ble_gatts_value_set(p_meas->conn_handle, p_meas->cal_handles.value_handle, &gatts_value);
+}
+
+
+uint32_t ble_meas_frame_send(ble_meas_t * p_meas, ble_meas_frame_t const * p_frame)
+{
+	if (p_meas == NULL || p_frame == NULL)
+	{
+		return NRF_ERROR_NULL;
+	}
+	
+	if (p_meas->conn_handle == BLE_CONN_HANDLE_INVALID || !p_meas->frame_notification)
+	{
+		return NRF_ERROR_INVALID_STATE;
+	}
+	
+	if (p_meas->encoding == BLE_MEAS_ENCODING_DELTA)
+	{
+		return frame_delta_send(p_meas, p_frame);
+	}
+	
+	uint8_t  mask_length = BLE_MEAS_FRAME_MASK_LEN(p_meas->channel_count);
+	uint16_t max_length  = MIN(p_meas->max_payload, MEASUREMENT_FRAME_CHAR_MAX_LEN);
+	uint8_t  head        = p_meas->tx_head;
+	uint8_t  count       = p_meas->tx_count;
+	uint8_t  channel     = 0;
+	ble_meas_tx_packet_t * p_packet = NULL;
+	
+	if (max_length < BLE_MEAS_FRAME_HEADER_LEN + mask_length + BLE_MEAS_FRAME_VALUE_LEN)
+	{
+		return NRF_ERROR_DATA_SIZE;
+	}
+	
+	// Every part carries the header and the bitmap of it's own channels
+	while (channel < p_meas->channel_count)
+	{
+		uint16_t length = BLE_MEAS_FRAME_HEADER_LEN + mask_length;
+		
+		// Frame is queued whole or not at all
+		if (count == BLE_MEAS_TX_QUEUE_SIZE)
+		{
+			p_meas->tx_stats.dropped++;
+			return NRF_ERROR_NO_MEM;
+		}
+		
+		p_packet = &p_meas->tx_queue[head];
+		
+		(void)uint16_encode((uint16_t)p_frame->sequence, &p_packet->data[0]);
+		(void)uint24_encode(p_frame->timestamp, &p_packet->data[2]);
+		memset(&p_packet->data[BLE_MEAS_FRAME_HEADER_LEN], 0, mask_length);
+		
+		for (; channel < p_meas->channel_count && length + BLE_MEAS_FRAME_VALUE_LEN <= max_length; channel++)
+		{
+			if (!(p_frame->channel_mask & ((uint64_t)1 << channel)))
+				continue;
+			
+			p_packet->data[BLE_MEAS_FRAME_HEADER_LEN + channel / 8] |= (uint8_t)(1 << (channel % 8));
+			frame_value_encode(p_frame->p_values[channel], &p_packet->data[length]);
+			length += BLE_MEAS_FRAME_VALUE_LEN;
+		}
+		
+		// Channels left in the mask were all outside of the frame
+		if (length == BLE_MEAS_FRAME_HEADER_LEN + mask_length)
+			break;
+		
+		p_packet->handle = p_meas->frame_handles.value_handle;
+		p_packet->length = length;
+		p_packet->last   = false;
+		
+		head = (head + 1) % BLE_MEAS_TX_QUEUE_SIZE;
+		count++;
+	}
+	
+	if (count == p_meas->tx_count)
+	{
+		return NRF_SUCCESS;
+	}
+	
+	p_meas->tx_queue[(head + BLE_MEAS_TX_QUEUE_SIZE - 1) % BLE_MEAS_TX_QUEUE_SIZE].last = true;
+	p_meas->tx_head  = head;
+	p_meas->tx_count = count;
+	
+	tx_pump(p_meas);
+	
+	return NRF_SUCCESS;
+}
+
+
+uint32_t ble_meas_stream_send(ble_meas_t * p_meas, ble_meas_stream_block_t const * p_block)
+{
+	if (p_meas == NULL || p_block == NULL)
+	{
+		return NRF_ERROR_NULL;
+	}
+	
+	if (p_block->count > BLE_MEAS_STREAM_SLOT_MAX)
+	{
+		return NRF_ERROR_INVALID_PARAM;
+	}
+	
+	if (p_meas->conn_handle == BLE_CONN_HANDLE_INVALID || !p_meas->stream_notification)
+	{
+		return NRF_ERROR_INVALID_STATE;
+	}
+	
+	uint16_t max_length = MIN(p_meas->max_payload, MEASUREMENT_STREAM_CHAR_MAX_LEN);
+	uint8_t  part_slots = (max_length - BLE_MEAS_STREAM_HEADER_LEN) / BLE_MEAS_STREAM_SLOT_LEN;
+	uint8_t  head       = p_meas->tx_head;
+	
+	if (p_block->count == 0)
+	{
+		return NRF_SUCCESS;
+	}
+	
+	// Block is queued whole or not at all
+	if (p_meas->tx_count + CEIL_DIV(p_block->count, part_slots) > BLE_MEAS_TX_QUEUE_SIZE)
+	{
+		p_meas->tx_stats.dropped++;
+		return NRF_ERROR_NO_MEM;
+	}
+	
+	for (uint8_t slot = 0; slot < p_block->count; slot += part_slots)
+	{
+		ble_meas_tx_packet_t * p_packet = &p_meas->tx_queue[head];
+		uint8_t slots = MIN(part_slots, p_block->count - slot);
+		
+		(void)uint16_encode((uint16_t)p_block->sequence, &p_packet->data[0]);
+		p_packet->data[2] = p_block->channel;
+		p_packet->data[3] = slot;
+		(void)uint16_encode((uint16_t)((p_block->missed_mask >> slot) & ((1u << slots) - 1)), &p_packet->data[4]);
+		memcpy(&p_packet->data[BLE_MEAS_STREAM_HEADER_LEN], &p_block->p_data[slot * BLE_MEAS_STREAM_SLOT_LEN], 
+			   slots * BLE_MEAS_STREAM_SLOT_LEN);
+		
+		p_packet->handle = p_meas->stream_handles.value_handle;
+		p_packet->length = BLE_MEAS_STREAM_HEADER_LEN + slots * BLE_MEAS_STREAM_SLOT_LEN;
+		p_packet->last   = (slot + slots == p_block->count);
+		
+		head = (head + 1) % BLE_MEAS_TX_QUEUE_SIZE;
+		p_meas->tx_count++;
+	}
+	
+	p_meas->tx_head = head;
+	
+	tx_pump(p_meas);
+	
+	return NRF_SUCCESS;
+}
+
+
+uint32_t ble_meas_encoding_set(ble_meas_t * p_meas, uint8_t encoding)
+{
+	if (p_meas == NULL)
+	{
+		return NRF_ERROR_NULL;
+	}
+	
+	if (encoding >= BLE_MEAS_ENCODING_COUNT)
+	{
+		return NRF_ERROR_NOT_SUPPORTED;
+	}
+	
+	ble_meas_encoding_event_t event =
+	{
+		.p_meas   = p_meas,
+		.encoding = encoding
+	};
+	
+	// Frames and their packets are encoded in the main loop, so the encoder 
+	// is switched there, between two frames
+	if (app_sched_event_put(&event, sizeof(event), encoding_set_handler) != NRF_SUCCESS)
+	{
+		return NRF_ERROR_BUSY;
+	}
+	
+	return NRF_SUCCESS;
+}
+
+
+void ble_meas_tx_stats_get(ble_meas_t const * p_meas, ble_meas_tx_stats_t * p_stats)
+{
+	*p_stats = p_meas->tx_stats;
+}
+
+
+void ble_meas_codec_stats_get(ble_meas_t const * p_meas, frame_codec_stats_t * p_stats)
+{
+	*p_stats = p_meas->encoder.stats;
+}
+
+
+void ble_meas_att_mtu_set(ble_meas_t * p_meas, uint16_t att_mtu)
+{
+	if (p_meas == NULL || att_mtu < BLE_GATT_ATT_MTU_DEFAULT)
+	{
+		return;
+	}
+	
+	p_meas->max_payload = att_mtu - BLE_MEAS_ATT_HEADER_LEN;
+}
+
+
+uint32_t ble_meas_link_update(ble_meas_t * p_meas, uint8_t const * p_data, uint16_t length)
+{
+	if (p_meas == NULL)
+	{
+		return NRF_ERROR_NULL;
+	}
+	
+	ble_gatts_value_t gatts_value;
+	
+	memset(&gatts_value, 0, sizeof(gatts_value));
+	
+	gatts_value.len     = length;
+	gatts_value.offset  = 0;
+	gatts_value.p_value = (uint8_t *)p_data;
+	
+	uint32_t err_code = sd_ble_gatts_value_set(p_meas->conn_handle, p_meas->link_handles.value_handle, &gatts_value);
+	VERIFY_SUCCESS(err_code);
+	
+	if (p_meas->conn_handle == BLE_CONN_HANDLE_INVALID)
+	{
+		return NRF_SUCCESS;
+	}
+	
+	ble_gatts_hvx_params_t hvx_params;
+	
+	memset(&hvx_params, 0, sizeof(hvx_params));
+	
+	hvx_params.handle = p_meas->link_handles.value_handle;
+	hvx_params.type   = BLE_GATT_HVX_NOTIFICATION;
+	hvx_params.p_len  = &gatts_value.len;
+	hvx_params.p_data = gatts_value.p_value;
+	
+	return sd_ble_gatts_hvx(p_meas->conn_handle, &hvx_params);
+}
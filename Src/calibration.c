@@ -0,0 +1,266 @@
+/**
+ * @file
+ * calibration.c
+ * 
+ * @brief Per-channel calibration
+ * 
+ * This file contains implementations of functions declared in
+ * calibration.h. Table is applied by the acquisition from the main
+ * loop, BLE writes may interrupt it, so it is only changed inside 
+ * critical region. Flash
+ * write works on a copy of the table, which stays valid until FDS
+ * has finished.
+ * 
+ */
+
+#include <string.h>
+#include "sdk_common.h"
+#include "calibration.h"
+#include "fds.h"
+#include "nrf_pwr_mgmt.h"
+#include "app_util_platform.h"
+
+STATIC_ASSERT(sizeof(cal_table_t) % sizeof(uint32_t) == 0);
+
+static cal_table_t				m_table;
+static cal_table_t				m_flash_table;			/**< Table being written to flash */
+static fds_record_desc_t		m_record_desc;
+static bool						m_record_found;
+static volatile bool			m_fds_initialized;
+static volatile bool			m_flash_busy;			/**< Write or garbage collection in progress */
+static volatile bool			m_save_pending;			/**< Table changed while flash was busy */
+static uint8_t					m_selected_record;		/**< Channel number or CAL_TEMP_REF_RECORD */
+
+
+/**@brief Sets coefficients of all channels to pass the input unchanged. */
+static void cal_table_reset(cal_table_t * p_table)
+{
+	for (uint8_t channel = 0; channel < CAL_CHANNEL_COUNT; channel++)
+	{
+		p_table->channel[channel].offset_uv = 0;
+		p_table->channel[channel].gain      = (1L << CAL_GAIN_Q);
+		p_table->channel[channel].quad      = 0;
+		p_table->channel[channel].tempco    = 0;
+	}
+	p_table->temp_ref = CAL_TEMP_UNKNOWN;
+}
+
+/**@brief Starts write of the table copy to flash. */
+static ret_code_t cal_save(void)
+{
+	ret_code_t err_code;
+	
+	fds_record_t const record = {
+		.file_id           = CAL_FILE_ID,
+		.key               = CAL_RECORD_KEY,
+		.data.p_data       = &m_flash_table,
+		.data.length_words = sizeof(m_flash_table) / sizeof(uint32_t)
+	};
+	
+	CRITICAL_REGION_ENTER();
+	m_flash_table = m_table;
+	CRITICAL_REGION_EXIT();
+	
+	m_save_pending = false;
+	m_flash_busy   = true;
+	
+	if (m_record_found)
+		err_code = fds_record_update(&m_record_desc, &record);
+	else
+		err_code = fds_record_write(&m_record_desc, &record);
+	
+	if (err_code == FDS_ERR_NO_SPACE_IN_FLASH)
+	{
+		// Old versions of the record are removed, then write is repeated
+		m_save_pending = true;
+		err_code = fds_gc();
+	}
+	
+	if (err_code != NRF_SUCCESS)
+		m_flash_busy = false;
+	
+	return err_code;
+}
+
+static void cal_fds_evt_handler(fds_evt_t const * p_evt)
+{
+	switch (p_evt->id)
+	{
+	case FDS_EVT_INIT:
+		m_fds_initialized = (p_evt->result == NRF_SUCCESS);
+		break;
+		
+	case FDS_EVT_WRITE:
+	case FDS_EVT_UPDATE:
+		if (p_evt->write.file_id != CAL_FILE_ID || p_evt->write.record_key != CAL_RECORD_KEY)
+			break;
+		
+		if (p_evt->result == NRF_SUCCESS)
+			m_record_found = true;
+		
+		m_flash_busy = false;
+		if (m_save_pending)
+			(void)cal_save();
+		break;
+		
+	case FDS_EVT_GC:
+		if (!m_flash_busy)
+			break;
+		
+		m_flash_busy = false;
+		if (m_save_pending)
+			(void)cal_save();
+		break;
+		
+	default:
+		break;
+	}
+}
+
+ret_code_t cal_init(void)
+{
+	ret_code_t err_code;
+	fds_find_token_t token;
+	fds_flash_record_t flash_record;
+	
+	cal_table_reset(&m_table);
+	
+	err_code = fds_register(cal_fds_evt_handler);
+	VERIFY_SUCCESS(err_code);
+	
+	err_code = fds_init();
+	VERIFY_SUCCESS(err_code);
+	
+	while (!m_fds_initialized)
+	{
+		nrf_pwr_mgmt_run();
+	}
+	
+	memset(&token, 0, sizeof(token));
+	if (fds_record_find(CAL_FILE_ID, CAL_RECORD_KEY, &m_record_desc, &token) != NRF_SUCCESS)
+		return NRF_SUCCESS;
+	
+	m_record_found = true;
+	
+	err_code = fds_record_open(&m_record_desc, &flash_record);
+	VERIFY_SUCCESS(err_code);
+	
+	// Record of different size is left from other firmware version
+	if (flash_record.p_header->length_words == sizeof(m_table) / sizeof(uint32_t))
+		memcpy(&m_table, flash_record.p_data, sizeof(m_table));
+	
+	return fds_record_close(&m_record_desc);
+}
+
+int32_t cal_apply(uint8_t channel, int32_t uv, int32_t temp)
+{
+	cal_coeff_t const * p_coeff = &m_table.channel[channel];
+	int64_t value;
+	
+	value = ((int64_t)uv * p_coeff->gain) >> CAL_GAIN_Q;
+	
+	// Square is scaled down before multiplication, so the product
+	// fits 64 bits for any input of the ADC range
+	if (p_coeff->quad != 0)
+		value += ((((int64_t)uv * uv) >> 16) * p_coeff->quad) >> (CAL_QUAD_Q - 16);
+	
+	value += p_coeff->offset_uv;
+	
+	if (p_coeff->tempco != 0 && temp != CAL_TEMP_UNKNOWN && m_table.temp_ref != CAL_TEMP_UNKNOWN)
+		value -= ((int64_t)p_coeff->tempco * (temp - m_table.temp_ref)) >> (CAL_TEMPCO_Q + CAL_TEMP_Q);
+	
+	if (value > INT32_MAX)
+		return INT32_MAX;
+	if (value < INT32_MIN)
+		return INT32_MIN;
+	
+	return (int32_t)value;
+}
+
+/**@brief Stores changed table to flash. */
+static ret_code_t cal_table_save(void)
+{
+	// Table is saved again after the write in progress
+	if (m_flash_busy)
+	{
+		m_save_pending = true;
+		return NRF_SUCCESS;
+	}
+	
+	return cal_save();
+}
+
+ret_code_t cal_channel_set(uint8_t channel, cal_coeff_t const * p_coeff)
+{
+	if (channel >= CAL_CHANNEL_COUNT)
+		return NRF_ERROR_INVALID_PARAM;
+	
+	CRITICAL_REGION_ENTER();
+	m_table.channel[channel] = *p_coeff;
+	CRITICAL_REGION_EXIT();
+	
+	return cal_table_save();
+}
+
+ret_code_t cal_record_write(uint8_t const * p_record, uint16_t length)
+{
+	cal_coeff_t coeff;
+	
+	if (length == 0)
+		return NRF_ERROR_INVALID_LENGTH;
+	
+	if (p_record[0] >= CAL_CHANNEL_COUNT && p_record[0] != CAL_TEMP_REF_RECORD)
+		return NRF_ERROR_INVALID_PARAM;
+	
+	m_selected_record = p_record[0];
+	
+	if (length == CAL_SELECT_RECORD_LENGTH)
+		return NRF_SUCCESS;
+	
+	if (p_record[0] == CAL_TEMP_REF_RECORD)
+	{
+		if (length != CAL_TEMP_REF_RECORD_LENGTH)
+			return NRF_ERROR_INVALID_LENGTH;
+		
+		CRITICAL_REGION_ENTER();
+		m_table.temp_ref = (int32_t)uint32_decode(&p_record[1]);
+		CRITICAL_REGION_EXIT();
+		
+		return cal_table_save();
+	}
+	
+	if (length != CAL_CHANNEL_RECORD_LENGTH)
+		return NRF_ERROR_INVALID_LENGTH;
+	
+	coeff.offset_uv = (int32_t)uint32_decode(&p_record[1]);
+	coeff.gain      = (int32_t)uint32_decode(&p_record[5]);
+	coeff.quad      = (int32_t)uint32_decode(&p_record[9]);
+	coeff.tempco    = (int32_t)uint32_decode(&p_record[13]);
+	
+	return cal_channel_set(p_record[0], &coeff);
+}
+
+uint16_t cal_record_read(uint8_t * p_record)
+{
+	p_record[0] = m_selected_record;
+	
+	if (m_selected_record == CAL_TEMP_REF_RECORD)
+	{
+		(void)uint32_encode((uint32_t)m_table.temp_ref, &p_record[1]);
+		return CAL_TEMP_REF_RECORD_LENGTH;
+	}
+	
+	cal_coeff_t const * p_coeff = &m_table.channel[m_selected_record];
+	
+	(void)uint32_encode((uint32_t)p_coeff->offset_uv, &p_record[1]);
+	(void)uint32_encode((uint32_t)p_coeff->gain,      &p_record[5]);
+	(void)uint32_encode((uint32_t)p_coeff->quad,      &p_record[9]);
+	(void)uint32_encode((uint32_t)p_coeff->tempco,    &p_record[13]);
+	
+	return CAL_CHANNEL_RECORD_LENGTH;
+}
+
+cal_table_t const * cal_table_get(void)
+{
+	return &m_table;
+}
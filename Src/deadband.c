@@ -0,0 +1,154 @@
+/**
+ * @file
+ * deadband.c
+ *
+ * @brief Per-channel change detection
+ *
+ * This file contains implementations of functions declared in
+ * deadband.h. Frames are passed in from the main loop, while the 
+ * configuration is changed and the state is reset by BLE events from
+ * interrupt. Every channel is therefore checked and updated in it's own
+ * short critical region, so it never sees half-written configuration,
+ * and interrupts aren't held off for the whole frame. Silence is 
+ * measured in application timer ticks of the frame timestamps, so late
+ * frame processing doesn't stretch it.
+ *
+ */
+
+#include <string.h>
+#include "sdk_common.h"
+#include "deadband.h"
+#include "app_timer.h"
+#include "app_util_platform.h"
+
+/**@brief State of single channel. */
+typedef struct
+{
+	int32_t			last_value;			/**< Last value sent */
+	uint32_t		last_ticks;			/**< Timestamp of the frame the last value was sent in */
+	bool			valid;				/**< Value was sent since the reset */
+} deadband_channel_t;
+
+static deadband_config_t		m_config[DEADBAND_CHANNEL_COUNT];
+static deadband_channel_t		m_channels[DEADBAND_CHANNEL_COUNT];
+static deadband_stats_t			m_stats;
+
+
+/**@brief Checks if the value is far enough from the last one sent. */
+static bool deadband_changed(deadband_config_t const * p_config, int32_t last, int32_t value)
+{
+	int64_t change = (int64_t)value - last;
+	int64_t band   = p_config->abs_uv;
+	int64_t rel    = (((last < 0) ? -(int64_t)last : last) * p_config->rel_permille) / 1000;
+	
+	if (rel > band)
+		band = rel;
+	
+	return (change > band || change < -band);
+}
+
+/**@brief Checks the value of the channel against the last one sent and takes
+ *        it as the last one if it is to be sent. Called in critical region. */
+static bool deadband_channel_check(uint8_t channel, int32_t value, uint32_t timestamp)
+{
+	deadband_config_t const * p_config  = &m_config[channel];
+	deadband_channel_t *      p_channel = &m_channels[channel];
+	
+	m_stats.checked++;
+	
+	if (p_channel->valid && (p_config->abs_uv != 0 || p_config->rel_permille != 0) &&
+		!deadband_changed(p_config, p_channel->last_value, value))
+	{
+		uint32_t silence = app_timer_cnt_diff_compute(timestamp, p_channel->last_ticks);
+		
+		if (p_config->max_silence_ms == 0 || silence < APP_TIMER_TICKS(p_config->max_silence_ms))
+		{
+			m_stats.suppressed++;
+			return false;
+		}
+		
+		m_stats.keepalives++;
+	}
+	
+	p_channel->last_value = value;
+	p_channel->last_ticks = timestamp;
+	p_channel->valid      = true;
+	
+	return true;
+}
+
+void deadband_init(deadband_config_t const * p_config)
+{
+	(void)deadband_config_set(DEADBAND_CHANNEL_ALL, p_config);
+	
+	CRITICAL_REGION_ENTER();
+	memset(&m_stats, 0, sizeof(m_stats));
+	CRITICAL_REGION_EXIT();
+	
+	deadband_reset();
+}
+
+ret_code_t deadband_config_set(uint8_t channel, deadband_config_t const * p_config)
+{
+	if (channel == DEADBAND_CHANNEL_ALL)
+	{
+		for (uint8_t i = 0; i < DEADBAND_CHANNEL_COUNT; i++)
+		{
+			CRITICAL_REGION_ENTER();
+			m_config[i] = *p_config;
+			CRITICAL_REGION_EXIT();
+		}
+		
+		return NRF_SUCCESS;
+	}
+	
+	if (channel >= DEADBAND_CHANNEL_COUNT)
+		return NRF_ERROR_INVALID_PARAM;
+	
+	CRITICAL_REGION_ENTER();
+	m_config[channel] = *p_config;
+	CRITICAL_REGION_EXIT();
+	
+	return NRF_SUCCESS;
+}
+
+void deadband_reset(void)
+{
+	// Single store, channel being checked sees it before or after the check
+	for (uint8_t i = 0; i < DEADBAND_CHANNEL_COUNT; i++)
+		m_channels[i].valid = false;
+}
+
+uint64_t deadband_apply(uint64_t channel_mask, int32_t const * p_values, uint32_t timestamp)
+{
+	uint64_t send_mask = 0;
+	
+	for (uint8_t channel = 0; channel < DEADBAND_CHANNEL_COUNT; channel++)
+	{
+		uint64_t bit = (uint64_t)1 << channel;
+		bool send;
+		
+		// Channel missing from the frame is sent whole when it's back
+		if (!(channel_mask & bit))
+		{
+			m_channels[channel].valid = false;
+			continue;
+		}
+		
+		CRITICAL_REGION_ENTER();
+		send = deadband_channel_check(channel, p_values[channel], timestamp);
+		CRITICAL_REGION_EXIT();
+		
+		if (send)
+			send_mask |= bit;
+	}
+	
+	return send_mask;
+}
+
+void deadband_stats_get(deadband_stats_t * p_stats)
+{
+	CRITICAL_REGION_ENTER();
+	*p_stats = m_stats;
+	CRITICAL_REGION_EXIT();
+}
@@ -0,0 +1,772 @@
+/**
+ * @file
+ * device_registry.c
+ *
+ * @brief Registry of the devices on I2C bus
+ *
+ * This file contains implementations of functions declared in
+ * device_registry.h. Probe is a single byte read, it is chained from
+ * the completion callback of the previous one, so discovery runs from
+ * TWIM interrupt. Every bus has it's own probe chain, so buses are
+ * probed in parallel. Busy device doesn't acknowledge it's address, so
+ * the addresses without answer are probed once more after a delay.
+ * 
+ * Self-test reads are chained the same way and timed by CPU cycle counter.
+ * Conversion started by every read is waited out by application timer
+ * before the next one, and address NACK of the chip still converting is
+ * polled, so a clock counts as working only when all of it's reads have
+ * completed. Clocks selected are kept in the registry record, so the test
+ * runs again only after discovery or on request.
+ *
+ */
+
+#include <string.h>
+#include "sdk_common.h"
+#include "device_registry.h"
+#include "i2c.h"
+#include "LTC2497.h"
+#include "fds.h"
+#include "app_timer.h"
+#include "nrf_pwr_mgmt.h"
+#include "nrf.h"
+
+#define DEV_ADDRESS_NONE			0x00		/**< General call, never probed */
+#define DEV_ADDRESS_MAX				0x7F
+#define DEV_PROBE_PASSES			2
+#define DEV_RETRY_DELAY_MS			LTC2497_CONVERSION_TIME_1X_MS	/**< Longest time known device doesn't answer */
+#define DEV_SELFTEST_POLLS			4			/**< Address NACKs of single self-test read before it fails */
+#define DEV_DEVICE_NONE				0xFF		/**< Read chain hasn't read any device yet */
+
+STATIC_ASSERT(sizeof(dev_registry_t) % sizeof(uint32_t) == 0);
+
+/**@brief Address range where the device of given type may be. */
+typedef struct
+{
+	uint8_t			first;
+	uint8_t			last;
+	dev_type_t		type;
+} dev_candidate_t;
+
+/**@brief Addresses probed, ascending. */
+static const dev_candidate_t m_candidates[] = {
+	// LTC2497, address is selected by CA0-CA2 pins, 0x77 is global address
+	{ 0x14, 0x17, DEV_TYPE_LTC2497 },
+	{ 0x24, 0x27, DEV_TYPE_LTC2497 },
+	{ 0x34, 0x37, DEV_TYPE_LTC2497 },
+	{ 0x44, 0x47, DEV_TYPE_LTC2497 },
+	{ 0x54, 0x57, DEV_TYPE_LTC2497 },
+	{ 0x64, 0x67, DEV_TYPE_LTC2497 },
+	{ 0x74, 0x76, DEV_TYPE_LTC2497 }
+};
+
+/**@brief Probe chain of single bus. */
+typedef struct
+{
+	twi_transaction_t	transaction;
+	uint8_t				data;
+	uint8_t				address;		/**< Address being probed */
+	bool				absent;			/**< Bus isn't initialized */
+	uint32_t			found[(DEV_ADDRESS_MAX + 1) / 32];
+} dev_probe_t;
+
+/**@brief Self-test read chain of single bus. */
+typedef struct
+{
+	twi_transaction_t	transaction;
+	uint8_t				data;
+	uint8_t				device;			/**< Registry index of the device being read */
+	uint32_t			start;			/**< Cycle counter at the read start */
+} dev_selftest_chain_t;
+
+/**@brief Fastest clock supported by each device type. */
+static const uint8_t m_type_max_speed[] = {
+	[DEV_TYPE_UNKNOWN] = TWI_SPEED_100K,
+	[DEV_TYPE_LTC2497] = TWI_SPEED_400K
+};
+
+/**@brief Time the device doesn't answer after a transaction, while it converts. */
+static const uint16_t m_type_busy_ms[] = {
+	[DEV_TYPE_UNKNOWN] = 0,
+	[DEV_TYPE_LTC2497] = LTC2497_CONVERSION_TIME_1X_MS	/**< Self-test runs before setup, chip converts at power-on speed */
+};
+
+APP_TIMER_DEF(m_retry_timer);
+APP_TIMER_DEF(m_selftest_timer);
+
+__ALIGN(4) static dev_registry_t	m_registry;
+static bool						m_registry_valid;		/**< Registry is loaded from flash or discovered */
+static fds_record_desc_t		m_record_desc;
+static bool						m_record_found;
+static volatile bool			m_fds_initialized;
+static volatile bool			m_flash_busy;			/**< Write or garbage collection in progress */
+static volatile bool			m_save_pending;			/**< Write waits for garbage collection */
+
+static volatile bool			m_busy;
+static dev_probe_t				m_probes[TWI_BUS_COUNT];
+static uint8_t					m_pass;
+static uint8_t					m_buses_probing;		/**< Buses which haven't finished the pass */
+static dev_timing_t				m_timing[DEV_REGISTRY_SIZE];
+
+static volatile bool			m_selftest_busy;
+static volatile bool			m_speeds_pending;		/**< Clocks selected wait for the registry write in progress */
+static dev_selftest_chain_t		m_chains[TWI_BUS_COUNT];
+static uint8_t					m_chains_reading;		/**< Buses which haven't finished the self-test pass */
+static uint8_t					m_selftest_speed;		/**< Clock being tested */
+static uint8_t					m_selftest_xfer;		/**< Read of the clock in progress */
+static uint8_t					m_selftest_poll;		/**< Polls of the read done */
+static uint32_t					m_selftest_delay_ms;	/**< Delay before the next poll */
+static uint32_t					m_selftest_busy_ms;		/**< Conversion started by the read, waited out before the next one */
+static bool						m_selftest_pending[DEV_REGISTRY_SIZE];	/**< Device hasn't completed the read yet */
+static uint32_t					m_selftest_cycles[DEV_REGISTRY_SIZE];	/**< CPU cycles of completed reads at the clock */
+
+
+/**@brief Gets type of the device expected at the address, DEV_TYPE_UNKNOWN if address isn't probed. */
+static dev_type_t dev_candidate_type(uint8_t address)
+{
+	for (uint8_t i = 0; i < ARRAY_SIZE(m_candidates); i++)
+	{
+		if (address >= m_candidates[i].first && address <= m_candidates[i].last)
+			return m_candidates[i].type;
+	}
+	
+	return DEV_TYPE_UNKNOWN;
+}
+
+static bool dev_is_found(dev_probe_t const * p_probe, uint8_t address)
+{
+	return (p_probe->found[address / 32] & (1UL << (address % 32))) != 0;
+}
+
+/**@brief Gets the next candidate address after given, which hasn't answered yet. */
+static uint8_t dev_candidate_next(dev_probe_t const * p_probe, uint8_t address)
+{
+	if (p_probe->absent)
+		return DEV_ADDRESS_NONE;
+	
+	while (address < DEV_ADDRESS_MAX)
+	{
+		address++;
+		if (dev_candidate_type(address) != DEV_TYPE_UNKNOWN && !dev_is_found(p_probe, address))
+			return address;
+	}
+	
+	return DEV_ADDRESS_NONE;
+}
+
+/**@brief Starts write of the registry to flash. */
+static ret_code_t dev_registry_save(void)
+{
+	ret_code_t err_code;
+	
+	fds_record_t const record = {
+		.file_id           = DEV_FILE_ID,
+		.key               = DEV_RECORD_KEY,
+		.data.p_data       = &m_registry,
+		.data.length_words = sizeof(m_registry) / sizeof(uint32_t)
+	};
+	
+	m_save_pending = false;
+	m_flash_busy   = true;
+	
+	if (m_record_found)
+		err_code = fds_record_update(&m_record_desc, &record);
+	else
+		err_code = fds_record_write(&m_record_desc, &record);
+	
+	if (err_code == FDS_ERR_NO_SPACE_IN_FLASH)
+	{
+		m_save_pending = true;
+		err_code = fds_gc();
+	}
+	
+	if (err_code != NRF_SUCCESS)
+		m_flash_busy = false;
+	
+	return err_code;
+}
+
+/**@brief Builds registry from the addresses answered and saves it if changed. */
+static void dev_discovery_finish(void)
+{
+	dev_registry_t registry;
+	
+	memset(&registry, 0, sizeof(registry));
+	
+	for (uint8_t bus = 0; bus < TWI_BUS_COUNT; bus++)
+	{
+		for (uint8_t address = 1; address <= DEV_ADDRESS_MAX && registry.count < DEV_REGISTRY_SIZE; address++)
+		{
+			if (!dev_is_found(&m_probes[bus], address))
+				continue;
+			
+			registry.device[registry.count].bus     = bus;
+			registry.device[registry.count].address = address;
+			registry.device[registry.count].type    = dev_candidate_type(address);
+			registry.count++;
+		}
+	}
+	
+	bool changed = !m_registry_valid || memcmp(&registry, &m_registry, sizeof(registry)) != 0;
+	
+	m_registry       = registry;
+	m_registry_valid = true;
+	
+	if (changed)
+		(void)dev_registry_save();
+	
+	m_busy = false;
+}
+
+static void dev_probe_next(dev_probe_t * p_probe);
+
+/**@brief Starts probe chains of all buses. */
+static void dev_pass_start(void)
+{
+	m_buses_probing = TWI_BUS_COUNT;
+	
+	for (uint8_t bus = 0; bus < TWI_BUS_COUNT; bus++)
+	{
+		m_probes[bus].address = DEV_ADDRESS_NONE;
+		dev_probe_next(&m_probes[bus]);
+	}
+}
+
+/**@brief Called when probe chain of the bus ends, finishes the pass after the last bus. */
+static void dev_pass_end(void)
+{
+	bool retry = false;
+	uint8_t buses_probing;
+	
+	CRITICAL_REGION_ENTER();
+	buses_probing = --m_buses_probing;
+	CRITICAL_REGION_EXIT();
+	
+	if (buses_probing > 0)
+		return;
+	
+	m_pass++;
+	
+	for (uint8_t bus = 0; bus < TWI_BUS_COUNT; bus++)
+	{
+		if (dev_candidate_next(&m_probes[bus], DEV_ADDRESS_NONE) != DEV_ADDRESS_NONE)
+			retry = true;
+	}
+	
+	if (m_pass < DEV_PROBE_PASSES && retry)
+	{
+		if (app_timer_start(m_retry_timer, APP_TIMER_TICKS(DEV_RETRY_DELAY_MS), NULL) == NRF_SUCCESS)
+			return;
+	}
+	
+	dev_discovery_finish();
+}
+
+/**@brief Probes the next candidate address of the bus or ends the pass. */
+static void dev_probe_next(dev_probe_t * p_probe)
+{
+	for (;;)
+	{
+		p_probe->address = dev_candidate_next(p_probe, p_probe->address);
+		if (p_probe->address == DEV_ADDRESS_NONE)
+		{
+			dev_pass_end();
+			return;
+		}
+		
+		p_probe->transaction.xfer.address = p_probe->address;
+		
+		ret_code_t err_code = twi_schedule(&p_probe->transaction);
+		if (err_code == NRF_SUCCESS)
+			return;
+		
+		// Address which can't be probed now is left for the next pass
+		if (err_code == NRF_ERROR_INVALID_STATE)
+			p_probe->absent = true;
+	}
+}
+
+static void dev_probe_callback(ret_code_t result, void * p_context)
+{
+	dev_probe_t * p_probe = (dev_probe_t *)p_context;
+	
+	if (result == NRF_SUCCESS)
+		p_probe->found[p_probe->address / 32] |= (1UL << (p_probe->address % 32));
+	
+	dev_probe_next(p_probe);
+}
+
+static void dev_retry_timeout_handler(void * p_context)
+{
+	UNUSED_PARAMETER(p_context);
+	
+	dev_pass_start();
+}
+
+static void dev_speeds_save(void);
+static void dev_selftest_callback(ret_code_t result, void * p_context);
+static void dev_selftest_timeout_handler(void * p_context);
+
+static void dev_fds_evt_handler(fds_evt_t const * p_evt)
+{
+	switch (p_evt->id)
+	{
+	case FDS_EVT_INIT:
+		m_fds_initialized = (p_evt->result == NRF_SUCCESS);
+		break;
+		
+	case FDS_EVT_WRITE:
+	case FDS_EVT_UPDATE:
+		if (p_evt->write.file_id != DEV_FILE_ID || p_evt->write.record_key != DEV_RECORD_KEY)
+			break;
+		
+		if (p_evt->result == NRF_SUCCESS)
+			m_record_found = true;
+		
+		m_flash_busy = false;
+		
+		if (m_speeds_pending)
+			dev_speeds_save();
+		break;
+		
+	case FDS_EVT_GC:
+		if (!m_save_pending)
+			break;
+		
+		m_flash_busy = false;
+		(void)dev_registry_save();
+		break;
+		
+	default:
+		break;
+	}
+}
+
+ret_code_t dev_registry_init(void)
+{
+	ret_code_t err_code;
+	fds_find_token_t token;
+	fds_flash_record_t flash_record;
+	
+	for (uint8_t bus = 0; bus < TWI_BUS_COUNT; bus++)
+	{
+		dev_probe_t * p_probe = &m_probes[bus];
+		
+		p_probe->transaction.xfer      = (nrfx_twim_xfer_desc_t)NRFX_TWIM_XFER_DESC_RX(0, &p_probe->data, sizeof(p_probe->data));
+		p_probe->transaction.callback  = dev_probe_callback;
+		p_probe->transaction.p_context = p_probe;
+		p_probe->transaction.bus       = bus;
+	}
+	
+	for (uint8_t bus = 0; bus < TWI_BUS_COUNT; bus++)
+	{
+		dev_selftest_chain_t * p_chain = &m_chains[bus];
+		
+		p_chain->transaction.xfer      = (nrfx_twim_xfer_desc_t)NRFX_TWIM_XFER_DESC_RX(0, &p_chain->data, sizeof(p_chain->data));
+		p_chain->transaction.callback  = dev_selftest_callback;
+		p_chain->transaction.p_context = p_chain;
+		p_chain->transaction.bus       = bus;
+	}
+	
+	err_code = app_timer_create(&m_retry_timer, APP_TIMER_MODE_SINGLE_SHOT, dev_retry_timeout_handler);
+	VERIFY_SUCCESS(err_code);
+	
+	err_code = app_timer_create(&m_selftest_timer, APP_TIMER_MODE_SINGLE_SHOT, dev_selftest_timeout_handler);
+	VERIFY_SUCCESS(err_code);
+	
+	err_code = fds_register(dev_fds_evt_handler);
+	VERIFY_SUCCESS(err_code);
+	
+	err_code = fds_init();
+	VERIFY_SUCCESS(err_code);
+	
+	while (!m_fds_initialized)
+	{
+		nrf_pwr_mgmt_run();
+	}
+	
+	memset(&token, 0, sizeof(token));
+	if (fds_record_find(DEV_FILE_ID, DEV_RECORD_KEY, &m_record_desc, &token) != NRF_SUCCESS)
+		return NRF_SUCCESS;
+	
+	m_record_found = true;
+	
+	err_code = fds_record_open(&m_record_desc, &flash_record);
+	VERIFY_SUCCESS(err_code);
+	
+	// Record of different size is left from other firmware version
+	if (flash_record.p_header->length_words == sizeof(m_registry) / sizeof(uint32_t))
+	{
+		memcpy(&m_registry, flash_record.p_data, sizeof(m_registry));
+		m_registry_valid = (m_registry.count <= DEV_REGISTRY_SIZE);
+	}
+	
+	return fds_record_close(&m_record_desc);
+}
+
+ret_code_t dev_discovery_start(bool use_cache)
+{
+	// Registry mustn't change while it is being written or tested
+	if (m_busy || m_flash_busy || m_selftest_busy)
+		return NRF_ERROR_BUSY;
+	
+	if (use_cache && m_registry_valid)
+		return NRF_SUCCESS;
+	
+	for (uint8_t bus = 0; bus < TWI_BUS_COUNT; bus++)
+	{
+		memset(m_probes[bus].found, 0, sizeof(m_probes[bus].found));
+		m_probes[bus].absent = false;
+	}
+	
+	m_pass = 0;
+	m_busy = true;
+	
+	dev_pass_start();
+	
+	return NRF_SUCCESS;
+}
+
+bool dev_discovery_is_busy(void)
+{
+	return m_busy;
+}
+
+dev_registry_t const * dev_registry_get(void)
+{
+	return &m_registry;
+}
+
+uint8_t dev_registry_addresses_get(dev_type_t type, uint8_t * p_buses, uint8_t * p_addresses, uint8_t max_count)
+{
+	uint8_t count = 0;
+	
+	if (!m_registry_valid)
+		return 0;
+	
+	for (uint8_t i = 0; i < m_registry.count && count < max_count; i++)
+	{
+		if (m_registry.device[i].type != type)
+			continue;
+		
+		p_buses[count]     = m_registry.device[i].bus;
+		p_addresses[count] = m_registry.device[i].address;
+		count++;
+	}
+	
+	return count;
+}
+
+/**@brief Starts CPU cycle counter, which times self-test reads. Application
+ *        timer tick is about as long as the read itself. */
+static void dev_cycle_counter_start(void)
+{
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL        |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+/**@brief Gets the fastest clock supported by the device. */
+static twi_speed_t dev_max_speed(dev_entry_t const * p_device)
+{
+	return (p_device->type < ARRAY_SIZE(m_type_max_speed)) ? (twi_speed_t)m_type_max_speed[p_device->type] 
+														   : TWI_SPEED_100K;
+}
+
+/**@brief Copies clocks selected by self-test to the registry and saves it if changed. */
+static void dev_speeds_save(void)
+{
+	bool changed = false;
+	
+	m_speeds_pending = false;
+	
+	for (uint8_t i = 0; i < m_registry.count; i++)
+	{
+		if (m_registry.device[i].speed == m_timing[i].speed)
+			continue;
+		
+		m_registry.device[i].speed = m_timing[i].speed;
+		changed = true;
+	}
+	
+	if (changed)
+		(void)dev_registry_save();
+}
+
+/**@brief Sets the clocks selected and stores them, the registry being 
+ *        written meanwhile is stored after the write. */
+static void dev_selftest_finish(void)
+{
+	bool flash_busy;
+	
+	for (uint8_t i = 0; i < m_registry.count; i++)
+		(void)twi_device_speed_set(m_registry.device[i].bus, m_registry.device[i].address, (twi_speed_t)m_timing[i].speed);
+	
+	CRITICAL_REGION_ENTER();
+	flash_busy       = m_flash_busy;
+	m_speeds_pending = flash_busy;
+	CRITICAL_REGION_EXIT();
+	
+	if (!flash_busy)
+		dev_speeds_save();
+	
+	m_selftest_busy = false;
+}
+
+/**@brief Starts the self-test pass after delay, or finishes the test if the timer fails. */
+static void dev_selftest_wait(uint32_t delay_ms)
+{
+	uint32_t ticks = MAX(APP_TIMER_TICKS(delay_ms), APP_TIMER_MIN_TIMEOUT_TICKS);
+	
+	if (app_timer_start(m_selftest_timer, ticks, NULL) != NRF_SUCCESS)
+		dev_selftest_finish();
+}
+
+/**@brief Starts the next read of every device tested at the clock. */
+static void dev_selftest_xfer_start(void)
+{
+	m_selftest_poll     = 0;
+	m_selftest_delay_ms = LTC2497_POLL_MIN_MS;
+	
+	for (uint8_t i = 0; i < m_registry.count; i++)
+		m_selftest_pending[i] = (m_selftest_speed <= dev_max_speed(&m_registry.device[i]));
+	
+	// Read ends with stop condition, which starts the next conversion.
+	// It is waited out once for all devices, so the reads are rarely
+	// polled and self-test time doesn't grow with the device count.
+	dev_selftest_wait(m_selftest_busy_ms);
+}
+
+/**@brief Sets the clock being tested on the devices which support it. */
+static void dev_selftest_speed_start(void)
+{
+	memset(m_selftest_cycles, 0, sizeof(m_selftest_cycles));
+	
+	for (uint8_t i = 0; i < m_registry.count; i++)
+	{
+		if (m_selftest_speed <= dev_max_speed(&m_registry.device[i]))
+			(void)twi_device_speed_set(m_registry.device[i].bus, m_registry.device[i].address, (twi_speed_t)m_selftest_speed);
+	}
+	
+	m_selftest_xfer = 0;
+	dev_selftest_xfer_start();
+}
+
+/**@brief Takes average read time of the clock tested, the clock is selected if all reads completed. */
+static void dev_selftest_speed_end(void)
+{
+	uint8_t speed = m_selftest_speed;
+	
+	for (uint8_t i = 0; i < m_registry.count; i++)
+	{
+		dev_timing_t * p_timing = &m_timing[i];
+		uint8_t reads = DEV_SELFTEST_XFERS - p_timing->errors[speed];
+		
+		if (speed > dev_max_speed(&m_registry.device[i]) || reads == 0)
+			continue;
+		
+		p_timing->xfer_us[speed] = (uint16_t)(m_selftest_cycles[i] / reads / (SystemCoreClock / 1000000));
+		
+		if (p_timing->errors[speed] == 0)
+			p_timing->speed = speed;
+	}
+}
+
+/**@brief Called when read chain of the bus ends. After the last bus polls
+ *        the devices which haven't answered, or goes to the next read. */
+static void dev_selftest_pass_end(void)
+{
+	bool poll = false;
+	uint8_t chains_reading;
+	
+	CRITICAL_REGION_ENTER();
+	chains_reading = --m_chains_reading;
+	CRITICAL_REGION_EXIT();
+	
+	if (chains_reading > 0)
+		return;
+	
+	for (uint8_t i = 0; i < m_registry.count; i++)
+	{
+		if (!m_selftest_pending[i])
+			continue;
+		
+		if (m_selftest_poll < DEV_SELFTEST_POLLS)
+		{
+			poll = true;
+			continue;
+		}
+		
+		// Address NACK after all polls fails the read
+		m_selftest_pending[i] = false;
+		m_timing[i].errors[m_selftest_speed]++;
+	}
+	
+	if (poll)
+	{
+		uint32_t delay_ms = m_selftest_delay_ms;
+		
+		m_selftest_poll++;
+		m_selftest_delay_ms = MIN(delay_ms * 2, LTC2497_POLL_MAX_MS);
+		dev_selftest_wait(delay_ms);
+		return;
+	}
+	
+	if (++m_selftest_xfer < DEV_SELFTEST_XFERS)
+	{
+		dev_selftest_xfer_start();
+		return;
+	}
+	
+	dev_selftest_speed_end();
+	
+	if (++m_selftest_speed < TWI_SPEED_COUNT)
+	{
+		dev_selftest_speed_start();
+		return;
+	}
+	
+	dev_selftest_finish();
+}
+
+/**@brief Reads the next device of the bus waiting for it's read or ends the pass. */
+static void dev_selftest_read_next(dev_selftest_chain_t * p_chain)
+{
+	uint8_t i = (p_chain->device == DEV_DEVICE_NONE) ? 0 : p_chain->device + 1;
+	
+	for (; i < m_registry.count; i++)
+	{
+		if (m_registry.device[i].bus != p_chain->transaction.bus || !m_selftest_pending[i])
+			continue;
+		
+		p_chain->device                   = i;
+		p_chain->transaction.xfer.address = m_registry.device[i].address;
+		p_chain->start                    = DWT->CYCCNT;
+		
+		if (twi_schedule(&p_chain->transaction) == NRF_SUCCESS)
+			return;
+		
+		// Read which can't be started fails
+		m_selftest_pending[i] = false;
+		m_timing[i].errors[m_selftest_speed]++;
+	}
+	
+	dev_selftest_pass_end();
+}
+
+/**@brief Starts read chains of all buses. */
+static void dev_selftest_pass_start(void)
+{
+	m_chains_reading = TWI_BUS_COUNT;
+	
+	for (uint8_t bus = 0; bus < TWI_BUS_COUNT; bus++)
+	{
+		m_chains[bus].device = DEV_DEVICE_NONE;
+		dev_selftest_read_next(&m_chains[bus]);
+	}
+}
+
+static void dev_selftest_callback(ret_code_t result, void * p_context)
+{
+	dev_selftest_chain_t * p_chain = (dev_selftest_chain_t *)p_context;
+	uint8_t i = p_chain->device;
+	
+	// Device still converting doesn't acknowledge it's address, it is polled
+	// after the pass. Only completed read is timed.
+	if (result == NRF_SUCCESS)
+	{
+		m_selftest_cycles[i]  += DWT->CYCCNT - p_chain->start;
+		m_selftest_pending[i]  = false;
+	}
+	else if (result != NRF_ERROR_DRV_TWI_ERR_ANACK)
+	{
+		m_selftest_pending[i] = false;
+		m_timing[i].errors[m_selftest_speed]++;
+	}
+	
+	dev_selftest_read_next(p_chain);
+}
+
+static void dev_selftest_timeout_handler(void * p_context)
+{
+	UNUSED_PARAMETER(p_context);
+	
+	dev_selftest_pass_start();
+}
+
+ret_code_t dev_selftest_start(bool use_cache)
+{
+	bool tested = true;
+	
+	if (m_selftest_busy)
+		return NRF_ERROR_BUSY;
+	
+	if (m_busy || !m_registry_valid)
+		return NRF_ERROR_INVALID_STATE;
+	
+	for (uint8_t i = 0; i < m_registry.count; i++)
+	{
+		uint8_t speed = m_registry.device[i].speed;
+		
+		memset(&m_timing[i], 0, sizeof(dev_timing_t));
+		
+		// Clock isn't known until the device is tested after discovery
+		if (speed == TWI_SPEED_DEFAULT || speed > dev_max_speed(&m_registry.device[i]))
+			tested = false;
+		
+		m_timing[i].speed = speed;
+	}
+	
+	if ((use_cache && tested) || m_registry.count == 0)
+	{
+		for (uint8_t i = 0; i < m_registry.count; i++)
+			(void)twi_device_speed_set(m_registry.device[i].bus, m_registry.device[i].address, (twi_speed_t)m_timing[i].speed);
+		
+		return NRF_SUCCESS;
+	}
+	
+	m_selftest_busy_ms = 0;
+	
+	for (uint8_t i = 0; i < m_registry.count; i++)
+	{
+		uint8_t type = m_registry.device[i].type;
+		
+		// Slowest clock is kept if none works
+		m_timing[i].speed = TWI_SPEED_100K;
+		
+		if (type < ARRAY_SIZE(m_type_busy_ms))
+			m_selftest_busy_ms = MAX(m_selftest_busy_ms, m_type_busy_ms[type]);
+	}
+	
+	dev_cycle_counter_start();
+	
+	m_selftest_busy  = true;
+	m_selftest_speed = TWI_SPEED_100K;
+	dev_selftest_speed_start();
+	
+	return NRF_SUCCESS;
+}
+
+bool dev_selftest_is_busy(void)
+{
+	return m_selftest_busy;
+}
+
+dev_timing_t const * dev_timing_get(uint8_t index)
+{
+	if (index >= m_registry.count)
+		return NULL;
+	
+	return &m_timing[index];
+}
+
+ret_code_t dev_registry_invalidate(void)
+{
+	m_registry_valid = false;
+	
+	// Record being written is deleted after the write
+	if (!m_record_found && !m_flash_busy)
+		return NRF_SUCCESS;
+	
+	m_record_found = false;
+	
+	return fds_record_delete(&m_record_desc);
+}
@@ -0,0 +1,260 @@
+/**
+ * @file
+ * frame_codec.c
+ *
+ * @brief Delta frame codec
+ *
+ * This file contains implementations of functions declared in
+ * frame_codec.h. Values are saturated before they are taken as reference,
+ * so the decoder, which only sees saturated values, follows the encoder
+ * exactly. Difference of two 24 bit values needs 25 bits, so its varint
+ * never takes more than FRAME_CODEC_VALUE_MAX_LEN bytes.
+ *
+ */
+
+#include <string.h>
+#include "frame_codec.h"
+
+#define FRAME_CODEC_VARINT_MAX_LEN		5		/**< Varint of any 32 bit value */
+
+
+/**@brief Writes 16 bit value, little endian. */
+static void frame_codec_u16_put(uint16_t value, uint8_t * p_data)
+{
+	p_data[0] = (uint8_t)value;
+	p_data[1] = (uint8_t)(value >> 8);
+}
+
+/**@brief Writes 24 bit value, little endian. */
+static void frame_codec_u24_put(uint32_t value, uint8_t * p_data)
+{
+	p_data[0] = (uint8_t)value;
+	p_data[1] = (uint8_t)(value >> 8);
+	p_data[2] = (uint8_t)(value >> 16);
+}
+
+static uint16_t frame_codec_u16_get(uint8_t const * p_data)
+{
+	return (uint16_t)(p_data[0] | (p_data[1] << 8));
+}
+
+static uint32_t frame_codec_u24_get(uint8_t const * p_data)
+{
+	return (uint32_t)p_data[0] | ((uint32_t)p_data[1] << 8) | ((uint32_t)p_data[2] << 16);
+}
+
+uint8_t frame_codec_varint_put(int32_t value, uint8_t * p_data)
+{
+	// Zigzag maps small values of either sign to small codes: 0, -1, 1, -2...
+	uint32_t code   = ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+	uint8_t  length = 0;
+	
+	while (code >= 0x80)
+	{
+		p_data[length++] = (uint8_t)(code | 0x80);
+		code >>= 7;
+	}
+	p_data[length++] = (uint8_t)code;
+	
+	return length;
+}
+
+uint8_t frame_codec_varint_get(uint8_t const * p_data, uint16_t length, int32_t * p_value)
+{
+	uint32_t code = 0;
+	
+	for (uint8_t i = 0; i < length && i < FRAME_CODEC_VARINT_MAX_LEN; i++)
+	{
+		code |= (uint32_t)(p_data[i] & 0x7F) << (7 * i);
+		
+		if (!(p_data[i] & 0x80))
+		{
+			*p_value = (int32_t)(code >> 1) ^ -(int32_t)(code & 1);
+			return i + 1;
+		}
+	}
+	
+	return 0;
+}
+
+int32_t frame_codec_limit(int32_t value)
+{
+	if (value > FRAME_CODEC_VALUE_MAX)
+		return FRAME_CODEC_VALUE_MAX;
+	
+	if (value < FRAME_CODEC_VALUE_MIN)
+		return FRAME_CODEC_VALUE_MIN;
+	
+	return value;
+}
+
+void frame_encoder_init(frame_encoder_t * p_enc, uint8_t channel_count, uint8_t keyframe_interval)
+{
+	memset(p_enc, 0, sizeof(*p_enc));
+	
+	p_enc->channel_count     = (channel_count < FRAME_CODEC_CHANNEL_MAX) ? channel_count : FRAME_CODEC_CHANNEL_MAX;
+	p_enc->keyframe_interval = keyframe_interval;
+	p_enc->keyframe_request  = true;
+}
+
+void frame_encoder_keyframe_request(frame_encoder_t * p_enc)
+{
+	p_enc->keyframe_request = true;
+}
+
+bool frame_encoder_keyframe_due(frame_encoder_t const * p_enc)
+{
+	return p_enc->keyframe_request ||
+		   (p_enc->keyframe_interval != 0 && p_enc->frames_since_keyframe >= p_enc->keyframe_interval);
+}
+
+uint16_t frame_encoder_part_encode(frame_encoder_t * p_enc, frame_codec_frame_t const * p_frame, bool keyframe,
+								   uint8_t part, uint8_t * p_channel, uint8_t * p_data, uint16_t max_length)
+{
+	uint8_t  mask_length = FRAME_CODEC_MASK_LEN(p_enc->channel_count);
+	uint16_t length      = FRAME_CODEC_HEADER_LEN + mask_length;
+	uint8_t  channel     = *p_channel;
+	uint8_t  varint[FRAME_CODEC_VARINT_MAX_LEN];
+	
+	if (part == 0)
+		p_enc->pending_bytes = 0;
+	
+	if (part > FRAME_CODEC_PART_MASK || max_length < length + FRAME_CODEC_VALUE_MAX_LEN)
+		return 0;
+	
+	frame_codec_u16_put(p_frame->sequence, &p_data[0]);
+	frame_codec_u24_put(p_frame->timestamp, &p_data[2]);
+	p_data[FRAME_CODEC_FLAGS_OFFSET] = (keyframe ? FRAME_CODEC_FLAG_KEYFRAME : 0) | part;
+	frame_codec_u16_put(p_enc->reference_sequence, &p_data[6]);
+	memset(&p_data[FRAME_CODEC_HEADER_LEN], 0, mask_length);
+	
+	for (; channel < p_enc->channel_count; channel++)
+	{
+		bool read = (p_frame->channel_mask & ((uint64_t)1 << channel)) != 0;
+		
+		// Keyframe carries every channel, the ones not read keep their last value
+		if (!read && !keyframe)
+			continue;
+		
+		int32_t value  = read ? frame_codec_limit(p_frame->p_values[channel]) : p_enc->reference[channel];
+		uint8_t n      = frame_codec_varint_put(keyframe ? value : value - p_enc->reference[channel], varint);
+		
+		if (length + n > max_length)
+			break;
+		
+		p_data[FRAME_CODEC_HEADER_LEN + channel / 8] |= (uint8_t)(1 << (channel % 8));
+		memcpy(&p_data[length], varint, n);
+		length += n;
+		p_enc->pending_bytes += n;
+	}
+	
+	*p_channel = channel;
+	
+	if (length == FRAME_CODEC_HEADER_LEN + mask_length)
+		return 0;
+	
+	return length;
+}
+
+void frame_encoder_last_mark(uint8_t * p_data)
+{
+	p_data[FRAME_CODEC_FLAGS_OFFSET] |= FRAME_CODEC_FLAG_LAST;
+}
+
+void frame_encoder_commit(frame_encoder_t * p_enc, frame_codec_frame_t const * p_frame, bool keyframe)
+{
+	for (uint8_t channel = 0; channel < p_enc->channel_count; channel++)
+	{
+		if (!(p_frame->channel_mask & ((uint64_t)1 << channel)))
+			continue;
+		
+		p_enc->reference[channel] = frame_codec_limit(p_frame->p_values[channel]);
+		p_enc->stats.values++;
+	}
+	
+	p_enc->reference_sequence = p_frame->sequence;
+	p_enc->stats.frames++;
+	p_enc->stats.value_bytes += p_enc->pending_bytes;
+	
+	if (keyframe)
+	{
+		p_enc->keyframe_request      = false;
+		p_enc->frames_since_keyframe = 0;
+		p_enc->stats.keyframes++;
+	}
+	else if (p_enc->frames_since_keyframe < UINT8_MAX)
+	{
+		p_enc->frames_since_keyframe++;
+	}
+}
+
+void frame_decoder_init(frame_decoder_t * p_dec, uint8_t channel_count)
+{
+	memset(p_dec, 0, sizeof(*p_dec));
+	
+	p_dec->channel_count = (channel_count < FRAME_CODEC_CHANNEL_MAX) ? channel_count : FRAME_CODEC_CHANNEL_MAX;
+}
+
+frame_decode_result_t frame_decoder_part_decode(frame_decoder_t * p_dec, uint8_t const * p_data, uint16_t length,
+												frame_codec_part_t * p_part)
+{
+	uint8_t  mask_length = FRAME_CODEC_MASK_LEN(p_dec->channel_count);
+	uint16_t offset      = FRAME_CODEC_HEADER_LEN + mask_length;
+	
+	if (length < offset)
+		return FRAME_DECODE_INVALID;
+	
+	uint8_t  flags     = p_data[FRAME_CODEC_FLAGS_OFFSET];
+	uint8_t  part      = flags & FRAME_CODEC_PART_MASK;
+	uint16_t reference = frame_codec_u16_get(&p_data[6]);
+	
+	p_part->sequence     = frame_codec_u16_get(&p_data[0]);
+	p_part->timestamp    = frame_codec_u24_get(&p_data[2]);
+	p_part->keyframe     = (flags & FRAME_CODEC_FLAG_KEYFRAME) != 0;
+	p_part->last         = (flags & FRAME_CODEC_FLAG_LAST) != 0;
+	p_part->channel_mask = 0;
+	
+	// Delta frame follows only the whole frame it refers to, missing part
+	// puts the decoder out of sync until the next keyframe
+	if (part == 0)
+	{
+		bool follows = p_dec->synced && p_dec->complete && reference == p_dec->sequence;
+		
+		p_dec->synced = p_part->keyframe || follows;
+	}
+	else if (p_part->sequence != p_dec->sequence || part != p_dec->next_part || p_dec->complete)
+	{
+		p_dec->synced = false;
+	}
+	
+	p_dec->sequence  = p_part->sequence;
+	p_dec->next_part = part + 1;
+	p_dec->complete  = p_part->last;
+	
+	if (!p_dec->synced)
+	{
+		p_dec->skipped++;
+		return FRAME_DECODE_SKIPPED;
+	}
+	
+	for (uint8_t channel = 0; channel < p_dec->channel_count; channel++)
+	{
+		if (!(p_data[FRAME_CODEC_HEADER_LEN + channel / 8] & (1 << (channel % 8))))
+			continue;
+		
+		int32_t value;
+		uint8_t n = frame_codec_varint_get(&p_data[offset], length - offset, &value);
+		
+		if (n == 0)
+		{
+			p_dec->synced = false;
+			return FRAME_DECODE_INVALID;
+		}
+		
+		p_dec->value[channel]  = p_part->keyframe ? value : p_dec->value[channel] + value;
+		p_part->channel_mask  |= (uint64_t)1 << channel;
+		offset += n;
+	}
+	
+	return FRAME_DECODE_OK;
+}
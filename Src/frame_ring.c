@@ -0,0 +1,111 @@
+/**
+ * @file
+ * frame_ring.c
+ *
+ * @brief Lock-free single producer, single consumer ring of frames
+ *
+ * This file contains implementations of functions declared in
+ * frame_ring.h. Producer runs in interrupt and is never preempted by
+ * the consumer, so only the consumer has to check that the tail wasn't
+ * moved under it. Memory barrier keeps the frame copy ahead of the head
+ * update which publishes it.
+ *
+ */
+
+#include <string.h>
+#include "frame_ring.h"
+
+
+/**@brief Returns address of the slot of the free running index. */
+static uint8_t * frame_ring_slot(frame_ring_t const * p_ring, uint32_t index)
+{
+	return p_ring->p_buffer + (size_t)(index & p_ring->mask) * p_ring->element_size;
+}
+
+void frame_ring_init(frame_ring_t * p_ring, frame_ring_policy_t policy, uint8_t decimation)
+{
+	p_ring->head             = 0;
+	p_ring->tail             = 0;
+	p_ring->policy           = policy;
+	p_ring->decimation       = (decimation > 0) ? decimation : 1;
+	p_ring->decimation_count = 0;
+	
+	memset(&p_ring->stats, 0, sizeof(p_ring->stats));
+}
+
+bool frame_ring_push(frame_ring_t * p_ring, void const * p_frame)
+{
+	uint32_t head = p_ring->head;
+	uint32_t tail = p_ring->tail;
+	uint32_t size = (uint32_t)p_ring->mask + 1;
+	uint32_t fill = head - tail;
+	
+	if (p_ring->policy == FRAME_RING_DECIMATE && fill >= size / 2)
+	{
+		if (p_ring->decimation_count++ % p_ring->decimation != 0)
+		{
+			p_ring->stats.decimated++;
+			return false;
+		}
+	}
+	else
+	{
+		p_ring->decimation_count = 0;
+	}
+	
+	if (fill >= size)
+	{
+		p_ring->stats.overruns++;
+		
+		if (p_ring->policy != FRAME_RING_DROP_OLDEST)
+			return false;
+		
+		// Consumer can't run until the producer returns, so exchange only
+		// fails if the slot was freed anyway
+		(void)nrf_atomic_u32_cmp_exch(&p_ring->tail, &tail, tail + 1);
+		fill--;
+	}
+	
+	memcpy(frame_ring_slot(p_ring, head), p_frame, p_ring->element_size);
+	
+	__DMB();
+	p_ring->head = head + 1;
+	
+	p_ring->stats.pushed++;
+	if (fill + 1 > p_ring->stats.peak)
+		p_ring->stats.peak = (uint16_t)(fill + 1);
+	
+	return true;
+}
+
+bool frame_ring_pop(frame_ring_t * p_ring, void * p_frame)
+{
+	for (;;)
+	{
+		uint32_t tail = p_ring->tail;
+		
+		if (tail == p_ring->head)
+			return false;
+		
+		__DMB();
+		memcpy(p_frame, frame_ring_slot(p_ring, tail), p_ring->element_size);
+		
+		// Producer dropping the oldest frame moves the tail and overwrites
+		// the slot, copy is then taken again from the new tail
+		if (nrf_atomic_u32_cmp_exch(&p_ring->tail, &tail, tail + 1))
+		{
+			p_ring->stats.popped++;
+			return true;
+		}
+	}
+}
+
+uint16_t frame_ring_count(frame_ring_t const * p_ring)
+{
+	return (uint16_t)(p_ring->head - p_ring->tail);
+}
+
+void frame_ring_stats_get(frame_ring_t const * p_ring, frame_ring_stats_t * p_stats)
+{
+	*p_stats = p_ring->stats;
+}
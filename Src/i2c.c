@@ -6,69 +6,513 @@
  *
  * This file contains implementations of functions, declared in i2c.h
  * 
+ * Error policy: transaction failed by bus error is restarted up to it's
+ * retry budget. Address NACK isn't bus error, it is passed to the caller
+ * at once. After TWI_BUS_ERROR_LIMIT bus errors in a row, or when
+ * transaction doesn't finish for a whole watchdog period, bus is cleared by
+ * SCL toggling and TWIM is initialized again. Transaction cut off by
+ * the recovery fails with NRF_ERROR_TIMEOUT, so no caller waits forever.
+ * 
  * @author Radchenko Evgeny
  * captain.97r@gmail.com
  */
 
 #include "i2c.h"
+#include "app_util_platform.h"
+#include "app_timer.h"
+#include "nrf_gpio.h"
 #include "nrf_delay.h"
 
-void twi_init(void)
-{
-#if USE_LEGACY_DRIVERS
-	uint32_t err_code;
-	    
-	const nrf_drv_twi_config_t twi_mpu_config = {
-		.scl = 26,
-		.sda = 25,
-		.frequency = NRF_DRV_TWI_FREQ_400K,
-		.interrupt_priority = APP_IRQ_PRIORITY_HIGHEST,
-		.clear_bus_init = false
-	};
-	    
-	err_code = nrf_drv_twi_init(&m_twi_instance, &twi_mpu_config, NULL, NULL);
-	nrf_drv_twi_enable(&m_twi_instance);
-#else
-	//	nrfx_err_t err_code;
-//	
-//	const nrfx_twi_config_t twi_config = { 
-//		.scl = 26,
-//		.sda = 25,
-//		.frequency = TWI_FREQUENCY_FREQUENCY_K400,
-//		.interrupt_priority = NRFX_TWI_DEFAULT_CONFIG_IRQ_PRIORITY,
-//		.hold_bus_uninit = NRFX_TWI_DEFAULT_CONFIG_HOLD_BUS_UNINIT
-//	};
-//	
-//	err_code = nrfx_twi_init(&m_twi_instance, &twi_config, NULL, NULL);
-//	nrfx_twi_enable(&m_twi_instance);
-//	
-//	uint8_t data[1] = { 0b10101010 };
-//	err_code = nrfx_twi_tx(&m_twi_instance, 0b0010100, data, 1, false);
-#endif //USE_LEGACY_DRIVERS
-}
-
-uint8_t twi_scan(void)
+#define TWI_CLEAR_CLOCKS			9		/**< Clocks to finish the byte slave may be sending */
+#define TWI_CLEAR_HALF_PERIOD_US	5		/**< 100 kHz clock */
+
+/**@brief State of single bus. */
+typedef struct
 {
-	ret_code_t err_code;
-	uint8_t sample_data;
-	bool detected_device = false;
-	uint8_t device_num = 0;
-	uint8_t address_array[5] = { 0 };
+	nrfx_twim_t						twim;
+	twi_transaction_t const *		queue[TWI_QUEUE_SIZE];
+	uint8_t							queue_head;
+	uint8_t							queue_count;
+	twi_transaction_t const *		p_current;		/**< Transaction being transferred */
+	volatile bool					triggered;		/**< Bus is taken by hardware triggered transaction */
+	bool							initialized;
+	uint8_t							attempts;		/**< Retries of the current transaction */
+	uint8_t							errors;			/**< Bus errors in a row */
+	bool							recover_pending;
+	uint32_t						xfer_count;		/**< Transfers finished */
+	uint32_t						watchdog_count;	/**< Transfers finished at the last watchdog check */
+	uint8_t							stall_ticks;	/**< Watchdog checks in a row without progress of a transfer */
+	nrfx_twim_config_t				config;
+	twi_speed_t						default_speed;
+	twi_speed_t						speed;			/**< Clock set in TWIM */
+	uint8_t							device_speeds[TWI_ADDRESS_COUNT];	/**< twi_speed_t of each address */
+	twi_stats_t						stats;
+} twi_bus_t;
+
+static twi_bus_t					m_buses[TWI_BUS_COUNT] = {
+	{ .twim = NRFX_TWIM_INSTANCE(0) },
+	{ .twim = NRFX_TWIM_INSTANCE(1) }
+};
+
+static const nrf_twim_frequency_t	m_frequencies[TWI_SPEED_COUNT] = {
+	[TWI_SPEED_100K] = NRF_TWIM_FREQ_100K,
+	[TWI_SPEED_250K] = NRF_TWIM_FREQ_250K,
+	[TWI_SPEED_400K] = NRF_TWIM_FREQ_400K
+};
+
+APP_TIMER_DEF(m_watchdog_timer_id);
+static bool							m_watchdog_started;
+
+
+static ret_code_t twi_result_get(nrfx_err_t err_code)
+{
+	switch (err_code)
+	{
+	case NRFX_SUCCESS:
+		return NRF_SUCCESS;
+		
+	case NRFX_ERROR_DRV_TWI_ERR_ANACK:
+		return NRF_ERROR_DRV_TWI_ERR_ANACK;
+		
+	case NRFX_ERROR_DRV_TWI_ERR_DNACK:
+		return NRF_ERROR_DRV_TWI_ERR_DNACK;
+		
+	case NRFX_ERROR_BUSY:
+		return NRF_ERROR_BUSY;
+		
+	case NRFX_ERROR_INVALID_ADDR:
+		return NRF_ERROR_INVALID_ADDR;
+		
+	case NRFX_ERROR_INVALID_STATE:
+		return NRF_ERROR_INVALID_STATE;
+		
+	default:
+		return NRF_ERROR_INTERNAL;
+	}
+}
+
+/**@brief Sets clock of the device before the transaction. TWIM must be idle. */
+static void twi_speed_apply(twi_bus_t * p_bus, uint8_t address)
+{
+	twi_speed_t speed = (twi_speed_t)p_bus->device_speeds[address & (TWI_ADDRESS_COUNT - 1)];
+	
+	if (speed == TWI_SPEED_DEFAULT)
+		speed = p_bus->default_speed;
+	
+	if (speed != p_bus->speed)
+	{
+		nrf_twim_frequency_set(p_bus->twim.p_twim, m_frequencies[speed]);
+		p_bus->speed = speed;
+	}
+}
+
+static ret_code_t twi_xfer_start(twi_bus_t * p_bus, twi_transaction_t const * p_transaction)
+{
+	twi_speed_apply(p_bus, p_transaction->xfer.address);
 	
-	for (uint8_t address = 0x01; address <= TWI_ADDRESSES; address++)
+	return twi_result_get(nrfx_twim_xfer(&p_bus->twim, &p_transaction->xfer, p_transaction->flags));
+}
+
+/**@brief Starts the first queued transaction which can be started. 
+ *        Transactions which fail to start are completed with error. 
+ *        Called when the bus becomes free. */
+static void twi_queue_process(twi_bus_t * p_bus)
+{
+	for (;;)
 	{
-		err_code = nrf_drv_twi_rx(&m_twi_instance, address, &sample_data, sizeof(sample_data));
+		twi_transaction_t const * p_transaction = NULL;
+		
+		CRITICAL_REGION_ENTER();
+		if (p_bus->queue_count > 0)
+		{
+			p_transaction     = p_bus->queue[p_bus->queue_head];
+			p_bus->queue_head = (p_bus->queue_head + 1) % TWI_QUEUE_SIZE;
+			p_bus->queue_count--;
+		}
+		p_bus->p_current = p_transaction;
+		CRITICAL_REGION_EXIT();
+		
+		if (p_transaction == NULL)
+			return;
+		
+		p_bus->attempts = 0;
+		
+		ret_code_t err_code = p_bus->initialized ? twi_xfer_start(p_bus, p_transaction) : NRF_ERROR_INVALID_STATE;
 		if (err_code == NRF_SUCCESS)
+			return;
+		
+		p_bus->p_current = NULL;
+		if (p_transaction->callback != NULL)
+			p_transaction->callback(err_code, p_transaction->p_context);
+	}
+}
+
+/**@brief Completes the current transaction. Failed one is restarted while 
+ *        it has retries left. */
+static void twi_xfer_finish(twi_bus_t * p_bus, twi_transaction_t const * p_transaction, ret_code_t result)
+{
+	if (result == NRF_SUCCESS || result == NRF_ERROR_DRV_TWI_ERR_ANACK)
+	{
+		p_bus->errors = 0;
+	}
+	else
+	{
+		p_bus->stats.errors++;
+		if (++p_bus->errors >= TWI_BUS_ERROR_LIMIT)
+			p_bus->recover_pending = true;
+		
+		if (p_transaction != NULL && !p_bus->triggered && !p_bus->recover_pending && 
+			p_bus->attempts < p_transaction->retries)
+		{
+			p_bus->attempts++;
+			p_bus->stats.retries++;
+			if (twi_xfer_start(p_bus, p_transaction) == NRF_SUCCESS)
+				return;
+		}
+	}
+	
+	// Next transaction is started before the callback, so the bus
+	// doesn't wait for the callback processing
+	if (!p_bus->triggered)
+		twi_queue_process(p_bus);
+	
+	if (p_transaction != NULL && p_transaction->callback != NULL)
+	{
+		p_transaction->callback(result, p_transaction->p_context);
+	}
+}
+
+static void twi_evt_handler(nrfx_twim_evt_t const * p_event, void * p_context)
+{
+	twi_bus_t * p_bus = (twi_bus_t *)p_context;
+	ret_code_t result;
+	
+	switch (p_event->type)
+	{
+	case NRFX_TWIM_EVT_DONE:
+		result = NRF_SUCCESS;
+		break;
+		
+	case NRFX_TWIM_EVT_ADDRESS_NACK:
+		result = NRF_ERROR_DRV_TWI_ERR_ANACK;
+		break;
+		
+	default:
+		result = NRF_ERROR_DRV_TWI_ERR_DNACK;
+		break;
+	}
+	
+	p_bus->xfer_count++;
+	twi_xfer_finish(p_bus, p_bus->p_current, result);
+}
+
+/**@brief Releases the bus held by slave: clocks out the byte it may be 
+ *        sending, then generates stop condition. */
+static void twi_bus_clear(uint32_t scl_pin, uint32_t sda_pin)
+{
+	nrf_gpio_pin_set(scl_pin);
+	nrf_gpio_pin_set(sda_pin);
+	nrf_gpio_cfg(scl_pin, NRF_GPIO_PIN_DIR_OUTPUT, NRF_GPIO_PIN_INPUT_CONNECT, 
+				 NRF_GPIO_PIN_PULLUP, NRF_GPIO_PIN_S0D1, NRF_GPIO_PIN_NOSENSE);
+	nrf_gpio_cfg(sda_pin, NRF_GPIO_PIN_DIR_OUTPUT, NRF_GPIO_PIN_INPUT_CONNECT, 
+				 NRF_GPIO_PIN_PULLUP, NRF_GPIO_PIN_S0D1, NRF_GPIO_PIN_NOSENSE);
+	nrf_delay_us(TWI_CLEAR_HALF_PERIOD_US);
+	
+	for (uint8_t i = 0; i < TWI_CLEAR_CLOCKS && !nrf_gpio_pin_read(sda_pin); i++)
+	{
+		nrf_gpio_pin_clear(scl_pin);
+		nrf_delay_us(TWI_CLEAR_HALF_PERIOD_US);
+		nrf_gpio_pin_set(scl_pin);
+		nrf_delay_us(TWI_CLEAR_HALF_PERIOD_US);
+	}
+	
+	// Stop condition, SDA rises while SCL is high
+	nrf_gpio_pin_clear(scl_pin);
+	nrf_gpio_pin_clear(sda_pin);
+	nrf_delay_us(TWI_CLEAR_HALF_PERIOD_US);
+	nrf_gpio_pin_set(scl_pin);
+	nrf_delay_us(TWI_CLEAR_HALF_PERIOD_US);
+	nrf_gpio_pin_set(sda_pin);
+	nrf_delay_us(TWI_CLEAR_HALF_PERIOD_US);
+}
+
+/**@brief Clears the bus and initializes TWIM again. Transaction in progress
+ *        is completed with NRF_ERROR_TIMEOUT, unless it has retries left. */
+static void twi_bus_recover(twi_bus_t * p_bus)
+{
+	twi_transaction_t const * p_transaction = p_bus->p_current;
+	
+	p_bus->recover_pending = false;
+	p_bus->errors          = 0;
+	p_bus->stats.recoveries++;
+	
+	nrfx_twim_uninit(&p_bus->twim);
+	twi_bus_clear(p_bus->config.scl, p_bus->config.sda);
+	
+	if (nrfx_twim_init(&p_bus->twim, &p_bus->config, twi_evt_handler, p_bus) == NRFX_SUCCESS)
+		nrfx_twim_enable(&p_bus->twim);
+	else
+		p_bus->initialized = false;		// Queued transactions fail at start
+	
+	p_bus->speed = p_bus->default_speed;
+	
+	if (p_transaction != NULL)
+		twi_xfer_finish(p_bus, p_transaction, NRF_ERROR_TIMEOUT);
+}
+
+/**@brief Recovers buses which are stuck or have too many errors. Bus 
+ *        taken by triggered transfers is left to it's owner. */
+static void twi_watchdog_handler(void * p_context)
+{
+	UNUSED_PARAMETER(p_context);
+	
+	for (uint8_t bus = 0; bus < TWI_BUS_COUNT; bus++)
+	{
+		twi_bus_t * p_bus = &m_buses[bus];
+		
+		if (!p_bus->initialized || p_bus->triggered)
+			continue;
+		
+		// Transfer may have started just before this check, so it's stuck 
+		// only when it was already in flight at the previous one
+		if (p_bus->p_current != NULL && p_bus->xfer_count == p_bus->watchdog_count)
+			p_bus->stall_ticks++;
+		else
+			p_bus->stall_ticks = 0;
+		
+		p_bus->watchdog_count = p_bus->xfer_count;
+		
+		if (p_bus->stall_ticks >= 2 || p_bus->recover_pending)
 		{
-			detected_device = true;
-			address_array[device_num++] = address;
+			p_bus->stall_ticks = 0;
+			twi_bus_recover(p_bus);
 		}
 	}
+}
 
- 	if (!detected_device)
+ret_code_t twi_init(uint8_t bus, uint32_t scl_pin, uint32_t sda_pin, twi_speed_t speed)
+{
+	if (bus >= TWI_BUS_COUNT || speed == TWI_SPEED_DEFAULT || speed >= TWI_SPEED_COUNT)
+		return NRF_ERROR_INVALID_PARAM;
+	
+	twi_bus_t * p_bus = &m_buses[bus];
+	ret_code_t err_code;
+	
+	// Callbacks drive acquisition state machines, which also run from
+	// application timer events, so TWIM takes the timer priority and
+	// the two never preempt each other. Samples are passed to BLE from
+	// the main loop through app_scheduler.
+	const nrfx_twim_config_t twi_config = { 
+		.scl                = scl_pin,
+		.sda                = sda_pin,
+		.frequency          = m_frequencies[speed],
+		.interrupt_priority = APP_IRQ_PRIORITY_LOW,
+		.hold_bus_uninit    = false
+	};
+	
+	// Watchdog shares interrupt priority with TWIM, so it never 
+	// preempts the event handler
+	if (!m_watchdog_started)
 	{
-		sample_data = 0;
+		err_code = app_timer_create(&m_watchdog_timer_id, APP_TIMER_MODE_REPEATED, twi_watchdog_handler);
+		VERIFY_SUCCESS(err_code);
+		
+		err_code = app_timer_start(m_watchdog_timer_id, APP_TIMER_TICKS(TWI_WATCHDOG_MS), NULL);
+		VERIFY_SUCCESS(err_code);
+		
+		m_watchdog_started = true;
 	}
 	
-	return device_num;
-}
\ No newline at end of file
+	// Slave may hold the bus after reset in the middle of transfer
+	twi_bus_clear(scl_pin, sda_pin);
+	
+	// PRS refuses the peripheral while SPI instance sharing it is in use
+	err_code = twi_result_get(nrfx_twim_init(&p_bus->twim, &twi_config, twi_evt_handler, p_bus));
+	VERIFY_SUCCESS(err_code);
+	
+	nrfx_twim_enable(&p_bus->twim);
+	p_bus->config        = twi_config;
+	p_bus->default_speed = speed;
+	p_bus->speed         = speed;
+	p_bus->initialized   = true;
+	
+	return NRF_SUCCESS;
+}
+
+ret_code_t twi_device_speed_set(uint8_t bus, uint8_t address, twi_speed_t speed)
+{
+	if (bus >= TWI_BUS_COUNT || address >= TWI_ADDRESS_COUNT || speed >= TWI_SPEED_COUNT)
+		return NRF_ERROR_INVALID_PARAM;
+	
+	// Taken by the next transaction with the device
+	m_buses[bus].device_speeds[address] = speed;
+	
+	return NRF_SUCCESS;
+}
+
+ret_code_t twi_uninit(uint8_t bus)
+{
+	if (bus >= TWI_BUS_COUNT)
+		return NRF_ERROR_INVALID_PARAM;
+	
+	twi_bus_t * p_bus = &m_buses[bus];
+	bool busy;
+	
+	CRITICAL_REGION_ENTER();
+	busy = (p_bus->p_current != NULL || p_bus->queue_count > 0);
+	if (!busy)
+		p_bus->initialized = false;
+	CRITICAL_REGION_EXIT();
+	
+	if (busy)
+		return NRF_ERROR_BUSY;
+	
+	nrfx_twim_uninit(&p_bus->twim);
+	
+	return NRF_SUCCESS;
+}
+
+ret_code_t twi_schedule(twi_transaction_t const * p_transaction)
+{
+	if (p_transaction->bus >= TWI_BUS_COUNT)
+		return NRF_ERROR_INVALID_PARAM;
+	
+	twi_bus_t * p_bus = &m_buses[p_transaction->bus];
+	bool start_now = false;
+	
+	if (!p_bus->initialized)
+		return NRF_ERROR_INVALID_STATE;
+	
+	CRITICAL_REGION_ENTER();
+	if (p_bus->p_current == NULL && p_bus->queue_count == 0)
+	{
+		p_bus->p_current = p_transaction;
+		start_now = true;
+	}
+	else if (p_bus->queue_count < TWI_QUEUE_SIZE)
+	{
+		p_bus->queue[(p_bus->queue_head + p_bus->queue_count) % TWI_QUEUE_SIZE] = p_transaction;
+		p_bus->queue_count++;
+	}
+	else
+	{
+		p_transaction = NULL;
+	}
+	CRITICAL_REGION_EXIT();
+	
+	if (p_transaction == NULL)
+		return NRF_ERROR_NO_MEM;
+	
+	if (!start_now)
+		return NRF_SUCCESS;
+	
+	p_bus->attempts = 0;
+	
+	ret_code_t err_code = twi_xfer_start(p_bus, p_transaction);
+	if (err_code != NRF_SUCCESS)
+	{
+		// Bus is released, so the transactions queued meanwhile go on
+		twi_queue_process(p_bus);
+	}
+	
+	return err_code;
+}
+
+ret_code_t twi_triggered_setup(twi_transaction_t const * p_transaction, uint32_t * p_start_task)
+{
+	if (p_transaction->bus >= TWI_BUS_COUNT)
+		return NRF_ERROR_INVALID_PARAM;
+	
+	twi_bus_t * p_bus = &m_buses[p_transaction->bus];
+	bool busy;
+	bool rearm;
+	
+	if (!p_bus->initialized)
+		return NRF_ERROR_INVALID_STATE;
+	
+	CRITICAL_REGION_ENTER();
+	rearm = p_bus->triggered;
+	busy  = (p_bus->p_current != NULL && !rearm);
+	if (!busy)
+	{
+		p_bus->p_current = p_transaction;
+		p_bus->triggered = true;
+	}
+	CRITICAL_REGION_EXIT();
+	
+	if (busy)
+		return NRF_ERROR_BUSY;
+	
+	if (!rearm)
+		twi_speed_apply(p_bus, p_transaction->xfer.address);
+	
+	ret_code_t err_code = twi_result_get(nrfx_twim_xfer(&p_bus->twim, &p_transaction->xfer, 
+													   p_transaction->flags | NRFX_TWIM_FLAG_HOLD_XFER | NRFX_TWIM_FLAG_REPEATED_XFER));
+	if (err_code != NRF_SUCCESS)
+	{
+		// Bus is kept on failed re-arm, trigger may be still enabled
+		if (!rearm)
+			twi_triggered_stop(p_transaction->bus);
+		return err_code;
+	}
+	
+	*p_start_task = nrfx_twim_start_task_get(&p_bus->twim, p_transaction->xfer.type);
+	
+	return NRF_SUCCESS;
+}
+
+void twi_triggered_stop(uint8_t bus)
+{
+	if (bus >= TWI_BUS_COUNT || !m_buses[bus].triggered)
+		return;
+	
+	twi_bus_t * p_bus = &m_buses[bus];
+	
+	p_bus->triggered = false;
+	twi_queue_process(p_bus);
+}
+
+typedef struct
+{
+	volatile bool			done;
+	volatile ret_code_t		result;
+} twi_perform_status_t;
+
+static void twi_perform_callback(ret_code_t result, void * p_context)
+{
+	twi_perform_status_t * p_status = (twi_perform_status_t *)p_context;
+	
+	p_status->result = result;
+	p_status->done   = true;
+}
+
+ret_code_t twi_perform(twi_transaction_t const * p_transaction)
+{
+	twi_perform_status_t status = { .done = false, .result = NRF_SUCCESS };
+	twi_transaction_t transaction = *p_transaction;
+	
+	transaction.callback  = twi_perform_callback;
+	transaction.p_context = &status;
+	
+	ret_code_t err_code = twi_schedule(&transaction);
+	if (err_code != NRF_SUCCESS)
+		return err_code;
+	
+	while (!status.done)
+	{
+	}
+	
+	return status.result;
+}
+
+ret_code_t twi_stats_get(uint8_t bus, twi_stats_t * p_stats)
+{
+	if (bus >= TWI_BUS_COUNT)
+		return NRF_ERROR_INVALID_PARAM;
+	
+	CRITICAL_REGION_ENTER();
+	*p_stats = m_buses[bus].stats;
+	CRITICAL_REGION_EXIT();
+	
+	return NRF_SUCCESS;
+}
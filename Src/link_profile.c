@@ -0,0 +1,188 @@
+/**
+ * @file
+ * link_profile.c
+ *
+ * @brief Connection parameter profiles
+ *
+ * This file contains implementations of functions declared in
+ * link_profile.h. Update procedure, retries included, is left to the
+ * connection parameters module, which takes the profile as preferred
+ * parameters of the connection. Every connection starts idle, on 1M PHY
+ * until the central accepts the PHY update.
+ *
+ */
+
+#include <string.h>
+#include "sdk_common.h"
+#include "link_profile.h"
+#include "ble_conn_params.h"
+#include "nrf_sdh_ble.h"
+#include "ble_hci.h"
+
+#define LINK_SUP_TIMEOUT			MSEC_TO_UNITS(4000, UNIT_10_MS)
+
+// Whole streaming interval is reserved for the link, extension adds the
+// idle radio time of the longer intervals
+STATIC_ASSERT(NRF_SDH_BLE_GAP_EVENT_LENGTH >= LINK_STREAMING_MIN_INTERVAL);
+
+static const ble_gap_conn_params_t	m_profiles[LINK_PROFILE_COUNT] =
+{
+	[LINK_PROFILE_IDLE] =
+	{
+		.min_conn_interval = MSEC_TO_UNITS(100, UNIT_1_25_MS),
+		.max_conn_interval = MSEC_TO_UNITS(200, UNIT_1_25_MS),
+		.slave_latency     = 4,
+		.conn_sup_timeout  = LINK_SUP_TIMEOUT
+	},
+	[LINK_PROFILE_STREAMING] =
+	{
+		.min_conn_interval = LINK_STREAMING_MIN_INTERVAL,
+		.max_conn_interval = MSEC_TO_UNITS(15, UNIT_1_25_MS),
+		.slave_latency     = 0,
+		.conn_sup_timeout  = LINK_SUP_TIMEOUT
+	},
+	[LINK_PROFILE_BULK] =
+	{
+		.min_conn_interval = MSEC_TO_UNITS(30, UNIT_1_25_MS),
+		.max_conn_interval = MSEC_TO_UNITS(60, UNIT_1_25_MS),
+		.slave_latency     = 0,
+		.conn_sup_timeout  = LINK_SUP_TIMEOUT
+	}
+};
+
+static link_status_t				m_status;
+static link_status_handler_t		m_handler;
+
+
+/**@brief Takes the parameters in use from GAP event and reports them. */
+static void link_params_update(ble_gap_conn_params_t const * p_params)
+{
+	m_status.interval = p_params->max_conn_interval;
+	m_status.latency  = p_params->slave_latency;
+	m_status.timeout  = p_params->conn_sup_timeout;
+	
+	if (m_handler != NULL)
+		m_handler(&m_status);
+}
+
+static void link_on_ble_evt(ble_evt_t const * p_ble_evt, void * p_context)
+{
+	UNUSED_PARAMETER(p_context);
+	
+	switch (p_ble_evt->header.evt_id)
+	{
+	case BLE_GAP_EVT_CONNECTED:
+	{
+		ble_gap_phys_t const phys =
+		{
+			.tx_phys = LINK_PREFERRED_PHYS,
+			.rx_phys = LINK_PREFERRED_PHYS
+		};
+			
+		m_status.profile = LINK_PROFILE_IDLE;
+		m_status.tx_phy  = BLE_GAP_PHY_1MBPS;
+		m_status.rx_phy  = BLE_GAP_PHY_1MBPS;
+		link_params_update(&p_ble_evt->evt.gap_evt.params.connected.conn_params);
+			
+		// Central which doesn't support 2M answers with 1M
+		(void)sd_ble_gap_phy_update(p_ble_evt->evt.gap_evt.conn_handle, &phys);
+		break;
+	}
+		
+	case BLE_GAP_EVT_PHY_UPDATE:
+		if (p_ble_evt->evt.gap_evt.params.phy_update.status != BLE_HCI_STATUS_CODE_SUCCESS)
+			break;
+		
+		m_status.tx_phy = p_ble_evt->evt.gap_evt.params.phy_update.tx_phy;
+		m_status.rx_phy = p_ble_evt->evt.gap_evt.params.phy_update.rx_phy;
+		
+		if (m_handler != NULL)
+			m_handler(&m_status);
+		break;
+		
+	case BLE_GAP_EVT_CONN_PARAM_UPDATE:
+		link_params_update(&p_ble_evt->evt.gap_evt.params.conn_param_update.conn_params);
+		break;
+		
+	case BLE_GAP_EVT_DISCONNECTED:
+		memset(&m_status, 0, sizeof(m_status));
+		break;
+		
+	default:
+		break;
+	}
+}
+
+NRF_SDH_BLE_OBSERVER(m_link_ble_observer, LINK_PROFILE_BLE_OBSERVER_PRIO, link_on_ble_evt, NULL);
+
+ret_code_t link_profile_init(link_status_handler_t handler)
+{
+	ret_code_t err_code;
+	ble_opt_t opt;
+	
+	m_handler = handler;
+	memset(&m_status, 0, sizeof(m_status));
+	
+	memset(&opt, 0, sizeof(opt));
+	opt.common_opt.conn_evt_ext.enable = 1;
+	
+	err_code = sd_ble_opt_set(BLE_COMMON_OPT_CONN_EVT_EXT, &opt);
+	VERIFY_SUCCESS(err_code);
+	
+	return sd_ble_gap_ppcp_set(&m_profiles[LINK_PROFILE_IDLE]);
+}
+
+ret_code_t link_profile_set(uint16_t conn_handle, link_profile_t profile)
+{
+	if (profile >= LINK_PROFILE_COUNT)
+		return NRF_ERROR_INVALID_PARAM;
+	
+	if (profile == m_status.profile)
+		return NRF_SUCCESS;
+	
+	ble_gap_conn_params_t params = m_profiles[profile];
+	
+	ret_code_t err_code = ble_conn_params_change_conn_params(conn_handle, &params);
+	VERIFY_SUCCESS(err_code);
+	
+	m_status.profile = profile;
+	
+	if (m_handler != NULL)
+		m_handler(&m_status);
+	
+	return NRF_SUCCESS;
+}
+
+void link_throughput_set(uint32_t bytes_per_s)
+{
+	m_status.throughput = bytes_per_s;
+	
+	if (m_handler != NULL)
+		m_handler(&m_status);
+}
+
+ble_gap_conn_params_t const * link_profile_params_get(link_profile_t profile)
+{
+	if (profile >= LINK_PROFILE_COUNT)
+		return NULL;
+	
+	return &m_profiles[profile];
+}
+
+link_status_t const * link_status_get(void)
+{
+	return &m_status;
+}
+
+uint16_t link_status_encode(uint8_t * p_data)
+{
+	p_data[0] = m_status.profile;
+	(void)uint16_encode(m_status.interval, &p_data[1]);
+	(void)uint16_encode(m_status.latency,  &p_data[3]);
+	(void)uint16_encode(m_status.timeout,  &p_data[5]);
+	p_data[7] = m_status.tx_phy;
+	p_data[8] = m_status.rx_phy;
+	(void)uint32_encode(m_status.throughput, &p_data[9]);
+	
+	return LINK_STATUS_LENGTH;
+}
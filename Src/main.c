@@ -68,6 +68,7 @@
 #include "nrf_sdh_soc.h"
 #include "nrf_sdh_ble.h"
 #include "app_timer.h"
+#include "app_scheduler.h"
 #include "fds.h"
 #include "peer_manager.h"
 #include "peer_manager_handler.h"
@@ -77,7 +78,6 @@
 #include "nrf_ble_gatt.h"
 #include "nrf_ble_qwr.h"
 #include "nrf_pwr_mgmt.h"
-#include "nrf_delay.h"
 
 #include "ble_measurement_service.h"
 #include "i2c.h"
@@ -86,6 +86,11 @@
 #include "nrf_log_ctrl.h"
 #include "nrf_log_default_backends.h"
 #include "LTC2497.h"
+#include "acquisition.h"
+#include "calibration.h"
+#include "device_registry.h"
+#include "link_profile.h"
+#include "deadband.h"
 
 
 #define DEVICE_NAME                     "SensoricGlove1"                       /**< Name of device. Will be included in the advertising data. */
@@ -96,11 +101,6 @@
 #define APP_BLE_OBSERVER_PRIO           3                                       /**< Application's BLE observer priority. You shouldn't need to modify this value. */
 #define APP_BLE_CONN_CFG_TAG            1                                       /**< A tag identifying the SoftDevice BLE configuration. */
 
-#define MIN_CONN_INTERVAL               MSEC_TO_UNITS(100, UNIT_1_25_MS)        /**< Minimum acceptable connection interval (0.1 seconds). */
-#define MAX_CONN_INTERVAL               MSEC_TO_UNITS(200, UNIT_1_25_MS)        /**< Maximum acceptable connection interval (0.2 second). */
-#define SLAVE_LATENCY                   0                                       /**< Slave latency. */
-#define CONN_SUP_TIMEOUT                MSEC_TO_UNITS(4000, UNIT_10_MS)         /**< Connection supervisory timeout (4 seconds). */
-
 #define FIRST_CONN_PARAMS_UPDATE_DELAY  APP_TIMER_TICKS(5000)                   /**< Time from initiating event (connect or start of notification) to first time sd_ble_gap_conn_param_update is called (5 seconds). */
 #define NEXT_CONN_PARAMS_UPDATE_DELAY   APP_TIMER_TICKS(30000)                  /**< Time between each call to sd_ble_gap_conn_param_update after the first call (30 seconds). */
 #define MAX_CONN_PARAMS_UPDATE_COUNT    3                                       /**< Number of attempts before giving up the connection parameter negotiation. */
@@ -114,10 +114,14 @@
 #define SEC_PARAM_MIN_KEY_SIZE          7                                       /**< Minimum encryption key size. */
 #define SEC_PARAM_MAX_KEY_SIZE          16                                      /**< Maximum encryption key size. */
 
+#define SCHED_MAX_EVENT_DATA_SIZE       ACQ_SCHED_EVENT_DATA_SIZE               /**< Maximum size of scheduler events. */
+#define SCHED_QUEUE_SIZE                8                                       /**< Maximum number of events in the scheduler queue, frame waits in it at most once. */
+
 #define DEAD_BEEF                       0xDEADBEEF                              /**< Value used as error code on stack dump, can be used to identify stack location on stack unwind. */
 
 
 BLE_MEAS_DEF(m_meas);
+APP_TIMER_DEF(m_throughput_timer_id);                                           /**< Link throughput measurement timer. */
 NRF_BLE_GATT_DEF(m_gatt);                                                       /**< GATT module instance. */
 NRF_BLE_QWR_DEF(m_qwr);                                                         /**< Context for the Queued Write module.*/
 BLE_ADVERTISING_DEF(m_advertising);                                             /**< Advertising module instance. */
@@ -130,11 +134,38 @@ static ble_uuid_t m_adv_uuids[] =
     {MEASUREMENT_SERVICE_UUID, BLE_UUID_TYPE_BLE }
 };
 
-// Only for testing notifications
-#define NOTIFICATION_INTERVAL           APP_TIMER_TICKS(100)
-APP_TIMER_DEF(m_notification_timer_id);
-static uint8_t m_current_channel = 0;
-static uint8_t updating_chars[16] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+#define FRAME_INTERVAL_MS               ACQ_FRAME_INTERVAL_MS                   /**< Interval between snapshots of all channels. */
+#define DEADBAND_ABS_UV                 200                                     /**< Default dead band, a few LSB of ADC noise. */
+#define DEADBAND_REL_PERMILLE           0                                       /**< Default relative dead band, off. */
+#define DEADBAND_MAX_SILENCE_MS         10000                                   /**< Default keepalive of unchanged channel. */
+#define STREAM_RING_SIZE                4                                       /**< Stream blocks waiting for the main loop, power of two. */
+static uint8_t updating_chars[ACQ_CHANNEL_MAX] = { 0 };
+static uint8_t m_adc_buses[ACQ_ADC_MAX];                                        /**< Buses of the ADC chips found. */
+static uint8_t m_adc_addresses[ACQ_ADC_MAX];                                    /**< Addresses of the ADC chips found. */
+static uint8_t m_adc_count;
+
+static const LTC2497_setup_t m_adc_setup =                                     /**< ADC setup at start and after disconnect. */
+{
+    .freq  = LTC2497_REJECTION_FREQ_50_60_HZ,
+    .speed = LTC2497_CONVERSION_SPEED_2X,
+    .temp  = LTC2497_TEMP_OUTPUT_OFF
+};
+static acq_channel_mask_t m_frame_mask = ~(acq_channel_mask_t)0;                /**< Channels of the Frame characteristic, set by the control point. */
+static bool m_stream_active;                                                    /**< Frame scan is running, control point may stop it. */
+static bool m_hw_stream_active;                                                 /**< Hardware paced stream is started by the control point. */
+static const deadband_config_t m_deadband =                                     /**< Dead band at start and after disconnect. */
+{
+    .abs_uv         = DEADBAND_ABS_UV,
+    .rel_permille   = DEADBAND_REL_PERMILLE,
+    .max_silence_ms = DEADBAND_MAX_SILENCE_MS
+};
+
+STATIC_ASSERT(DEADBAND_CHANNEL_COUNT == ACQ_CHANNEL_MAX);
+STATIC_ASSERT(BLE_MEAS_SCHED_EVENT_DATA_SIZE <= SCHED_MAX_EVENT_DATA_SIZE);
+STATIC_ASSERT(ACQ_STREAM_BLOCK_SIZE <= BLE_MEAS_STREAM_SLOT_MAX);
+STATIC_ASSERT(LTC2497_DATA_LENGTH == BLE_MEAS_STREAM_SLOT_LEN);
+
+FRAME_RING_DEF(m_stream_ring, acq_stream_block_t, STREAM_RING_SIZE);           /**< Stream blocks passed from interrupt context, newest is dropped when full. */
 
 
 static void advertising_start(bool erase_bonds);
@@ -177,37 +208,115 @@ static void pm_evt_handler(pm_evt_t const * p_evt)
     }
 }
 
+/**@brief Function for getting mask of channels with enabled notifications
+ */
+static acq_channel_mask_t updating_chars_mask_get(void)
+{
+	acq_channel_mask_t mask = 0;
+	
+	for (uint8_t channel = 0; channel < acq_channel_count_get(); channel++)
+	{
+		// Frame characteristic carries the channels selected by the control point
+		if (updating_chars[channel] || (m_meas.frame_notification && (m_frame_mask & ACQ_CHANNEL_BIT(channel))))
+			mask |= ACQ_CHANNEL_BIT(channel);
+	}
+	
+	return mask;
+}
+
 /**@brief Function for updating all BLE channels with ADC data
  *
- * @details This function will be called each time the notification timer expires.
+ * @details This function will be called by acquisition engine each time the sweep 
+ *          of all enabled channels is finished. Channel characteristics keep 
+ *          carrying the 4 bytes read from LTC2497, as hosts of the legacy format
+ *          expect. Calibrated input voltages in microvolts are sent only by the
+ *          Frame characteristic, if it's notification is enabled. Channels
+ *          which haven't moved out of their dead band are left out of both.
  *
- * @param[in] p_context  Pointer used for passing some arbitrary information (context) from the
- *                       app_start_timer() call to the timeout handler.
+ * @param[in] p_frame  Frame of samples sharing the same timestamp.
  */
-static void notification_timeout_handler(void * p_context)
-{	
-	UNUSED_PARAMETER(p_context);
-	ret_code_t err_code = NRF_SUCCESS;
+static void acq_frame_handler(acq_frame_t const * p_frame)
+{
+	uint8_t channel_count = acq_channel_count_get();
+	acq_channel_mask_t send_mask = deadband_apply(p_frame->channel_mask, p_frame->value, p_frame->timestamp);
 	
-    
-	if (updating_chars[m_current_channel])
+	for (uint8_t channel = 0; channel < channel_count; channel++)
 	{
-		uint8_t data[4] = { 0 };
-		err_code = ltc2497_select_diff_channel((m_current_channel > 7) ? ADC_ADDRESS_TWO : ADC_ADDRESS_ONE, m_current_channel % 8, LTC2497_DIFF_POLARITY_POSITIVE);
-		nrf_delay_ms(1);
-		err_code = ltc_read_data((m_current_channel > 7) ? ADC_ADDRESS_TWO : ADC_ADDRESS_ONE, data);
-		nrf_delay_ms(1);
+		if ((send_mask & ACQ_CHANNEL_BIT(channel)) && updating_chars[channel])
+			ble_meas_value_update(&m_meas, (uint8_t*)p_frame->data[channel], channel);
+	}
+	
+	if (m_meas.frame_notification && send_mask != 0)
+	{
+		ble_meas_frame_t frame =
+		{
+			.sequence     = p_frame->sequence,
+			.timestamp    = p_frame->timestamp,
+			.channel_mask = send_mask,
+			.p_values     = p_frame->value
+		};
+		
+		(void)ble_meas_frame_send(&m_meas, &frame);
+	}
+}
+
+/**@brief Function for sending the stream blocks by the Stream characteristic from the main loop.
+ */
+static void stream_block_process(void * p_event_data, uint16_t event_size)
+{
+	static acq_stream_block_t block;
 	
-		err_code = ble_meas_value_update(&m_meas, data, m_current_channel);
+	UNUSED_PARAMETER(p_event_data);
+	UNUSED_PARAMETER(event_size);
+	
+	while (frame_ring_pop(&m_stream_ring, &block))
+	{
+		ble_meas_stream_block_t const stream_block =
+		{
+			.sequence    = block.sequence,
+			.channel     = block.channel,
+			.count       = block.count,
+			.missed_mask = block.missed_mask,
+			.p_data      = block.data[0]
+		};
+		
+		(void)ble_meas_stream_send(&m_meas, &stream_block);
 	}
+}
+
+/**@brief Function for handing the block of the hardware paced stream over to the main loop.
+ *
+ * @details This function will be called by acquisition engine from interrupt context when 
+ *          the block is filled. Block is refilled one block time later, so it is copied 
+ *          to the ring. Block left there by failed scheduler event goes with the next one.
+ *
+ * @param[in] p_block  Block of samples of single channel.
+ */
+static void acq_stream_handler(acq_stream_block_t const * p_block)
+{
+	if (frame_ring_push(&m_stream_ring, p_block))
+		(void)app_sched_event_put(NULL, 0, stream_block_process);
+}
+
+/**@brief Function for measuring the throughput of the frame notifications.
+ *
+ * @details Data passed to the SoftDevice since the last measurement is reported by the
+ *          Link characteristic, so the radio budget of the active profile can be checked.
+ */
+static void throughput_timeout_handler(void * p_context)
+{
+	static uint32_t last_bytes;
+	ble_meas_tx_stats_t tx_stats;
 	
-	m_current_channel++;
+	UNUSED_PARAMETER(p_context);
 	
-	if (m_current_channel > 15)
-		m_current_channel = 0;
+	ble_meas_tx_stats_get(&m_meas, &tx_stats);
 	
+	uint32_t bytes = tx_stats.bytes - last_bytes;
+	last_bytes = tx_stats.bytes;
 	
-	//APP_ERROR_CHECK(err_code);
+	if (m_conn_handle != BLE_CONN_HANDLE_INVALID)
+		link_throughput_set(bytes * 1000 / LINK_THROUGHPUT_INTERVAL_MS);
 }
 
 /**@brief Function for the Timer initialization.
@@ -220,9 +329,31 @@ static void timers_init(void)
     ret_code_t err_code = app_timer_init();
     APP_ERROR_CHECK(err_code);
 
-    // Create timers.
-    err_code = app_timer_create(&m_notification_timer_id, APP_TIMER_MODE_REPEATED, notification_timeout_handler);
-	APP_ERROR_CHECK(err_code);
+    err_code = app_timer_create(&m_throughput_timer_id, APP_TIMER_MODE_REPEATED, throughput_timeout_handler);
+    APP_ERROR_CHECK(err_code);
+}
+
+
+/**@brief Function for the Event Scheduler initialization.
+ *
+ * @details Acquisition passes finished frames to the main loop through the scheduler,
+ *          so the notifications are sent outside of the TWI and timer interrupts.
+ */
+static void scheduler_init(void)
+{
+    APP_SCHED_INIT(SCHED_MAX_EVENT_DATA_SIZE, SCHED_QUEUE_SIZE);
+}
+
+
+/**@brief Function for reporting the link profile and the connection parameters in use.
+ */
+static void link_status_handler(link_status_t const * p_status)
+{
+	uint8_t data[LINK_STATUS_LENGTH];
+	
+	UNUSED_PARAMETER(p_status);
+	
+	(void)ble_meas_link_update(&m_meas, data, link_status_encode(data));
 }
 
 
@@ -234,7 +365,6 @@ static void timers_init(void)
 static void gap_params_init(void)
 {
     ret_code_t              err_code;
-    ble_gap_conn_params_t   gap_conn_params;
     ble_gap_conn_sec_mode_t sec_mode;
 
     BLE_GAP_CONN_SEC_MODE_SET_OPEN(&sec_mode);
@@ -248,23 +378,54 @@ static void gap_params_init(void)
        err_code = sd_ble_gap_appearance_set(BLE_APPEARANCE_);
        APP_ERROR_CHECK(err_code); */
 
-    memset(&gap_conn_params, 0, sizeof(gap_conn_params));
+    // Connection starts with idle profile parameters
+    err_code = link_profile_init(link_status_handler);
+    APP_ERROR_CHECK(err_code);
+}
 
-    gap_conn_params.min_conn_interval = MIN_CONN_INTERVAL;
-    gap_conn_params.max_conn_interval = MAX_CONN_INTERVAL;
-    gap_conn_params.slave_latency     = SLAVE_LATENCY;
-    gap_conn_params.conn_sup_timeout  = CONN_SUP_TIMEOUT;
 
-    err_code = sd_ble_gap_ppcp_set(&gap_conn_params);
-    APP_ERROR_CHECK(err_code);
+/**@brief Function for handling events from the GATT module.
+ *
+ * @details Frames are packed into notifications of the negotiated MTU, data length
+ *          lets a whole notification go in single link layer packet.
+ */
+static void gatt_evt_handler(nrf_ble_gatt_t * p_gatt, nrf_ble_gatt_evt_t const * p_evt)
+{
+    if (p_evt->conn_handle != m_conn_handle)
+    {
+        return;
+    }
+    
+    switch (p_evt->evt_id)
+    {
+        case NRF_BLE_GATT_EVT_ATT_MTU_UPDATED:
+            NRF_LOG_INFO("ATT MTU: %d", p_evt->params.att_mtu_effective);
+            ble_meas_att_mtu_set(&m_meas, p_evt->params.att_mtu_effective);
+            break;
+            
+        case NRF_BLE_GATT_EVT_DATA_LENGTH_UPDATED:
+            NRF_LOG_INFO("Data length: %d", p_evt->params.data_length);
+            break;
+            
+        default:
+            break;
+    }
 }
 
 
 /**@brief Function for initializing the GATT module.
+ *
+ * @details Largest MTU and data length are requested on connect.
  */
 static void gatt_init(void)
 {
-    ret_code_t err_code = nrf_ble_gatt_init(&m_gatt, NULL);
+    ret_code_t err_code = nrf_ble_gatt_init(&m_gatt, gatt_evt_handler);
+    APP_ERROR_CHECK(err_code);
+    
+    err_code = nrf_ble_gatt_att_mtu_periph_set(&m_gatt, NRF_SDH_BLE_GATT_MAX_MTU_SIZE);
+    APP_ERROR_CHECK(err_code);
+    
+    err_code = nrf_ble_gatt_data_length_set(&m_gatt, BLE_CONN_HANDLE_INVALID, NRF_SDH_BLE_GAP_DATA_LENGTH);
     APP_ERROR_CHECK(err_code);
 }
 
@@ -282,6 +443,142 @@ static void nrf_qwr_error_handler(uint32_t nrf_error)
 }
 
 
+/**@brief Function for switching the link to streaming profile while any channel is
+ *        notified, and back to idle profile when none is or the stream is stopped.
+ *        Hardware paced stream is sent in blocks, which need throughput rather than
+ *        latency, so the link takes bulk profile while it runs.
+ */
+static void link_profile_update(void)
+{
+	link_profile_t profile = LINK_PROFILE_IDLE;
+	
+	if (m_hw_stream_active)
+		profile = LINK_PROFILE_BULK;
+	else if (m_stream_active && updating_chars_mask_get() != 0)
+		profile = LINK_PROFILE_STREAMING;
+	
+	ret_code_t err_code = link_profile_set(m_conn_handle, profile);
+	if (err_code != NRF_SUCCESS)
+		NRF_LOG_WARNING("Link profile %d not requested: %d", profile, err_code);
+}
+
+
+/**@brief Function for selecting the ADC filter: mains frequency rejected and speed.
+ *
+ * @details Setup is applied by the acquisition from the next sweep. Frame interval 
+ *          must fit the sweep of the scanned channels with the new setup.
+ */
+static ret_code_t adc_filter_set(uint8_t rejection, uint8_t speed)
+{
+	static const uint8_t rejection_freq[] =
+	{
+		[BLE_MEAS_REJECTION_50_60_HZ] = LTC2497_REJECTION_FREQ_50_60_HZ,
+		[BLE_MEAS_REJECTION_50_HZ]    = LTC2497_REJECTION_FREQ_50_HZ,
+		[BLE_MEAS_REJECTION_60_HZ]    = LTC2497_REJECTION_FREQ_60_HZ
+	};
+	
+	if (rejection >= ARRAY_SIZE(rejection_freq) || speed > BLE_MEAS_SPEED_2X)
+		return NRF_ERROR_INVALID_PARAM;
+	
+	LTC2497_setup_t setup = m_adc_setup;
+	
+	setup.freq  = rejection_freq[rejection];
+	setup.speed = (speed == BLE_MEAS_SPEED_2X) ? LTC2497_CONVERSION_SPEED_2X : LTC2497_CONVERSION_SPEED_1X;
+	
+	return acq_setup_set(&setup);
+}
+
+
+/**@brief Function for executing the Control Point commands.
+ *
+ * @details Stream is reconfigured without reconnecting: channel mask takes effect from
+ *          the next frame, new frame interval restarts the scan timer, ADC filter is 
+ *          applied by the next sweep. Configuration returns to the defaults on disconnect.
+ *          Hardware paced stream of single channel is started after the frame scan is
+ *          stopped, it's blocks are sent by the Stream characteristic.
+ *
+ * @param[in]   p_meas         Measurement Service structure.
+ * @param[in]   p_cmd          Decoded command.
+ *
+ * @retval      NRF_SUCCESS or error code sent to the client by the write response.
+ */
+static ret_code_t on_meas_ctrl(ble_meas_t * p_meas, ble_meas_ctrl_cmd_t const * p_cmd)
+{
+	ret_code_t err_code;
+	
+	switch (p_cmd->opcode)
+	{
+	case BLE_MEAS_CTRL_OP_CHANNEL_MASK:
+		m_frame_mask = p_cmd->params.channel_mask;
+		acq_channel_mask_set(updating_chars_mask_get());
+		link_profile_update();
+		return NRF_SUCCESS;
+		
+	case BLE_MEAS_CTRL_OP_FRAME_INTERVAL:
+		return acq_frame_interval_set(p_cmd->params.frame_interval_ms);
+		
+	case BLE_MEAS_CTRL_OP_ENCODING:
+		return ble_meas_encoding_set(p_meas, p_cmd->params.encoding);
+		
+	case BLE_MEAS_CTRL_OP_FILTER:
+		return adc_filter_set(p_cmd->params.filter.rejection, p_cmd->params.filter.speed);
+		
+	case BLE_MEAS_CTRL_OP_DEADBAND:
+	{
+		deadband_config_t config =
+		{
+			.abs_uv         = p_cmd->params.deadband.abs_uv,
+			.rel_permille   = p_cmd->params.deadband.rel_permille,
+			.max_silence_ms = p_cmd->params.deadband.max_silence_ms
+		};
+			
+		return deadband_config_set(p_cmd->params.deadband.channel, &config);
+	}
+		
+	case BLE_MEAS_CTRL_OP_STREAM:
+		if (p_cmd->params.start == m_stream_active)
+			return NRF_SUCCESS;
+		
+		if (p_cmd->params.start)
+		{
+			// Filter may have been changed while the scan was stopped
+			if (acq_frame_interval_get() < acq_sweep_time_ms())
+				return NRF_ERROR_INVALID_STATE;
+			
+			err_code = acq_scan_start(updating_chars_mask_get(), acq_frame_interval_get());
+			VERIFY_SUCCESS(err_code);
+		}
+		else
+		{
+			acq_scan_stop();
+		}
+		
+		m_stream_active = p_cmd->params.start;
+		link_profile_update();
+		return NRF_SUCCESS;
+		
+	case BLE_MEAS_CTRL_OP_HW_STREAM:
+		if (p_cmd->params.hw_stream.channel == BLE_MEAS_HW_STREAM_STOP)
+		{
+			acq_stream_stop();
+		}
+		else
+		{
+			// Engine refuses the stream while the frame scan is running
+			err_code = acq_stream_start(p_cmd->params.hw_stream.channel, p_cmd->params.hw_stream.period_us);
+			VERIFY_SUCCESS(err_code);
+		}
+		
+		m_hw_stream_active = (p_cmd->params.hw_stream.channel != BLE_MEAS_HW_STREAM_STOP);
+		link_profile_update();
+		return NRF_SUCCESS;
+		
+	default:
+		return NRF_ERROR_NOT_SUPPORTED;
+	}
+}
+
+
 /**@brief Function for handling the Measurement Service events.
  *
  * @details This function will be called for all Custom Service events which are passed to
@@ -304,7 +601,7 @@ static void on_meas_evt(ble_meas_t * p_meas, ble_meas_evt_t * p_evt)
 	case BLE_MEAS_EVT_NOTIFICATION_ENABLED:
 		
 		handler_found = false;
-		for (handler = 0; handler < 16; handler++)
+		for (handler = 0; handler < p_meas->channel_count; handler++)
 		{
 			if (p_evt->p_evt_write->handle == p_meas->value_handles[handler].cccd_handle)
 			{
@@ -314,7 +611,11 @@ static void on_meas_evt(ble_meas_t * p_meas, ble_meas_evt_t * p_evt)
 		}
 		if (handler_found)
 		{
+			// New listener gets the current value of every channel
 			updating_chars[handler] = 1;
+			deadband_reset();
+			acq_channel_mask_set(updating_chars_mask_get());
+			link_profile_update();
 		}
 		
 		break;
@@ -322,7 +623,7 @@ static void on_meas_evt(ble_meas_t * p_meas, ble_meas_evt_t * p_evt)
 	case BLE_MEAS_EVT_NOTIFICATION_DISABLED:
 		
 		handler_found = false;
-		for (handler = 0; handler < 16; handler++)
+		for (handler = 0; handler < p_meas->channel_count; handler++)
 		{
 			if (p_evt->p_evt_write->handle == p_meas->value_handles[handler].cccd_handle)
 			{
@@ -333,22 +634,56 @@ static void on_meas_evt(ble_meas_t * p_meas, ble_meas_evt_t * p_evt)
 		if (handler_found)
 		{
 			updating_chars[handler] = 0;
+			acq_channel_mask_set(updating_chars_mask_get());
+			link_profile_update();
 		}
 		break;
 		
+	case BLE_MEAS_EVT_FRAME_NOTIFICATION_ENABLED:
+		deadband_reset();
+		acq_channel_mask_set(updating_chars_mask_get());
+		link_profile_update();
+		break;
+		
+	case BLE_MEAS_EVT_FRAME_NOTIFICATION_DISABLED:
+		acq_channel_mask_set(updating_chars_mask_get());
+		link_profile_update();
+		break;
+		
 	case BLE_MEAS_EVT_CONNECTED:
-		err_code = app_timer_start(m_notification_timer_id, NOTIFICATION_INTERVAL, NULL);
+		err_code = acq_scan_start(updating_chars_mask_get(), FRAME_INTERVAL_MS);
 		APP_ERROR_CHECK(err_code);
-		app_timer_resume();
+		m_stream_active = true;
 		break;
 
 	case BLE_MEAS_EVT_DISCONNECTED:
-		app_timer_pause();
+		acq_stream_stop();
+		acq_scan_stop();
+		m_stream_active    = false;
+		m_hw_stream_active = false;
 		
-		for (handler = 0; handler < 16; handler++)
+		for (handler = 0; handler < p_meas->channel_count; handler++)
 			updating_chars[handler] = 0;
 		
+		// Stream configuration of the control point lasts for the connection
+		m_frame_mask = ~(acq_channel_mask_t)0;
+		(void)acq_setup_set(&m_adc_setup);			// Scan is stopped, so it's always taken
+		deadband_init(&m_deadband);
+		break;
+		
+	case BLE_MEAS_EVT_CAL_WRITTEN:
+	{
+		uint8_t record[CAL_RECORD_MAX_LENGTH];
+		
+		err_code = cal_record_write(p_evt->p_evt_write->data, p_evt->p_evt_write->len);
+		if (err_code != NRF_SUCCESS)
+			NRF_LOG_WARNING("Calibration write failed: %d", err_code);
+		
+		// Characteristic shows the selected record as stored
+		err_code = ble_meas_cal_update(p_meas, record, cal_record_read(record));
+		APP_ERROR_CHECK(err_code);
 		break;
+	}
 
 	default:
 		// No implementation needed.
@@ -375,6 +710,8 @@ static void services_init(void)
     memset(&meas_init, 0, sizeof(meas_init));
 	
 	meas_init.evt_handler                = on_meas_evt;
+	meas_init.channel_count              = m_adc_count * ACQ_CHANNELS_PER_ADC;
+	meas_init.ctrl_handler               = on_meas_ctrl;
 	BLE_GAP_CONN_SEC_MODE_SET_OPEN(&meas_init.value_char_attr_md.read_perm);
 	BLE_GAP_CONN_SEC_MODE_SET_OPEN(&meas_init.value_char_attr_md.write_perm);
 	
@@ -386,21 +723,17 @@ static void services_init(void)
 /**@brief Function for handling the Connection Parameters Module.
  *
  * @details This function will be called for all events in the Connection Parameters Module which
- *          are passed to the application.
- *          @note All this function does is to disconnect. This could have been done by simply
- *                setting the disconnect_on_fail config parameter, but instead we use the event
- *                handler mechanism to demonstrate its use.
+ *          are passed to the application. Connection is kept when the central refuses
+ *          the parameters of the requested link profile.
  *
  * @param[in] p_evt  Event received from the Connection Parameters Module.
  */
 static void on_conn_params_evt(ble_conn_params_evt_t * p_evt)
 {
-    ret_code_t err_code;
-
+    // Parameters chosen by the central are reported by the Link characteristic
     if (p_evt->evt_type == BLE_CONN_PARAMS_EVT_FAILED)
     {
-        err_code = sd_ble_gap_disconnect(m_conn_handle, BLE_HCI_CONN_INTERVAL_UNACCEPTABLE);
-        APP_ERROR_CHECK(err_code);
+        NRF_LOG_WARNING("Connection parameters of link profile refused.");
     }
 }
 
@@ -442,11 +775,10 @@ static void conn_params_init(void)
  */
 static void application_timers_start(void)
 {
-    /* YOUR_JOB: Start your timers. below is an example of how to start a timer.
-       ret_code_t err_code;
-       err_code = app_timer_start(m_app_timer_id, TIMER_INTERVAL, NULL);
-       APP_ERROR_CHECK(err_code); */
-	
+    ret_code_t err_code;
+
+    err_code = app_timer_start(m_throughput_timer_id, APP_TIMER_TICKS(LINK_THROUGHPUT_INTERVAL_MS), NULL);
+    APP_ERROR_CHECK(err_code);
 }
 
 
@@ -576,6 +908,14 @@ static void ble_stack_init(void)
     err_code = nrf_sdh_ble_default_cfg_set(APP_BLE_CONN_CFG_TAG, &ram_start);
     APP_ERROR_CHECK(err_code);
 
+    // Deeper notification queue lets every connection event be filled with frames.
+    ble_cfg_t ble_cfg;
+    memset(&ble_cfg, 0, sizeof(ble_cfg));
+    ble_cfg.conn_cfg.conn_cfg_tag                            = APP_BLE_CONN_CFG_TAG;
+    ble_cfg.conn_cfg.params.gatts_conn_cfg.hvn_tx_queue_size = BLE_MEAS_HVN_TX_QUEUE_SIZE;
+    err_code = sd_ble_cfg_set(BLE_CONN_CFG_GATTS, &ble_cfg, ram_start);
+    APP_ERROR_CHECK(err_code);
+
     // Enable BLE stack.
     err_code = nrf_sdh_ble_enable(&ram_start);
     APP_ERROR_CHECK(err_code);
@@ -746,6 +1086,7 @@ static void power_management_init(void)
  */
 static void idle_state_handle(void)
 {
+    app_sched_execute();
     if (NRF_LOG_PROCESS() == false)
     {
         nrf_pwr_mgmt_run();
@@ -775,31 +1116,87 @@ static void advertising_start(bool erase_bonds)
 int main(void)
 {
     bool erase_bonds;
+	ret_code_t err_code;
 		
     // Initialize.
     log_init();
     timers_init();
+    scheduler_init();
     buttons_leds_init(&erase_bonds);
     power_management_init();
     ble_stack_init();
+	
+	// Bus is probed in background, unless the registry is kept from the last boot
+	err_code = twi_init(0, TWI_BUS0_SCL_PIN, TWI_BUS0_SDA_PIN, TWI_SPEED_400K);
+	APP_ERROR_CHECK(err_code);
+	
+	err_code = twi_init(1, TWI_BUS1_SCL_PIN, TWI_BUS1_SDA_PIN, TWI_SPEED_400K);
+	APP_ERROR_CHECK(err_code);
+	
+	err_code = dev_registry_init();
+	APP_ERROR_CHECK(err_code);
+	
+	err_code = dev_discovery_start(true);
+	APP_ERROR_CHECK(err_code);
+	
     gap_params_init();
     gatt_init();
+	
+	// Calibration must be loaded before the first frame
+	err_code = cal_init();
+	APP_ERROR_CHECK(err_code);
+	
+	// Channel characteristics are created for the chips found
+	while (dev_discovery_is_busy())
+	{
+		idle_state_handle();
+	}
+	m_adc_count = dev_registry_addresses_get(DEV_TYPE_LTC2497, m_adc_buses, m_adc_addresses, ACQ_ADC_MAX);
+	NRF_LOG_INFO("ADC chips found: %d", m_adc_count);
+	
+	// Clock of every device is selected by it's measured timing, the test 
+	// runs in background after discovery, otherwise the saved clocks are set
+	err_code = dev_selftest_start(true);
+	APP_ERROR_CHECK(err_code);
+	
 	services_init();
 	advertising_init();
     conn_params_init();
 	//    peer_manager_init();
 	
-	twi_init();
+	uint8_t cal_record[CAL_RECORD_MAX_LENGTH];
+	err_code = ble_meas_cal_update(&m_meas, cal_record, cal_record_read(cal_record));
+	APP_ERROR_CHECK(err_code);
+	
+	deadband_init(&m_deadband);
 	
-	LTC2497_setup_t setup =
-	{ 
-		.freq   = LTC2497_REJECTION_FREQ_50_60_HZ,
-		.speed  = LTC2497_CONVERSION_SPEED_2X,
-		.temp   = LTC2497_TEMP_OUTPUT_OFF
+	// Chips are set up after the self-test, which reads them at power-on setup
+	while (dev_selftest_is_busy())
+	{
+		idle_state_handle();
+	}
+	
+	acq_init_t acq_init_params =
+	{
+		.setup          = m_adc_setup,
+		.p_buses        = m_adc_buses,
+		.p_addresses    = m_adc_addresses,
+		.adc_count      = m_adc_count,
+		.vref_uv        = LTC2497_VREF_UV,
+		.schedule       = ACQ_SCHEDULE_INTERLEAVED,
+		.ring_policy    = FRAME_RING_DROP_OLDEST,
+		.sample_handler = NULL,
+		.frame_handler  = acq_frame_handler,
+		.stream_handler = acq_stream_handler
 	};
 	
-	ltc2497_setup(ADC_ADDRESS_ONE, &setup);
-	ltc2497_setup(ADC_ADDRESS_TWO, &setup);
+	err_code = acq_init(&acq_init_params);
+	if (err_code != NRF_SUCCESS)
+	{
+		// Chip from the registry doesn't answer, so the bus is probed on the next boot
+		NRF_LOG_WARNING("ADC setup failed: %d", err_code);
+		(void)dev_registry_invalidate();
+	}
 	
     // Start execution.
     NRF_LOG_INFO("Template example started.");
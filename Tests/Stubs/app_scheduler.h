@@ -0,0 +1,22 @@
+/**
+ * @file
+ * app_scheduler.h
+ *
+ * @brief Host stub of the scheduler
+ *
+ * This file declares the scheduler of the SDK. The test defines it, so
+ * the queued events run from the simulated main loop.
+ *
+ */
+#pragma once
+
+#include <stdint.h>
+#include "sdk_errors.h"
+
+typedef void (*app_sched_event_handler_t)(void * p_event_data, uint16_t event_size);
+
+ret_code_t app_sched_event_put(void const * p_event_data, uint16_t event_size, app_sched_event_handler_t handler);
+
+void app_sched_execute(void);
+
+uint16_t app_sched_queue_utilization_get(void);
@@ -0,0 +1,22 @@
+/**
+ * @file
+ * app_util_platform.h
+ *
+ * @brief Host stub of the platform utilities
+ *
+ * This file defines interrupt priorities and critical regions. Simulated
+ * interrupts run one at a time and never preempt each other or the main
+ * loop, so critical region has nothing to hold off.
+ *
+ */
+#pragma once
+
+#include "sdk_common.h"
+
+#define APP_IRQ_PRIORITY_HIGH		2
+#define APP_IRQ_PRIORITY_MID		3
+#define APP_IRQ_PRIORITY_LOW		6
+#define APP_IRQ_PRIORITY_LOWEST		7
+
+#define CRITICAL_REGION_ENTER()		{
+#define CRITICAL_REGION_EXIT()		}
@@ -0,0 +1,21 @@
+/**
+ * @file
+ * nrf_atomic.h
+ *
+ * @brief Host stub of the SDK atomic operations
+ *
+ * This file implements the atomic operations used by the sources under
+ * test with the compiler builtins.
+ *
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef volatile uint32_t nrf_atomic_u32_t;
+
+static inline bool nrf_atomic_u32_cmp_exch(nrf_atomic_u32_t * p_data, uint32_t * p_expected, uint32_t desired)
+{
+	return __atomic_compare_exchange_n(p_data, p_expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
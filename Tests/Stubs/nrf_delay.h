@@ -0,0 +1,17 @@
+/**
+ * @file
+ * nrf_delay.h
+ *
+ * @brief Host stub of the busy-wait delays
+ *
+ * This file declares the delays, the test defines them, so it can tell
+ * when the code under test busy-waits.
+ *
+ */
+#pragma once
+
+#include <stdint.h>
+
+void nrf_delay_ms(uint32_t ms_time);
+
+void nrf_delay_us(uint32_t us_time);
@@ -0,0 +1,41 @@
+/**
+ * @file
+ * nrf_gpio.h
+ *
+ * @brief Host stub of the GPIO functions
+ *
+ * This file defines the GPIO functions used by the bus clearing. Pins
+ * aren't modelled, bus lines always read released.
+ *
+ */
+#pragma once
+
+#include <stdint.h>
+
+typedef enum { NRF_GPIO_PIN_DIR_INPUT, NRF_GPIO_PIN_DIR_OUTPUT } nrf_gpio_pin_dir_t;
+typedef enum { NRF_GPIO_PIN_INPUT_CONNECT, NRF_GPIO_PIN_INPUT_DISCONNECT } nrf_gpio_pin_input_t;
+typedef enum { NRF_GPIO_PIN_NOPULL, NRF_GPIO_PIN_PULLDOWN, NRF_GPIO_PIN_PULLUP = 3 } nrf_gpio_pin_pull_t;
+typedef enum { NRF_GPIO_PIN_S0S1, NRF_GPIO_PIN_S0D1 = 6 } nrf_gpio_pin_drive_t;
+typedef enum { NRF_GPIO_PIN_NOSENSE } nrf_gpio_pin_sense_t;
+
+static inline void nrf_gpio_cfg(uint32_t pin_number, nrf_gpio_pin_dir_t dir, nrf_gpio_pin_input_t input,
+								nrf_gpio_pin_pull_t pull, nrf_gpio_pin_drive_t drive, nrf_gpio_pin_sense_t sense)
+{
+	(void)pin_number; (void)dir; (void)input; (void)pull; (void)drive; (void)sense;
+}
+
+static inline void nrf_gpio_pin_set(uint32_t pin_number)
+{
+	(void)pin_number;
+}
+
+static inline void nrf_gpio_pin_clear(uint32_t pin_number)
+{
+	(void)pin_number;
+}
+
+static inline uint32_t nrf_gpio_pin_read(uint32_t pin_number)
+{
+	(void)pin_number;
+	return 1;
+}
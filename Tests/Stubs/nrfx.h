@@ -0,0 +1,30 @@
+/**
+ * @file
+ * nrfx.h
+ *
+ * @brief Host stub of the nrfx error codes
+ *
+ * This file defines the nrfx error codes with the values of the SDK, in
+ * which they equal the SDK error codes.
+ *
+ */
+#pragma once
+
+#include "sdk_common.h"
+
+typedef enum
+{
+	NRFX_SUCCESS					= NRF_SUCCESS,
+	NRFX_ERROR_INTERNAL				= NRF_ERROR_INTERNAL,
+	NRFX_ERROR_NO_MEM				= NRF_ERROR_NO_MEM,
+	NRFX_ERROR_NOT_SUPPORTED		= NRF_ERROR_NOT_SUPPORTED,
+	NRFX_ERROR_INVALID_PARAM		= NRF_ERROR_INVALID_PARAM,
+	NRFX_ERROR_INVALID_STATE		= NRF_ERROR_INVALID_STATE,
+	NRFX_ERROR_INVALID_LENGTH		= NRF_ERROR_INVALID_LENGTH,
+	NRFX_ERROR_TIMEOUT				= NRF_ERROR_TIMEOUT,
+	NRFX_ERROR_INVALID_ADDR			= NRF_ERROR_INVALID_ADDR,
+	NRFX_ERROR_BUSY					= NRF_ERROR_BUSY,
+	NRFX_ERROR_DRV_TWI_ERR_OVERRUN	= NRF_ERROR_DRV_TWI_ERR_OVERRUN,
+	NRFX_ERROR_DRV_TWI_ERR_ANACK	= NRF_ERROR_DRV_TWI_ERR_ANACK,
+	NRFX_ERROR_DRV_TWI_ERR_DNACK	= NRF_ERROR_DRV_TWI_ERR_DNACK
+} nrfx_err_t;
@@ -0,0 +1,24 @@
+/**
+ * @file
+ * nrfx_ppi.h
+ *
+ * @brief Host stub of the PPI driver
+ *
+ * This file declares the PPI driver API used by the stream mode. The
+ * test defines the functions.
+ *
+ */
+#pragma once
+
+#include <stdint.h>
+#include "nrfx.h"
+
+typedef enum { NRF_PPI_CHANNEL0 = 0 } nrf_ppi_channel_t;
+
+nrfx_err_t nrfx_ppi_channel_alloc(nrf_ppi_channel_t * p_channel);
+
+nrfx_err_t nrfx_ppi_channel_assign(nrf_ppi_channel_t channel, uint32_t eep, uint32_t tep);
+
+nrfx_err_t nrfx_ppi_channel_enable(nrf_ppi_channel_t channel);
+
+nrfx_err_t nrfx_ppi_channel_disable(nrf_ppi_channel_t channel);
@@ -0,0 +1,56 @@
+/**
+ * @file
+ * nrfx_timer.h
+ *
+ * @brief Host stub of the TIMER driver
+ *
+ * This file declares the TIMER driver API used by the stream mode. The
+ * test defines the functions.
+ *
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "nrfx.h"
+
+typedef enum { NRF_TIMER_FREQ_16MHz = 0, NRF_TIMER_FREQ_1MHz = 4 } nrf_timer_frequency_t;
+typedef enum { NRF_TIMER_MODE_TIMER = 0, NRF_TIMER_MODE_COUNTER } nrf_timer_mode_t;
+typedef enum { NRF_TIMER_BIT_WIDTH_16 = 0, NRF_TIMER_BIT_WIDTH_32 = 3 } nrf_timer_bit_width_t;
+typedef enum { NRF_TIMER_CC_CHANNEL0 = 0 } nrf_timer_cc_channel_t;
+typedef enum { NRF_TIMER_EVENT_COMPARE0 = 0x140 } nrf_timer_event_t;
+typedef enum { NRF_TIMER_SHORT_COMPARE0_CLEAR_MASK = 1 } nrf_timer_short_mask_t;
+
+typedef struct
+{
+	uint8_t					instance_id;
+} nrfx_timer_t;
+
+#define NRFX_TIMER_INSTANCE(id)		{ .instance_id = (id) }
+
+typedef struct
+{
+	nrf_timer_frequency_t	frequency;
+	nrf_timer_mode_t		mode;
+	nrf_timer_bit_width_t	bit_width;
+	uint8_t					interrupt_priority;
+	void *					p_context;
+} nrfx_timer_config_t;
+
+typedef void (*nrfx_timer_event_handler_t)(nrf_timer_event_t event_type, void * p_context);
+
+nrfx_err_t nrfx_timer_init(nrfx_timer_t const * p_instance, nrfx_timer_config_t const * p_config,
+						   nrfx_timer_event_handler_t timer_event_handler);
+
+void nrfx_timer_enable(nrfx_timer_t const * p_instance);
+
+void nrfx_timer_disable(nrfx_timer_t const * p_instance);
+
+void nrfx_timer_clear(nrfx_timer_t const * p_instance);
+
+void nrfx_timer_extended_compare(nrfx_timer_t const * p_instance, nrf_timer_cc_channel_t cc_channel, uint32_t cc_value,
+								 nrf_timer_short_mask_t timer_short_mask, bool enable_int);
+
+uint32_t nrfx_timer_us_to_ticks(nrfx_timer_t const * p_instance, uint32_t time_us);
+
+uint32_t nrfx_timer_compare_event_address_get(nrfx_timer_t const * p_instance, nrf_timer_cc_channel_t channel);
@@ -0,0 +1,129 @@
+/**
+ * @file
+ * nrfx_twim.h
+ *
+ * @brief Host stub of the TWIM driver
+ *
+ * This file declares the TWIM driver API used by the sources under test.
+ * Transfer descriptor and it's macros follow the SDK. Driver functions
+ * are defined by the test, e.g. by the simulated bus of sim.c, which
+ * finishes transfers by event later in simulated time.
+ *
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "nrfx.h"
+
+#define NRFX_TWIM_FLAG_TX_POSTINC			(1UL << 0)
+#define NRFX_TWIM_FLAG_RX_POSTINC			(1UL << 1)
+#define NRFX_TWIM_FLAG_NO_XFER_EVT_HANDLER	(1UL << 2)
+#define NRFX_TWIM_FLAG_HOLD_XFER			(1UL << 3)
+#define NRFX_TWIM_FLAG_REPEATED_XFER		(1UL << 4)
+#define NRFX_TWIM_FLAG_TX_NO_STOP			(1UL << 5)
+
+typedef enum
+{
+	NRFX_TWIM_XFER_TX,
+	NRFX_TWIM_XFER_RX,
+	NRFX_TWIM_XFER_TXRX,
+	NRFX_TWIM_XFER_TXTX
+} nrfx_twim_xfer_type_t;
+
+typedef struct
+{
+	nrfx_twim_xfer_type_t	type;
+	uint8_t					address;
+	size_t					primary_length;
+	size_t					secondary_length;
+	uint8_t *				p_primary_buf;
+	uint8_t *				p_secondary_buf;
+} nrfx_twim_xfer_desc_t;
+
+#define NRFX_TWIM_XFER_DESC(_type, _addr, _p_primary, _primary_length, _p_secondary, _secondary_length)	\
+	{																									\
+		.type             = (_type),																	\
+		.address          = (_addr),																	\
+		.primary_length   = (_primary_length),															\
+		.secondary_length = (_secondary_length),														\
+		.p_primary_buf    = (_p_primary),																\
+		.p_secondary_buf  = (_p_secondary),																\
+	}
+
+#define NRFX_TWIM_XFER_DESC_TX(_addr, _p_data, _length)													\
+	NRFX_TWIM_XFER_DESC(NRFX_TWIM_XFER_TX, _addr, _p_data, _length, NULL, 0)
+
+#define NRFX_TWIM_XFER_DESC_RX(_addr, _p_data, _length)													\
+	NRFX_TWIM_XFER_DESC(NRFX_TWIM_XFER_RX, _addr, _p_data, _length, NULL, 0)
+
+#define NRFX_TWIM_XFER_DESC_TXRX(_addr, _p_tx, _tx_len, _p_rx, _rx_len)									\
+	NRFX_TWIM_XFER_DESC(NRFX_TWIM_XFER_TXRX, _addr, _p_tx, _tx_len, _p_rx, _rx_len)
+
+typedef enum
+{
+	NRF_TWIM_FREQ_100K				= 0x01980000,
+	NRF_TWIM_FREQ_250K				= 0x04000000,
+	NRF_TWIM_FREQ_400K				= 0x06400000
+} nrf_twim_frequency_t;
+
+/**@brief TWIM registers, only the clock is kept. */
+typedef struct
+{
+	uint32_t				FREQUENCY;
+} NRF_TWIM_Type;
+
+extern NRF_TWIM_Type		g_nrf_twim[2];
+
+typedef struct
+{
+	NRF_TWIM_Type *			p_twim;
+	uint8_t					drv_inst_idx;
+} nrfx_twim_t;
+
+#define NRFX_TWIM_INSTANCE(id)											\
+	{																	\
+		.p_twim       = &g_nrf_twim[id],								\
+		.drv_inst_idx = (id),											\
+	}
+
+typedef struct
+{
+	uint32_t				scl;
+	uint32_t				sda;
+	nrf_twim_frequency_t	frequency;
+	uint8_t					interrupt_priority;
+	bool					hold_bus_uninit;
+} nrfx_twim_config_t;
+
+typedef enum
+{
+	NRFX_TWIM_EVT_DONE,
+	NRFX_TWIM_EVT_ADDRESS_NACK,
+	NRFX_TWIM_EVT_DATA_NACK
+} nrfx_twim_evt_type_t;
+
+typedef struct
+{
+	nrfx_twim_evt_type_t	type;
+	nrfx_twim_xfer_desc_t	xfer_desc;
+} nrfx_twim_evt_t;
+
+typedef void (*nrfx_twim_evt_handler_t)(nrfx_twim_evt_t const * p_event, void * p_context);
+
+static inline void nrf_twim_frequency_set(NRF_TWIM_Type * p_reg, nrf_twim_frequency_t frequency)
+{
+	p_reg->FREQUENCY = frequency;
+}
+
+nrfx_err_t nrfx_twim_init(nrfx_twim_t const * p_instance, nrfx_twim_config_t const * p_config,
+						  nrfx_twim_evt_handler_t event_handler, void * p_context);
+
+void nrfx_twim_uninit(nrfx_twim_t const * p_instance);
+
+void nrfx_twim_enable(nrfx_twim_t const * p_instance);
+
+nrfx_err_t nrfx_twim_xfer(nrfx_twim_t const * p_instance, nrfx_twim_xfer_desc_t const * p_xfer_desc, uint32_t flags);
+
+uint32_t nrfx_twim_start_task_get(nrfx_twim_t const * p_instance, nrfx_twim_xfer_type_t xfer_type);
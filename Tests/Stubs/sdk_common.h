@@ -0,0 +1,53 @@
+/**
+ * @file
+ * sdk_common.h
+ *
+ * @brief Host stub of the SDK common macros
+ *
+ * This file defines the subset of the SDK utility macros used by the
+ * sources under test. Memory barrier is a full compiler and processor
+ * fence, so the sources keep their ordering when the test runs producer
+ * and consumer in separate threads.
+ *
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include "sdk_errors.h"
+
+#define STATIC_ASSERT(_cond)			_Static_assert(_cond, #_cond)
+#define IS_POWER_OF_TWO(_a)				(((_a) != 0) && ((((_a) - 1) & (_a)) == 0))
+#define CONCAT_2(_a, _b)				CONCAT_2_(_a, _b)
+#define CONCAT_2_(_a, _b)				_a ## _b
+#define ARRAY_SIZE(_arr)				(sizeof(_arr) / sizeof((_arr)[0]))
+#define UNUSED_PARAMETER(_x)			(void)(_x)
+#define UNUSED_VARIABLE(_x)				(void)(_x)
+#define CEIL_DIV(_a, _b)				((((_a) - 1) / (_b)) + 1)
+#define ROUNDED_DIV(_a, _b)				(((_a) + ((_b) / 2)) / (_b))
+
+#ifndef MIN
+#define MIN(_a, _b)						((_a) < (_b) ? (_a) : (_b))
+#endif
+#ifndef MAX
+#define MAX(_a, _b)						((_a) < (_b) ? (_b) : (_a))
+#endif
+
+#define VERIFY_SUCCESS(_err)											\
+	do																	\
+	{																	\
+		ret_code_t _err_code = (_err);									\
+		if (_err_code != NRF_SUCCESS)									\
+			return _err_code;											\
+	} while (0)
+
+#define VERIFY_PARAM_NOT_NULL(_p)										\
+	do																	\
+	{																	\
+		if ((_p) == NULL)												\
+			return NRF_ERROR_NULL;										\
+	} while (0)
+
+#define __DMB()							__atomic_thread_fence(__ATOMIC_SEQ_CST)
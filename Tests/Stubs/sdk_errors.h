@@ -0,0 +1,35 @@
+/**
+ * @file
+ * sdk_errors.h
+ *
+ * @brief Host stub of the SDK error codes
+ *
+ * This file defines the error codes used by the sources under test with
+ * the values of the nRF5 SDK 15, so the host tests build the firmware
+ * sources unchanged.
+ *
+ */
+#pragma once
+
+#include <stdint.h>
+
+typedef uint32_t ret_code_t;
+
+#define NRF_SUCCESS						0
+#define NRF_ERROR_INTERNAL				3
+#define NRF_ERROR_NO_MEM				4
+#define NRF_ERROR_NOT_FOUND				5
+#define NRF_ERROR_NOT_SUPPORTED			6
+#define NRF_ERROR_INVALID_PARAM			7
+#define NRF_ERROR_INVALID_STATE			8
+#define NRF_ERROR_INVALID_LENGTH		9
+#define NRF_ERROR_DATA_SIZE				12
+#define NRF_ERROR_TIMEOUT				13
+#define NRF_ERROR_NULL					14
+#define NRF_ERROR_INVALID_ADDR			16
+#define NRF_ERROR_BUSY					17
+#define NRF_ERROR_RESOURCES				19
+
+#define NRF_ERROR_DRV_TWI_ERR_OVERRUN	0x8200
+#define NRF_ERROR_DRV_TWI_ERR_ANACK		0x8201
+#define NRF_ERROR_DRV_TWI_ERR_DNACK		0x8202
@@ -0,0 +1,241 @@
+/**
+ * @file
+ * bench_frame_codec.c
+ *
+ * @brief Host benchmark of the delta frame codec
+ *
+ * This file encodes a recording of glove frames the way the measurement
+ * service does it and reports compression ratio of the values, bytes on
+ * the link with packet headers against the raw frame encoding split into
+ * packets of the same size, and encode time per frame. Recording is
+ * a text file, one frame per line, 16 channel values in microvolts 
+ * separated by commas or spaces. Without the file, 750 ms frames of
+ * a hand are synthesized: fingers bend and rest in turns, every channel
+ * has few LSB of noise.
+ *
+ * Cycles are counted by the host time stamp counter, they show relative
+ * cost only. Encoder runs on the device the same code, so cycles of the
+ * device are taken by DWT around frame_encoder_part_encode() if needed.
+ *
+ * Build and run from the repository root:
+ *
+ *     gcc -O2 -Wall -Wextra -IInc Tests/bench_frame_codec.c Src/frame_codec.c -lm -o bench_frame_codec
+ *     ./bench_frame_codec [recording.csv]
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "frame_codec.h"
+
+#define BENCH_CHANNELS				16
+#define BENCH_FRAMES_MAX			100000
+#define BENCH_SYNTH_FRAMES			20000
+#define BENCH_REPEATS				20
+#define BENCH_LSB_UV				38			/**< Code LSB of 5 V reference, VREF/2^17 */
+#define BENCH_RAW_VALUE_LEN			3			/**< 24 bit value of the raw frame */
+#define BENCH_RAW_HEADER_LEN		5			/**< Sequence and timestamp of the raw frame */
+#define BENCH_PACKET_MAX			244
+
+
+static int32_t		m_values[BENCH_FRAMES_MAX][BENCH_CHANNELS];
+static uint32_t		m_frames;
+
+
+static uint64_t bench_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+#endif
+}
+
+static bool bench_load(char const * p_path)
+{
+	FILE * p_file = fopen(p_path, "r");
+	char   line[512];
+	
+	if (p_file == NULL)
+		return false;
+	
+	while (m_frames < BENCH_FRAMES_MAX && fgets(line, sizeof(line), p_file) != NULL)
+	{
+		char *  p_next = line;
+		uint8_t channel;
+		
+		for (channel = 0; channel < BENCH_CHANNELS; channel++)
+		{
+			char * p_end;
+			long   value = strtol(p_next, &p_end, 10);
+			
+			if (p_end == p_next)
+				break;
+			
+			m_values[m_frames][channel] = (int32_t)value;
+			p_next = p_end + strspn(p_end, ", \t");
+		}
+		
+		// Header and short lines are skipped
+		if (channel == BENCH_CHANNELS)
+			m_frames++;
+	}
+	
+	fclose(p_file);
+	
+	return m_frames > 0;
+}
+
+/**@brief Synthesizes hand frames: every finger bends and rests in turns,
+ *        two channels per finger joint move together. */
+static void bench_synthesize(void)
+{
+	uint32_t random = 1;
+	
+	for (m_frames = 0; m_frames < BENCH_SYNTH_FRAMES; m_frames++)
+	{
+		for (uint8_t channel = 0; channel < BENCH_CHANNELS; channel++)
+		{
+			uint8_t finger = channel / 4;
+			double  t      = m_frames * 0.75;
+			double  period = 20.0 + 7.0 * finger;
+			double  phase  = fmod(t + 3.0 * channel, period) / period;
+			
+			// Finger moves during a quarter of the period and rests otherwise
+			double  bend   = (phase < 0.25) ? 0.5 - 0.5 * cos(phase * 4.0 * M_PI) : 0.0;
+			int32_t offset = 150000 * (channel % 4) - 250000;
+			
+			random = random * 1103515245u + 12345u;
+			
+			m_values[m_frames][channel] = offset + (int32_t)(bend * 400000.0) +
+										  ((int32_t)((random >> 16) % 5) - 2) * BENCH_LSB_UV;
+		}
+	}
+}
+
+/**@brief Encodes the recording into packets of max_length bytes.
+ *
+ * @param[in]  max_length		packet size
+ * @param[out] p_stats			encoder statistics
+ * @param[out] p_packets		packets sent
+ * @param[out] p_bytes			bytes sent, headers included
+ *
+ * @retval		Cycles of all frames
+ */
+static uint64_t bench_encode(uint16_t max_length, frame_codec_stats_t * p_stats, uint32_t * p_packets, uint32_t * p_bytes)
+{
+	static frame_encoder_t	enc;
+	uint8_t					data[BENCH_PACKET_MAX];
+	uint64_t				cycles = 0;
+	
+	frame_encoder_init(&enc, BENCH_CHANNELS, FRAME_CODEC_KEYFRAME_INTERVAL);
+	*p_packets = 0;
+	*p_bytes   = 0;
+	
+	for (uint32_t i = 0; i < m_frames; i++)
+	{
+		frame_codec_frame_t const frame =
+		{
+			.sequence     = (uint16_t)i,
+			.timestamp    = i * 24576,
+			.channel_mask = (1u << BENCH_CHANNELS) - 1,
+			.p_values     = m_values[i]
+		};
+		
+		uint64_t start    = bench_cycles();
+		bool     keyframe = frame_encoder_keyframe_due(&enc);
+		uint8_t  channel  = 0;
+		uint8_t  part     = 0;
+		uint16_t length;
+		
+		while ((length = frame_encoder_part_encode(&enc, &frame, keyframe, part, &channel, data, max_length)) != 0)
+		{
+			frame_encoder_last_mark(data);
+			*p_bytes += length;
+			part++;
+		}
+		
+		frame_encoder_commit(&enc, &frame, keyframe);
+		cycles += bench_cycles() - start;
+		
+		*p_packets += part;
+	}
+	
+	*p_stats = enc.stats;
+	
+	return cycles;
+}
+
+/**@brief Returns bytes of the recording in raw frame encoding, every part
+ *        carries the header and the bitmap. */
+static uint32_t bench_raw_bytes(uint16_t max_length)
+{
+	uint32_t overhead = BENCH_RAW_HEADER_LEN + FRAME_CODEC_MASK_LEN(BENCH_CHANNELS);
+	uint32_t per_part = (max_length - overhead) / BENCH_RAW_VALUE_LEN;
+	uint32_t parts    = (BENCH_CHANNELS + per_part - 1) / per_part;
+	
+	return m_frames * (parts * overhead + BENCH_CHANNELS * BENCH_RAW_VALUE_LEN);
+}
+
+static void bench_run(uint16_t max_length)
+{
+	frame_codec_stats_t stats;
+	uint32_t            packets;
+	uint32_t            bytes;
+	uint64_t            best = UINT64_MAX;
+	
+	// Best of the repeats, so scheduling of the host doesn't count
+	for (uint32_t i = 0; i < BENCH_REPEATS; i++)
+	{
+		uint64_t cycles = bench_encode(max_length, &stats, &packets, &bytes);
+		
+		if (cycles < best)
+			best = cycles;
+	}
+	
+	uint32_t raw_bytes = bench_raw_bytes(max_length);
+	
+	printf("packet %3u: values %u -> %u bytes, ratio %.2f; link %u -> %u bytes in %u packets, ratio %.2f; "
+#if defined(__x86_64__) || defined(__i386__)
+		   "%.0f cycles per frame\n",
+#else
+		   "%.0f ns per frame\n",
+#endif
+		   max_length, stats.values * BENCH_RAW_VALUE_LEN, stats.value_bytes,
+		   (double)stats.values * BENCH_RAW_VALUE_LEN / stats.value_bytes,
+		   raw_bytes, bytes, packets, (double)raw_bytes / bytes, (double)best / m_frames);
+}
+
+int main(int argc, char ** argv)
+{
+	if (argc > 1)
+	{
+		if (!bench_load(argv[1]))
+		{
+			printf("%s: no frames\n", argv[1]);
+			return 1;
+		}
+		
+		printf("%s: %u frames of %u channels\n", argv[1], m_frames, BENCH_CHANNELS);
+	}
+	else
+	{
+		bench_synthesize();
+		printf("synthesized: %u frames of %u channels\n", m_frames, BENCH_CHANNELS);
+	}
+	
+	// Payload of the default and of the largest ATT MTU
+	bench_run(20);
+	bench_run(BENCH_PACKET_MAX);
+	
+	return 0;
+}
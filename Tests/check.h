@@ -0,0 +1,41 @@
+/**
+ * @file
+ * check.h
+ *
+ * @brief Checks of the host tests
+ *
+ * This file defines the check macro shared by the host tests. Failed
+ * check prints it's condition and location and is counted, the test
+ * goes on, so one run shows every failure. Test reports the result by
+ * check_result() at the end of main().
+ *
+ */
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define CHECK(_cond)																\
+	do																				\
+	{																				\
+		if (!(_cond))																\
+		{																			\
+			printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #_cond);		\
+			m_check_failures++;														\
+		}																			\
+	} while (0)
+
+static uint32_t m_check_failures;			/**< Failed checks of the test */
+
+
+/**
+  * @brief  Prints result of the test.
+  *
+  * @retval		Exit code of the test, 0 if no check has failed
+  */
+static inline int check_result(void)
+{
+	printf("%s\n", m_check_failures ? "FAILED" : "OK");
+	
+	return m_check_failures ? 1 : 0;
+}
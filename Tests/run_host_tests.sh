@@ -0,0 +1,29 @@
+#!/bin/sh
+#
+# Builds the host tests with the stub SDK headers of Tests/Stubs and runs
+# them. Run from anywhere, binaries are built in a temporary directory.
+#
+
+set -e
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+OUT=$(mktemp -d)
+CFLAGS="-O2 -Wall -Wextra -Werror -I$ROOT/Tests/Stubs -I$ROOT/Inc"
+
+trap 'rm -rf "$OUT"' EXIT
+
+gcc $CFLAGS "$ROOT/Tests/test_ltc2497_decode.c" "$ROOT/Src/LTC2497.c" -o "$OUT/test_ltc2497_decode"
+"$OUT/test_ltc2497_decode"
+
+gcc $CFLAGS -pthread -Wl,--wrap=memcpy "$ROOT/Tests/test_frame_ring.c" "$ROOT/Src/frame_ring.c" -o "$OUT/test_frame_ring"
+"$OUT/test_frame_ring"
+
+gcc $CFLAGS "$ROOT/Tests/test_frame_codec.c" "$ROOT/Src/frame_codec.c" -o "$OUT/test_frame_codec"
+"$OUT/test_frame_codec"
+
+gcc $CFLAGS "$ROOT/Tests/bench_frame_codec.c" "$ROOT/Src/frame_codec.c" -lm -o "$OUT/bench_frame_codec"
+"$OUT/bench_frame_codec"
+
+gcc $CFLAGS -Wl,--wrap=twi_perform "$ROOT/Tests/test_acquisition.c" "$ROOT/Tests/sim.c" "$ROOT/Src/acquisition.c" \
+	"$ROOT/Src/LTC2497.c" "$ROOT/Src/i2c.c" "$ROOT/Src/frame_ring.c" -o "$OUT/test_acquisition"
+"$OUT/test_acquisition"
@@ -0,0 +1,696 @@
+/**
+ * @file
+ * sim.c
+ *
+ * @brief Simulated SDK environment of the host tests
+ *
+ * This file contains implementations of functions declared in sim.h and
+ * the SDK functions the sources under test call. Application timer runs
+ * on simulated 32768 Hz counter. TWIM transfer takes the time of it's
+ * bits at the bus clock, chip state changes when the transfer finishes,
+ * as the conversion is started by the stop condition. Stream mode isn't
+ * simulated, TIMER and PPI can't be allocated.
+ *
+ */
+
+#include <string.h>
+#include <time.h>
+#include "sim.h"
+#include "app_timer.h"
+#include "app_scheduler.h"
+#include "nrf_delay.h"
+#include "nrfx_twim.h"
+#include "nrfx_timer.h"
+#include "nrfx_ppi.h"
+#include "i2c.h"
+#include "LTC2497.h"
+
+#define SIM_BUS_COUNT				2
+#define SIM_TIMER_MAX				16
+#define SIM_SCHED_QUEUE_SIZE		8			/**< As SCHED_QUEUE_SIZE of main.c */
+#define SIM_SCHED_DATA_SIZE			12			/**< As SCHED_MAX_EVENT_DATA_SIZE of main.c */
+#define SIM_CHANNEL_TEMP			0xFF		/**< Temperature sensor is converted */
+
+#define SIM_SELECT_PREAMBLE_MASK	0xE0		/**< Preamble and enable bits of the select byte */
+#define SIM_SELECT_PREAMBLE			0xA0
+#define SIM_SELECT_CHANNEL_MASK		0x07
+#define SIM_SETUP_ENABLE			0x80
+#define SIM_SETUP_TEMP				0x40
+#define SIM_SETUP_2X				0x08
+
+/**@brief LTC2497 chip. */
+typedef struct
+{
+	uint8_t					bus;
+	uint8_t					address;
+	uint32_t				vref_uv;
+	bool					present;
+	uint64_t				ready_us;			/**< Conversion in progress is finished at */
+	uint8_t					select;				/**< Channel of the next conversion */
+	uint8_t					setup;				/**< Setup byte of the next conversion */
+	uint8_t					converted;			/**< Channel of the last conversion */
+} sim_adc_t;
+
+/**@brief TWIM peripheral with the transfer in progress. */
+typedef struct
+{
+	nrfx_twim_evt_handler_t	handler;
+	void *					p_context;
+	bool					busy;
+	uint64_t				done_us;			/**< Transfer in progress is finished at */
+	nrfx_twim_xfer_desc_t	xfer;
+	uint32_t				flags;
+	sim_adc_t *				p_adc;				/**< Chip which has acknowledged the transfer, NULL on NACK */
+} sim_bus_t;
+
+/**@brief Scheduler event. */
+typedef struct
+{
+	app_sched_event_handler_t	handler;
+	uint16_t				size;
+	uint8_t					data[SIM_SCHED_DATA_SIZE];
+} sim_event_t;
+
+/**@brief Result of transfer waited for by twi_perform(). */
+typedef struct
+{
+	bool					done;
+	ret_code_t				result;
+} sim_perform_t;
+
+NRF_TWIM_Type				g_nrf_twim[SIM_BUS_COUNT];
+
+static uint64_t				m_now_us;
+static bool					m_in_interrupt;
+static sim_stats_t			m_stats;
+
+static sim_adc_t			m_adcs[SIM_ADC_MAX];
+static uint8_t				m_adc_count;
+static sim_bus_t			m_buses[SIM_BUS_COUNT];
+
+static app_timer_t *		m_timers[SIM_TIMER_MAX];
+static uint8_t				m_timer_count;
+
+static sim_event_t			m_events[SIM_SCHED_QUEUE_SIZE];
+static uint8_t				m_event_head;
+static uint8_t				m_event_count;
+static uint16_t				m_event_peak;
+
+
+static uint64_t sim_ticks(uint64_t time_us)
+{
+	return time_us * APP_TIMER_CLOCK_FREQ / 1000000;
+}
+
+/**@brief Returns time of the counter tick, rounded up. */
+static uint64_t sim_tick_time_us(uint64_t ticks)
+{
+	return (ticks * 1000000 + APP_TIMER_CLOCK_FREQ - 1) / APP_TIMER_CLOCK_FREQ;
+}
+
+/**@brief Returns CPU time of the host thread, so the handler isn't charged 
+ *        with the time the host has preempted it. */
+static uint64_t sim_host_ns(void)
+{
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static uint32_t sim_bus_hz(uint8_t bus)
+{
+	switch (g_nrf_twim[bus].FREQUENCY)
+	{
+	case NRF_TWIM_FREQ_400K:
+		return 400000;
+		
+	case NRF_TWIM_FREQ_250K:
+		return 250000;
+		
+	default:
+		return 100000;
+	}
+}
+
+static sim_adc_t * sim_adc_find(uint8_t bus, uint8_t address)
+{
+	for (uint8_t i = 0; i < m_adc_count; i++)
+	{
+		if (m_adcs[i].bus == bus && m_adcs[i].address == address)
+			return &m_adcs[i];
+	}
+	
+	return NULL;
+}
+
+/**@brief Writes result of the last conversion in the chip format: inverted
+ *        sign bit, 17 bit value, 6 sub-LSB bits. */
+static void sim_result_put(sim_adc_t const * p_adc, uint8_t * p_data, size_t length)
+{
+	uint8_t index  = (uint8_t)(p_adc - m_adcs);
+	int64_t uv     = (p_adc->converted == SIM_CHANNEL_TEMP) ? (int64_t)(SIM_TEMP_K + index) * LTC2497_TEMP_UV_PER_K
+															: sim_input_uv(index, p_adc->converted);
+	int64_t scaled = uv * 2 * LTC2497_CODE_FULL_SCALE;
+	int64_t half   = p_adc->vref_uv / 2;
+	int64_t code   = ((scaled >= 0) ? scaled + half : scaled - half) / (int64_t)p_adc->vref_uv;
+	uint8_t raw[LTC2497_DATA_LENGTH];
+	
+	// Out of range input gives the range codes
+	code = MIN(MAX(code, -LTC2497_CODE_FULL_SCALE - 1), LTC2497_CODE_FULL_SCALE);
+	
+	uint32_t word = (((uint32_t)code << LTC2497_DATA_SUB_LSB_BITS) & 0xFFFFC0) ^ LTC2497_DATA_SIG_BIT;
+	
+	raw[0] = (uint8_t)(word >> 16);
+	raw[1] = (uint8_t)(word >> 8);
+	raw[2] = (uint8_t)word;
+	raw[3] = 0;
+	
+	memcpy(p_data, raw, MIN(length, sizeof(raw)));
+}
+
+/**@brief Changes chip state by finished transfer. Data read is the result of
+ *        the last conversion, stop condition starts the next one. */
+static void sim_adc_xfer(sim_adc_t * p_adc, nrfx_twim_xfer_desc_t const * p_xfer, uint32_t flags)
+{
+	uint8_t const * p_tx   = NULL;
+	size_t          tx_len = 0;
+	
+	switch (p_xfer->type)
+	{
+	case NRFX_TWIM_XFER_TX:
+		p_tx   = p_xfer->p_primary_buf;
+		tx_len = p_xfer->primary_length;
+		break;
+		
+	case NRFX_TWIM_XFER_RX:
+		sim_result_put(p_adc, p_xfer->p_primary_buf, p_xfer->primary_length);
+		break;
+		
+	case NRFX_TWIM_XFER_TXRX:
+		p_tx   = p_xfer->p_primary_buf;
+		tx_len = p_xfer->primary_length;
+		sim_result_put(p_adc, p_xfer->p_secondary_buf, p_xfer->secondary_length);
+		break;
+		
+	default:
+		break;
+	}
+	
+	if (tx_len > 0 && (p_tx[0] & SIM_SELECT_PREAMBLE_MASK) == SIM_SELECT_PREAMBLE)
+	{
+		p_adc->select = p_tx[0] & SIM_SELECT_CHANNEL_MASK;
+		
+		// Setup byte without enable bit keeps the setup
+		if (tx_len > 1 && (p_tx[1] & SIM_SETUP_ENABLE))
+			p_adc->setup = p_tx[1];
+	}
+	
+	if (p_xfer->type == NRFX_TWIM_XFER_TX && (flags & NRFX_TWIM_FLAG_TX_NO_STOP))
+		return;
+	
+	// Temperature sensor replaces the inputs while it's selected
+	p_adc->converted = (p_adc->setup & SIM_SETUP_TEMP) ? SIM_CHANNEL_TEMP : p_adc->select;
+	p_adc->ready_us  = m_now_us + ((p_adc->setup & SIM_SETUP_2X) ? SIM_CONVERSION_2X_US : SIM_CONVERSION_1X_US);
+}
+
+/**@brief Finds the next interrupt due not later than limit. */
+static bool sim_next_get(uint64_t limit_us, app_timer_t ** pp_timer, sim_bus_t ** pp_bus, uint64_t * p_time_us)
+{
+	uint64_t next = UINT64_MAX;
+	
+	*pp_timer = NULL;
+	*pp_bus   = NULL;
+	
+	for (uint8_t i = 0; i < m_timer_count; i++)
+	{
+		uint64_t time_us = sim_tick_time_us(m_timers[i]->expiry);
+		
+		if (m_timers[i]->active && time_us < next)
+		{
+			next      = time_us;
+			*pp_timer = m_timers[i];
+		}
+	}
+	
+	for (uint8_t bus = 0; bus < SIM_BUS_COUNT; bus++)
+	{
+		if (m_buses[bus].busy && m_buses[bus].done_us < next)
+		{
+			next      = m_buses[bus].done_us;
+			*pp_timer = NULL;
+			*pp_bus   = &m_buses[bus];
+		}
+	}
+	
+	*p_time_us = next;
+	
+	return next <= limit_us;
+}
+
+/**@brief Runs the next interrupt due not later than limit. */
+static bool sim_step(uint64_t limit_us)
+{
+	app_timer_t * p_timer;
+	sim_bus_t *   p_bus;
+	uint64_t      time_us;
+	bool          outer = m_in_interrupt;
+	
+	if (!sim_next_get(limit_us, &p_timer, &p_bus, &time_us))
+		return false;
+	
+	if (time_us > m_now_us)
+		m_now_us = time_us;
+	
+	m_in_interrupt = true;
+	uint64_t start = sim_host_ns();
+	
+	if (p_timer != NULL)
+	{
+		if (p_timer->mode == APP_TIMER_MODE_REPEATED)
+			p_timer->expiry += p_timer->period;
+		else
+			p_timer->active = false;
+		
+		p_timer->handler(p_timer->p_context);
+	}
+	else
+	{
+		nrfx_twim_evt_t event =
+		{
+			.type      = (p_bus->p_adc != NULL) ? NRFX_TWIM_EVT_DONE : NRFX_TWIM_EVT_ADDRESS_NACK,
+			.xfer_desc = p_bus->xfer
+		};
+		
+		p_bus->busy = false;
+		m_stats.transfers++;
+		
+		if (p_bus->p_adc != NULL)
+			sim_adc_xfer(p_bus->p_adc, &p_bus->xfer, p_bus->flags);
+		else
+			m_stats.nacks++;
+		
+		if (p_bus->handler != NULL)
+			p_bus->handler(&event, p_bus->p_context);
+	}
+	
+	uint64_t elapsed = sim_host_ns() - start;
+	
+	m_in_interrupt = outer;
+	
+	if (!outer)
+	{
+		m_stats.interrupts++;
+		m_stats.interrupt_ns_total += elapsed;
+		if (elapsed > m_stats.interrupt_ns_max)
+			m_stats.interrupt_ns_max = (uint32_t)elapsed;
+	}
+	
+	return true;
+}
+
+/**@brief Busy-waits: interrupts go on, main loop doesn't run. */
+static void sim_busy_wait(uint64_t until_us)
+{
+	uint64_t start = m_now_us;
+	
+	if (m_in_interrupt)
+		m_stats.nested_waits++;
+	
+	while (sim_step(until_us))
+	{
+	}
+	
+	if (until_us > m_now_us)
+		m_now_us = until_us;
+	
+	m_stats.busy_wait_us += m_now_us - start;
+}
+
+void sim_init(void)
+{
+	memset(m_adcs, 0, sizeof(m_adcs));
+	memset(m_buses, 0, sizeof(m_buses));
+	memset(&m_stats, 0, sizeof(m_stats));
+	
+	m_now_us       = 0;
+	m_adc_count    = 0;
+	m_timer_count  = 0;
+	m_event_head   = 0;
+	m_event_count  = 0;
+	m_event_peak   = 0;
+	m_in_interrupt = false;
+}
+
+void sim_adc_add(uint8_t bus, uint8_t address, uint32_t vref_uv)
+{
+	sim_adc_t * p_adc = &m_adcs[m_adc_count++];
+	
+	p_adc->bus       = bus;
+	p_adc->address   = address;
+	p_adc->vref_uv   = vref_uv;
+	p_adc->present   = true;
+	p_adc->ready_us  = 0;
+	p_adc->select    = 0;
+	p_adc->setup     = SIM_SETUP_ENABLE;
+	p_adc->converted = 0;
+}
+
+void sim_adc_present_set(uint8_t index, bool present)
+{
+	m_adcs[index].present = present;
+}
+
+int32_t sim_input_uv(uint8_t index, uint8_t channel)
+{
+	// Distinct voltage of every channel, negative and positive
+	return (index * SIM_CHANNELS_PER_ADC + channel + 1) * 100000 - 800000;
+}
+
+void sim_run(uint64_t duration_us)
+{
+	uint64_t end_us = m_now_us + duration_us;
+	
+	app_sched_execute();
+	
+	while (sim_step(end_us))
+		app_sched_execute();
+	
+	m_now_us = end_us;
+}
+
+uint64_t sim_time_us(void)
+{
+	return m_now_us;
+}
+
+void sim_stats_get(sim_stats_t * p_stats)
+{
+	*p_stats = m_stats;
+}
+
+void sim_stats_clear(void)
+{
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+
+/**@brief Waits for the transfer by running the interrupts, see sim.h. */
+static void sim_perform_callback(ret_code_t result, void * p_context)
+{
+	sim_perform_t * p_status = (sim_perform_t *)p_context;
+	
+	p_status->result = result;
+	p_status->done   = true;
+}
+
+ret_code_t __wrap_twi_perform(twi_transaction_t const * p_transaction)
+{
+	sim_perform_t     status      = { .done = false, .result = NRF_SUCCESS };
+	twi_transaction_t transaction = *p_transaction;
+	uint64_t          start       = m_now_us;
+	
+	transaction.callback  = sim_perform_callback;
+	transaction.p_context = &status;
+	
+	m_stats.blocking_transfers++;
+	if (m_in_interrupt)
+		m_stats.nested_waits++;
+	
+	ret_code_t err_code = twi_schedule(&transaction);
+	if (err_code != NRF_SUCCESS)
+		return err_code;
+	
+	while (!status.done && sim_step(UINT64_MAX))
+	{
+	}
+	
+	m_stats.busy_wait_us += m_now_us - start;
+	
+	return status.done ? status.result : NRF_ERROR_TIMEOUT;
+}
+
+void nrf_delay_ms(uint32_t ms_time)
+{
+	sim_busy_wait(m_now_us + (uint64_t)ms_time * 1000);
+}
+
+void nrf_delay_us(uint32_t us_time)
+{
+	sim_busy_wait(m_now_us + us_time);
+}
+
+ret_code_t app_timer_create(app_timer_id_t const * p_timer_id, app_timer_mode_t mode,
+							app_timer_timeout_handler_t timeout_handler)
+{
+	app_timer_t * p_timer = *p_timer_id;
+	
+	if (timeout_handler == NULL)
+		return NRF_ERROR_INVALID_PARAM;
+	
+	p_timer->handler = timeout_handler;
+	p_timer->mode    = mode;
+	p_timer->active  = false;
+	
+	for (uint8_t i = 0; i < m_timer_count; i++)
+	{
+		if (m_timers[i] == p_timer)
+			return NRF_SUCCESS;
+	}
+	
+	if (m_timer_count == SIM_TIMER_MAX)
+		return NRF_ERROR_NO_MEM;
+	
+	m_timers[m_timer_count++] = p_timer;
+	
+	return NRF_SUCCESS;
+}
+
+ret_code_t app_timer_start(app_timer_id_t timer_id, uint32_t timeout_ticks, void * p_context)
+{
+	if (timeout_ticks < APP_TIMER_MIN_TIMEOUT_TICKS || timeout_ticks > APP_TIMER_MAX_CNT_VAL)
+		return NRF_ERROR_INVALID_PARAM;
+	
+	if (timer_id->handler == NULL)
+		return NRF_ERROR_INVALID_STATE;
+	
+	// Start of the running timer is ignored, as in the SDK
+	if (timer_id->active)
+		return NRF_SUCCESS;
+	
+	timer_id->expiry    = sim_ticks(m_now_us) + timeout_ticks;
+	timer_id->period    = timeout_ticks;
+	timer_id->p_context = p_context;
+	timer_id->active    = true;
+	
+	return NRF_SUCCESS;
+}
+
+ret_code_t app_timer_stop(app_timer_id_t timer_id)
+{
+	timer_id->active = false;
+	
+	return NRF_SUCCESS;
+}
+
+uint32_t app_timer_cnt_get(void)
+{
+	return (uint32_t)sim_ticks(m_now_us) & APP_TIMER_MAX_CNT_VAL;
+}
+
+uint32_t app_timer_cnt_diff_compute(uint32_t ticks_to, uint32_t ticks_from)
+{
+	return (ticks_to - ticks_from) & APP_TIMER_MAX_CNT_VAL;
+}
+
+ret_code_t app_sched_event_put(void const * p_event_data, uint16_t event_size, app_sched_event_handler_t handler)
+{
+	if (event_size > SIM_SCHED_DATA_SIZE)
+		return NRF_ERROR_INVALID_LENGTH;
+	
+	if (m_event_count == SIM_SCHED_QUEUE_SIZE)
+		return NRF_ERROR_NO_MEM;
+	
+	sim_event_t * p_event = &m_events[(m_event_head + m_event_count) % SIM_SCHED_QUEUE_SIZE];
+	
+	p_event->handler = handler;
+	p_event->size    = event_size;
+	if (p_event_data != NULL && event_size > 0)
+		memcpy(p_event->data, p_event_data, event_size);
+	
+	if (++m_event_count > m_event_peak)
+		m_event_peak = m_event_count;
+	
+	return NRF_SUCCESS;
+}
+
+void app_sched_execute(void)
+{
+	while (m_event_count > 0)
+	{
+		sim_event_t event = m_events[m_event_head];
+		
+		m_event_head = (m_event_head + 1) % SIM_SCHED_QUEUE_SIZE;
+		m_event_count--;
+		m_stats.main_events++;
+		
+		event.handler((event.size > 0) ? event.data : NULL, event.size);
+	}
+}
+
+uint16_t app_sched_queue_utilization_get(void)
+{
+	return m_event_peak;
+}
+
+nrfx_err_t nrfx_twim_init(nrfx_twim_t const * p_instance, nrfx_twim_config_t const * p_config,
+						  nrfx_twim_evt_handler_t event_handler, void * p_context)
+{
+	sim_bus_t * p_bus = &m_buses[p_instance->drv_inst_idx];
+	
+	p_bus->handler   = event_handler;
+	p_bus->p_context = p_context;
+	p_bus->busy      = false;
+	
+	nrf_twim_frequency_set(p_instance->p_twim, p_config->frequency);
+	
+	return NRFX_SUCCESS;
+}
+
+void nrfx_twim_uninit(nrfx_twim_t const * p_instance)
+{
+	sim_bus_t * p_bus = &m_buses[p_instance->drv_inst_idx];
+	
+	// Transfer in progress is cut off without event
+	p_bus->handler = NULL;
+	p_bus->busy    = false;
+}
+
+void nrfx_twim_enable(nrfx_twim_t const * p_instance)
+{
+	UNUSED_PARAMETER(p_instance);
+}
+
+nrfx_err_t nrfx_twim_xfer(nrfx_twim_t const * p_instance, nrfx_twim_xfer_desc_t const * p_xfer_desc, uint32_t flags)
+{
+	uint8_t     bus   = p_instance->drv_inst_idx;
+	sim_bus_t * p_bus = &m_buses[bus];
+	sim_adc_t * p_adc = sim_adc_find(bus, p_xfer_desc->address);
+	uint32_t    bytes = 1;
+	
+	if (p_bus->busy)
+		return NRFX_ERROR_BUSY;
+	
+	if (flags & NRFX_TWIM_FLAG_HOLD_XFER)
+		return NRFX_ERROR_NOT_SUPPORTED;
+	
+	// Chip converting doesn't acknowledge it's address, transfer ends there
+	if (p_adc != NULL && (!p_adc->present || m_now_us < p_adc->ready_us))
+		p_adc = NULL;
+	
+	if (p_adc != NULL)
+	{
+		bytes += p_xfer_desc->primary_length;
+		
+		if (p_xfer_desc->type == NRFX_TWIM_XFER_TXRX)
+			bytes += 1 + p_xfer_desc->secondary_length;
+	}
+	
+	// 9 clocks per byte, start and stop condition
+	uint32_t bits = 9 * bytes + 2;
+	
+	p_bus->busy    = true;
+	p_bus->done_us = m_now_us + (bits * 1000000 + sim_bus_hz(bus) - 1) / sim_bus_hz(bus) + SIM_XFER_OVERHEAD_US;
+	p_bus->xfer    = *p_xfer_desc;
+	p_bus->flags   = flags;
+	p_bus->p_adc   = p_adc;
+	
+	return NRFX_SUCCESS;
+}
+
+uint32_t nrfx_twim_start_task_get(nrfx_twim_t const * p_instance, nrfx_twim_xfer_type_t xfer_type)
+{
+	UNUSED_PARAMETER(p_instance);
+	UNUSED_PARAMETER(xfer_type);
+	
+	return 0;
+}
+
+nrfx_err_t nrfx_timer_init(nrfx_timer_t const * p_instance, nrfx_timer_config_t const * p_config,
+						   nrfx_timer_event_handler_t timer_event_handler)
+{
+	UNUSED_PARAMETER(p_instance);
+	UNUSED_PARAMETER(p_config);
+	UNUSED_PARAMETER(timer_event_handler);
+	
+	return NRFX_ERROR_NOT_SUPPORTED;
+}
+
+void nrfx_timer_enable(nrfx_timer_t const * p_instance)
+{
+	UNUSED_PARAMETER(p_instance);
+}
+
+void nrfx_timer_disable(nrfx_timer_t const * p_instance)
+{
+	UNUSED_PARAMETER(p_instance);
+}
+
+void nrfx_timer_clear(nrfx_timer_t const * p_instance)
+{
+	UNUSED_PARAMETER(p_instance);
+}
+
+void nrfx_timer_extended_compare(nrfx_timer_t const * p_instance, nrf_timer_cc_channel_t cc_channel, uint32_t cc_value,
+								 nrf_timer_short_mask_t timer_short_mask, bool enable_int)
+{
+	UNUSED_PARAMETER(p_instance);
+	UNUSED_PARAMETER(cc_channel);
+	UNUSED_PARAMETER(cc_value);
+	UNUSED_PARAMETER(timer_short_mask);
+	UNUSED_PARAMETER(enable_int);
+}
+
+uint32_t nrfx_timer_us_to_ticks(nrfx_timer_t const * p_instance, uint32_t time_us)
+{
+	UNUSED_PARAMETER(p_instance);
+	
+	return time_us;
+}
+
+uint32_t nrfx_timer_compare_event_address_get(nrfx_timer_t const * p_instance, nrf_timer_cc_channel_t channel)
+{
+	UNUSED_PARAMETER(p_instance);
+	UNUSED_PARAMETER(channel);
+	
+	return 0;
+}
+
+nrfx_err_t nrfx_ppi_channel_alloc(nrf_ppi_channel_t * p_channel)
+{
+	UNUSED_PARAMETER(p_channel);
+	
+	return NRFX_ERROR_NO_MEM;
+}
+
+nrfx_err_t nrfx_ppi_channel_assign(nrf_ppi_channel_t channel, uint32_t eep, uint32_t tep)
+{
+	UNUSED_PARAMETER(channel);
+	UNUSED_PARAMETER(eep);
+	UNUSED_PARAMETER(tep);
+	
+	return NRFX_ERROR_INVALID_STATE;
+}
+
+nrfx_err_t nrfx_ppi_channel_enable(nrf_ppi_channel_t channel)
+{
+	UNUSED_PARAMETER(channel);
+	
+	return NRFX_ERROR_INVALID_STATE;
+}
+
+nrfx_err_t nrfx_ppi_channel_disable(nrf_ppi_channel_t channel)
+{
+	UNUSED_PARAMETER(channel);
+	
+	return NRFX_ERROR_INVALID_STATE;
+}
@@ -0,0 +1,117 @@
+/**
+ * @file
+ * sim.h
+ *
+ * @brief Simulated SDK environment of the host tests
+ *
+ * This file declares discrete event simulation of the parts of the chip
+ * and of the SDK the acquisition engine runs on: application timer, TWIM
+ * driver with LTC2497 chips on the bus, app_scheduler and busy-wait
+ * delays. Time is simulated, it advances only when the next interrupt
+ * is due, so a minute of scan takes milliseconds of the host.
+ *
+ * Timer and TWIM events are run as interrupts, one at a time, queued
+ * scheduler events are run as main loop between them. Host CPU time of
+ * every interrupt handler is measured, and every busy-wait is counted,
+ * so the test can show that no handler waits for the bus or for the
+ * conversion.
+ *
+ * Chip model follows the LTC2497 datasheet: chip doesn't acknowledge
+ * it's address while converting, stop condition starts the conversion
+ * of the channel selected, read returns result of the conversion
+ * finished. Every channel has fixed input voltage, temperature sensor
+ * reads SIM_TEMP_K plus chip index.
+ *
+ * twi_perform() loops until the transfer interrupt, which can't happen
+ * in simulation, so the tests link with -Wl,--wrap=twi_perform: the
+ * wrapper runs the interrupts until the transfer is finished and counts
+ * the time as busy-wait, like nrf_delay_ms() does.
+ *
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SIM_ADC_MAX					8
+#define SIM_CHANNELS_PER_ADC		8
+#define SIM_TEMP_K					300			/**< Temperature read by the sensor of the first chip */
+#define SIM_CONVERSION_1X_US		147000		/**< Conversion time of the chip, 1X speed */
+#define SIM_CONVERSION_2X_US		73500		/**< Conversion time of the chip, 2X speed */
+#define SIM_XFER_OVERHEAD_US		10			/**< Driver latency of every transfer */
+
+
+/**@brief Simulation statistics. */
+typedef struct
+{
+	uint32_t		interrupts;				/**< Timer and TWIM handlers run */
+	uint64_t		interrupt_ns_total;		/**< Host time of the handlers */
+	uint32_t		interrupt_ns_max;		/**< Host time of the longest handler */
+	uint32_t		main_events;			/**< Scheduler events run */
+	uint32_t		transfers;				/**< Transfers finished on all buses */
+	uint32_t		nacks;					/**< Transfers not acknowledged by the chip */
+	uint32_t		blocking_transfers;		/**< Transfers waited for by twi_perform() */
+	uint64_t		busy_wait_us;			/**< Simulated time spent in twi_perform() and delays */
+	uint32_t		nested_waits;			/**< Busy-waits called from interrupt, deadlock on the device */
+} sim_stats_t;
+
+
+/**
+  * @brief  Resets simulated time, timers, scheduler, buses and chips.
+  */
+void sim_init(void);
+
+/**
+  * @brief  Connects LTC2497 chip to the bus. Inputs are set to distinct
+  *         voltages, see sim_input_uv().
+  *
+  * @param[in]  bus			bus index
+  * @param[in]  address		I2C address
+  * @param[in]  vref_uv		reference voltage, microvolts
+  */
+void sim_adc_add(uint8_t bus, uint8_t address, uint32_t vref_uv);
+
+/**
+  * @brief  Connects or disconnects the chip, disconnected chip doesn't
+  *         acknowledge it's address.
+  *
+  * @param[in]  index		chip index, in order of sim_adc_add()
+  * @param[in]  present		chip is connected
+  */
+void sim_adc_present_set(uint8_t index, bool present);
+
+/**
+  * @brief  Returns input voltage of the channel of the chip.
+  *
+  * @param[in]  index		chip index, in order of sim_adc_add()
+  * @param[in]  channel		chip channel
+  *
+  * @retval		Input voltage, microvolts
+  */
+int32_t sim_input_uv(uint8_t index, uint8_t channel);
+
+/**
+  * @brief  Runs interrupts and main loop for the given simulated time.
+  *
+  * @param[in]  duration_us	simulated time
+  */
+void sim_run(uint64_t duration_us);
+
+/**
+  * @brief  Returns simulated time since sim_init().
+  *
+  * @retval		Time, microseconds
+  */
+uint64_t sim_time_us(void);
+
+/**
+  * @brief  Gets simulation statistics.
+  *
+  * @param[out] p_stats		statistics
+  */
+void sim_stats_get(sim_stats_t * p_stats);
+
+/**
+  * @brief  Clears simulation statistics.
+  */
+void sim_stats_clear(void);
@@ -0,0 +1,376 @@
+/**
+ * @file
+ * test_acquisition.c
+ *
+ * @brief Host test of the acquisition engine on mocked TWI
+ *
+ * This file runs the acquisition engine, I2C library and LTC2497 library
+ * of the firmware on the simulated TWIM driver and chips of sim.c. It
+ * checks that:
+ *
+ * - every channel of every frame carries the voltage of it's own input,
+ *   so the pipelined read and select tags results right
+ * - no handler busy-waits: no transfer is waited for and no delay is
+ *   called after the init, handler time is bounded
+ * - frame interval of acq_sweep_time_ms() is never overrun
+ * - interleaved schedule gives about twice the samples per second of the
+ *   sequential one, both are printed for 1X and 2X speed. With n channels
+ *   per chip it's 2n/(n+1) at best, as interleaved sweep waits for the
+ *   conversion started by the last read of the previous one
+ * - chip which stops answering is degraded after ACQ_DEGRADE_ERRORS
+ *   frames without affecting the other chip, and is restored by the
+ *   probe frame when it's back
+ *
+ * Every case runs in it's own process, as the modules keep static state.
+ *
+ * Build and run from the repository root:
+ *
+ *     gcc -O2 -Wall -Wextra -ITests/Stubs -IInc -Wl,--wrap=twi_perform \
+ *         Tests/test_acquisition.c Tests/sim.c Src/acquisition.c Src/LTC2497.c \
+ *         Src/i2c.c Src/frame_ring.c -o test_acquisition
+ *     ./test_acquisition
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "sim.h"
+#include "acquisition.h"
+#include "calibration.h"
+#include "check.h"
+
+#define TEST_ADC_COUNT				2
+#define TEST_CHANNEL_COUNT			(TEST_ADC_COUNT * ACQ_CHANNELS_PER_ADC)
+#define TEST_ALL_CHANNELS			((acq_channel_mask_t)(1u << TEST_CHANNEL_COUNT) - 1)
+#define TEST_CHIP_CHANNELS(adc)		((acq_channel_mask_t)0xFF << ((adc) * ACQ_CHANNELS_PER_ADC))
+#define TEST_VALUE_TOLERANCE_UV		20			/**< Half LSB of 5 V reference */
+#define TEST_INTERRUPT_NS_MEAN		5000		/**< Host CPU time bound of handler, mean */
+#define TEST_INTERRUPT_NS_MAX		500000		/**< Host CPU time bound of single handler, host interrupts included */
+#define TEST_SPEEDUP_MIN			1.7			/**< Interleaved to sequential samples per second, 2n/(n+1) at best */
+
+/**@brief Frames seen by the frame handler. */
+typedef struct
+{
+	uint32_t			frames;
+	uint32_t			wrong_values;		/**< Channel values not equal to their input */
+	uint32_t			range_flags;
+	uint32_t			last_sequence;
+	uint32_t			reorders;
+	acq_channel_mask_t	channels_and;		/**< Channels read in every frame */
+	acq_channel_mask_t	last_mask;
+	acq_channel_mask_t	last_degraded;
+	int32_t				temperature[TEST_ADC_COUNT];
+} test_frames_t;
+
+static double *			m_p_rates;			/**< Samples per second of the throughput runs, shared with the child */
+static test_frames_t	m_frames;
+static uint8_t const	m_addresses[TEST_ADC_COUNT] = {0x14, 0x16};
+
+static uint8_t			m_sample_channel;
+static ret_code_t		m_sample_result;
+static int32_t			m_sample_uv;
+static uint32_t			m_samples;
+
+
+/**@brief Calibration isn't under test, values pass unchanged. */
+int32_t cal_apply(uint8_t channel, int32_t uv, int32_t temp)
+{
+	UNUSED_PARAMETER(channel);
+	UNUSED_PARAMETER(temp);
+	
+	return uv;
+}
+
+static void test_frame_handler(acq_frame_t const * p_frame)
+{
+	if (m_frames.frames > 0 && p_frame->sequence <= m_frames.last_sequence)
+		m_frames.reorders++;
+	
+	m_frames.channels_and  = (m_frames.frames == 0) ? p_frame->channel_mask : (m_frames.channels_and & p_frame->channel_mask);
+	m_frames.last_sequence = p_frame->sequence;
+	m_frames.last_mask     = p_frame->channel_mask;
+	m_frames.last_degraded = p_frame->degraded_mask;
+	m_frames.frames++;
+	
+	if (p_frame->range_mask != 0)
+		m_frames.range_flags++;
+	
+	for (uint8_t channel = 0; channel < TEST_CHANNEL_COUNT; channel++)
+	{
+		if (!(p_frame->channel_mask & ACQ_CHANNEL_BIT(channel)))
+			continue;
+		
+		int32_t input = sim_input_uv(channel / ACQ_CHANNELS_PER_ADC, channel % ACQ_CHANNELS_PER_ADC);
+		
+		if (abs(p_frame->value[channel] - input) > TEST_VALUE_TOLERANCE_UV)
+			m_frames.wrong_values++;
+	}
+	
+	for (uint8_t adc = 0; adc < TEST_ADC_COUNT; adc++)
+		m_frames.temperature[adc] = p_frame->temperature[adc];
+}
+
+static void test_sample_handler(uint8_t channel, ret_code_t result, uint8_t const * p_data)
+{
+	m_sample_channel = channel;
+	m_sample_result  = result;
+	m_sample_uv      = ltc2497_code_to_uv(ltc2497_code_get(p_data, NULL), LTC2497_VREF_UV);
+	m_samples++;
+}
+
+/**@brief Connects the chips and initializes bus and engine like main.c does. */
+static void test_setup(acq_schedule_t schedule, uint8_t speed)
+{
+	LTC2497_setup_t setup =
+	{
+		.freq  = LTC2497_REJECTION_FREQ_50_60_HZ,
+		.speed = speed,
+		.temp  = LTC2497_TEMP_OUTPUT_OFF
+	};
+	
+	acq_init_t init =
+	{
+		.setup          = setup,
+		.vref_uv        = LTC2497_VREF_UV,
+		.p_buses        = NULL,
+		.p_addresses    = m_addresses,
+		.adc_count      = TEST_ADC_COUNT,
+		.schedule       = schedule,
+		.ring_policy    = FRAME_RING_DROP_OLDEST,
+		.sample_handler = test_sample_handler,
+		.frame_handler  = test_frame_handler,
+		.stream_handler = NULL
+	};
+	
+	sim_init();
+	
+	for (uint8_t adc = 0; adc < TEST_ADC_COUNT; adc++)
+		sim_adc_add(0, m_addresses[adc], LTC2497_VREF_UV);
+	
+	CHECK(twi_init(0, TWI_BUS0_SCL_PIN, TWI_BUS0_SDA_PIN, TWI_SPEED_400K) == NRF_SUCCESS);
+	CHECK(acq_init(&init) == NRF_SUCCESS);
+	
+	// Chip setup at init is blocking, the rest must not be
+	sim_stats_clear();
+}
+
+/**@brief Checks that nothing has waited since the setup. */
+static void test_no_waits(void)
+{
+	sim_stats_t stats;
+	
+	sim_stats_get(&stats);
+	
+	CHECK(stats.blocking_transfers == 0);
+	CHECK(stats.busy_wait_us == 0);
+	CHECK(stats.nested_waits == 0);
+	CHECK(stats.interrupt_ns_total < (uint64_t)TEST_INTERRUPT_NS_MEAN * stats.interrupts);
+	CHECK(stats.interrupt_ns_max < TEST_INTERRUPT_NS_MAX);
+}
+
+/**@brief Scans all channels for a minute at the interval of the sweep estimate. */
+static void test_scan(void)
+{
+	acq_stats_t stats;
+	sim_stats_t sim;
+	
+	test_setup(ACQ_SCHEDULE_INTERLEAVED, LTC2497_CONVERSION_SPEED_2X);
+	
+	acq_channel_mask_set(TEST_ALL_CHANNELS);
+	CHECK(acq_frame_interval_set(acq_sweep_time_ms() - 1) == NRF_ERROR_INVALID_PARAM);
+	CHECK(acq_scan_start(TEST_ALL_CHANNELS, acq_sweep_time_ms()) == NRF_SUCCESS);
+	
+	sim_run(60000000);
+	acq_scan_stop();
+	
+	acq_stats_get(&stats);
+	sim_stats_get(&sim);
+	
+	printf("scan: %u frames of %u ms, %u interrupts, handler %.1f us mean, %.1f us max (host), %u NACK polls\n",
+		   m_frames.frames, acq_sweep_time_ms(), sim.interrupts,
+		   sim.interrupt_ns_total / 1000.0 / sim.interrupts, sim.interrupt_ns_max / 1000.0,
+		   stats.polls[0] + stats.polls[1]);
+	
+	CHECK(m_frames.frames >= 60000 / acq_sweep_time_ms() - 1);
+	CHECK(m_frames.channels_and == TEST_ALL_CHANNELS);
+	CHECK(m_frames.wrong_values == 0);
+	CHECK(m_frames.range_flags == 0);
+	CHECK(m_frames.reorders == 0);
+	CHECK(stats.frame_overruns == 0);
+	CHECK(stats.queue_drops == 0);
+	CHECK(stats.degraded_mask == 0);
+	
+	// Temperature sensor of every chip was read
+	for (uint8_t adc = 0; adc < TEST_ADC_COUNT; adc++)
+		CHECK(abs(m_frames.temperature[adc] - ((SIM_TEMP_K + adc) << LTC2497_TEMP_Q)) < (1 << LTC2497_TEMP_Q));
+	
+	test_no_waits();
+}
+
+/**@brief Takes single sample, result is passed through the scheduler. */
+static void test_sample(void)
+{
+	test_setup(ACQ_SCHEDULE_INTERLEAVED, LTC2497_CONVERSION_SPEED_1X);
+	
+	CHECK(acq_sample_start(TEST_CHANNEL_COUNT) == NRF_ERROR_INVALID_PARAM);
+	CHECK(acq_sample_start(11) == NRF_SUCCESS);
+	CHECK(acq_sample_start(3) == NRF_ERROR_BUSY);
+	CHECK(acq_is_busy());
+	
+	sim_run(1000000);
+	
+	CHECK(!acq_is_busy());
+	CHECK(m_samples == 1);
+	CHECK(m_sample_channel == 11 && m_sample_result == NRF_SUCCESS);
+	CHECK(abs(m_sample_uv - sim_input_uv(1, 3)) <= TEST_VALUE_TOLERANCE_UV);
+	
+	test_no_waits();
+}
+
+/**@brief Sweeps frames back to back, interval timer is shorter than the sweep. */
+static void test_throughput(acq_schedule_t schedule, uint8_t speed, double * p_rate)
+{
+	acq_stats_t stats;
+	uint32_t    samples = 0;
+	uint64_t    run_us  = 30000000;
+	
+	test_setup(schedule, speed);
+	
+	acq_channel_mask_set(TEST_ALL_CHANNELS);
+	
+	uint32_t estimate_ms = acq_sweep_time_ms();
+	
+	CHECK(acq_scan_start(TEST_ALL_CHANNELS, 1) == NRF_SUCCESS);
+	sim_run(run_us);
+	acq_scan_stop();
+	acq_stats_get(&stats);
+	
+	for (uint8_t adc = 0; adc < TEST_ADC_COUNT; adc++)
+		samples += stats.samples[adc];
+	
+	double sweep_ms = run_us / 1000.0 / stats.frames;
+	
+	*p_rate = samples * 1e6 / run_us;
+	
+	printf("%-11s %s: %5.1f samples/s, sweep %6.1f ms, estimate %4u ms\n",
+		   (schedule == ACQ_SCHEDULE_INTERLEAVED) ? "interleaved" : "sequential",
+		   (speed == LTC2497_CONVERSION_SPEED_2X) ? "2X" : "1X", *p_rate, sweep_ms, estimate_ms);
+	
+	CHECK(m_frames.wrong_values == 0);
+	CHECK(m_frames.channels_and == TEST_ALL_CHANNELS);
+	CHECK(sweep_ms <= estimate_ms);
+	
+	test_no_waits();
+}
+
+static void test_sequential_1x(void)
+{
+	test_throughput(ACQ_SCHEDULE_SEQUENTIAL, LTC2497_CONVERSION_SPEED_1X, &m_p_rates[0]);
+}
+
+static void test_interleaved_1x(void)
+{
+	test_throughput(ACQ_SCHEDULE_INTERLEAVED, LTC2497_CONVERSION_SPEED_1X, &m_p_rates[1]);
+}
+
+static void test_sequential_2x(void)
+{
+	test_throughput(ACQ_SCHEDULE_SEQUENTIAL, LTC2497_CONVERSION_SPEED_2X, &m_p_rates[2]);
+}
+
+static void test_interleaved_2x(void)
+{
+	test_throughput(ACQ_SCHEDULE_INTERLEAVED, LTC2497_CONVERSION_SPEED_2X, &m_p_rates[3]);
+}
+
+/**@brief Chip stops answering, is degraded, and is restored when it's back. */
+static void test_chip_failure(void)
+{
+	acq_stats_t stats;
+	uint32_t    interval_ms;
+	
+	test_setup(ACQ_SCHEDULE_INTERLEAVED, LTC2497_CONVERSION_SPEED_2X);
+	
+	acq_channel_mask_set(TEST_ALL_CHANNELS);
+	interval_ms = acq_sweep_time_ms();
+	CHECK(acq_scan_start(TEST_ALL_CHANNELS, interval_ms) == NRF_SUCCESS);
+	
+	sim_run(3 * interval_ms * 1000);
+	sim_adc_present_set(1, false);
+	sim_run((ACQ_DEGRADE_ERRORS + 3) * interval_ms * 1000);
+	
+	acq_stats_get(&stats);
+	
+	// Whole chip is charged, the other one isn't affected
+	CHECK(stats.degraded_mask == TEST_CHIP_CHANNELS(1));
+	CHECK(m_frames.last_degraded == TEST_CHIP_CHANNELS(1));
+	CHECK(m_frames.last_mask == TEST_CHIP_CHANNELS(0));
+	CHECK((m_frames.channels_and & TEST_CHIP_CHANNELS(0)) == TEST_CHIP_CHANNELS(0));
+	CHECK(stats.frame_overruns == 0);
+	
+	// Probe frame finds the chip again
+	sim_adc_present_set(1, true);
+	sim_run(ACQ_DEGRADE_PROBE_FRAMES * interval_ms * 1000);
+	
+	acq_stats_get(&stats);
+	
+	printf("chip failure: %u frames, %u overruns, %u errors of the first channel of the failed chip\n",
+		   stats.frames, stats.frame_overruns, stats.errors[ACQ_CHANNELS_PER_ADC]);
+	
+	// Chip away for long isn't taken for slow one
+	CHECK(stats.degraded_mask == 0);
+	CHECK(stats.frame_overruns == 0);
+	CHECK(m_frames.last_mask == TEST_ALL_CHANNELS);
+	CHECK(m_frames.wrong_values == 0);
+	
+	acq_scan_stop();
+	test_no_waits();
+}
+
+/**@brief Runs the case in child process, so static state of the modules is fresh. */
+static void test_case_run(void (*test_case)(void))
+{
+	int   status;
+	pid_t pid;
+	
+	fflush(stdout);
+	pid = fork();
+	
+	if (pid == 0)
+	{
+		test_case();
+		fflush(stdout);
+		_exit(m_check_failures ? 1 : 0);
+	}
+	
+	if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		m_check_failures++;
+}
+
+int main(void)
+{
+	test_case_run(test_scan);
+	test_case_run(test_sample);
+	// Interleaved schedule doubles the throughput of two chips
+	m_p_rates = mmap(NULL, 4 * sizeof(double), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (m_p_rates == MAP_FAILED)
+		return 1;
+	
+	test_case_run(test_sequential_1x);
+	test_case_run(test_interleaved_1x);
+	test_case_run(test_sequential_2x);
+	test_case_run(test_interleaved_2x);
+	
+	for (uint8_t i = 0; i < 4; i += 2)
+	{
+		printf("%s speedup %.2f\n", (i == 0) ? "1X" : "2X", m_p_rates[i + 1] / m_p_rates[i]);
+		CHECK(m_p_rates[i + 1] >= TEST_SPEEDUP_MIN * m_p_rates[i]);
+	}
+	
+	test_case_run(test_chip_failure);
+	
+	return check_result();
+}
@@ -0,0 +1,299 @@
+/**
+ * @file
+ * test_frame_codec.c
+ *
+ * @brief Host test of the delta frame codec
+ *
+ * This file checks varint and saturation edge values and round trips
+ * random walk frames through the encoder and the decoder, split into
+ * parts the way the measurement service does it. Frames dropped on the
+ * device before commit must not break the sync, lost packets must make
+ * the decoder skip until the next keyframe and never give wrong values.
+ *
+ * Build and run from the repository root:
+ *
+ *     gcc -O2 -Wall -Wextra -IInc Tests/test_frame_codec.c Src/frame_codec.c -o test_frame_codec
+ *     ./test_frame_codec
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "frame_codec.h"
+#include "check.h"
+
+#define TEST_CHANNELS				16
+#define TEST_FRAMES					20000
+#define TEST_PARTS_MAX				(FRAME_CODEC_PART_MASK + 1)
+#define TEST_PACKET_MAX				244			/**< Payload of 247 byte ATT MTU */
+
+/**@brief Encoded frame. */
+typedef struct
+{
+	uint8_t			data[TEST_PARTS_MAX][TEST_PACKET_MAX];
+	uint16_t		length[TEST_PARTS_MAX];
+	uint8_t			parts;
+} test_packets_t;
+
+static uint32_t		m_random = 1;
+
+
+static uint32_t test_random(void)
+{
+	m_random = m_random * 1103515245u + 12345u;
+	return m_random >> 8;
+}
+
+/**@brief Splits the frame into packets like the measurement service, without commit. */
+static bool test_encode(frame_encoder_t * p_enc, frame_codec_frame_t const * p_frame, bool keyframe,
+						uint16_t max_length, test_packets_t * p_packets)
+{
+	uint8_t channel = 0;
+	
+	p_packets->parts = 0;
+	
+	while (channel < p_enc->channel_count && (keyframe || (p_frame->channel_mask >> channel) != 0))
+	{
+		uint8_t  part   = p_packets->parts;
+		uint16_t length = frame_encoder_part_encode(p_enc, p_frame, keyframe, part, &channel,
+													p_packets->data[part], max_length);
+		if (length == 0)
+			break;
+		
+		p_packets->length[part] = length;
+		p_packets->parts++;
+	}
+	
+	if (p_packets->parts == 0)
+		return false;
+	
+	frame_encoder_last_mark(p_packets->data[p_packets->parts - 1]);
+	
+	return true;
+}
+
+static void test_varint(void)
+{
+	static int32_t const values[] =
+	{
+		0, 1, -1, 63, -64, 64, -65, 8191, -8192, 8192, 
+		FRAME_CODEC_VALUE_MAX, FRAME_CODEC_VALUE_MIN,
+		FRAME_CODEC_VALUE_MAX - FRAME_CODEC_VALUE_MIN, FRAME_CODEC_VALUE_MIN - FRAME_CODEC_VALUE_MAX,
+		INT32_MAX, INT32_MIN
+	};
+	static uint8_t const lengths[] = {1, 1, 1, 1, 1, 2, 2, 2, 2, 3, 4, 4, 4, 4, 5, 5};
+	uint8_t data[8];
+	
+	for (uint32_t i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+	{
+		int32_t value  = 0;
+		uint8_t length = frame_codec_varint_put(values[i], data);
+		
+		CHECK(length == lengths[i]);
+		CHECK(frame_codec_varint_get(data, length, &value) == length && value == values[i]);
+		
+		// Truncated varint isn't taken
+		CHECK(frame_codec_varint_get(data, length - 1, &value) == 0);
+	}
+	
+	CHECK(frame_codec_limit(FRAME_CODEC_VALUE_MAX + 1) == FRAME_CODEC_VALUE_MAX);
+	CHECK(frame_codec_limit(FRAME_CODEC_VALUE_MIN - 1) == FRAME_CODEC_VALUE_MIN);
+	CHECK(frame_codec_limit(INT32_MAX) == FRAME_CODEC_VALUE_MAX);
+	CHECK(frame_codec_limit(-5) == -5);
+}
+
+/**@brief Encodes random walk frames and decodes every packet that isn't lost.
+ *
+ * @param[in]  max_length		packet size
+ * @param[in]  drop_permille	frames dropped on the device before commit
+ * @param[in]  loss_permille	packets lost on the link
+ */
+static void test_round_trip(uint16_t max_length, uint32_t drop_permille, uint32_t loss_permille)
+{
+	static frame_encoder_t	enc;
+	static frame_decoder_t	dec;
+	static test_packets_t	packets;
+	int32_t					values[TEST_CHANNELS] = {0};
+	int32_t					sent[TEST_CHANNELS]   = {0};
+	uint32_t				frames_ok = 0;
+	uint32_t				mismatches = 0;
+	uint32_t				skipped_parts = 0;
+	uint32_t				committed_values = 0;
+	bool					lost_since_keyframe = false;
+	
+	frame_encoder_init(&enc, TEST_CHANNELS, FRAME_CODEC_KEYFRAME_INTERVAL);
+	frame_decoder_init(&dec, TEST_CHANNELS);
+	
+	for (uint32_t sequence = 0; sequence < TEST_FRAMES; sequence++)
+	{
+		uint64_t mask = 0;
+		
+		for (uint8_t channel = 0; channel < TEST_CHANNELS; channel++)
+		{
+			uint32_t r = test_random();
+			
+			// Mostly small steps, some jumps and values out of 24 bit range
+			if (r % 100 == 0)
+				values[channel] = (int32_t)(test_random() << 8);
+			else
+				values[channel] = frame_codec_limit(values[channel]) + (int32_t)(r % 65) - 32;
+			
+			// Dead band leaves some channels out
+			if (r % 4 != 0)
+				mask |= (uint64_t)1 << channel;
+		}
+		
+		frame_codec_frame_t const frame =
+		{
+			.sequence     = (uint16_t)sequence,
+			.timestamp    = sequence * 3277,
+			.channel_mask = mask,
+			.p_values     = values
+		};
+		
+		bool keyframe = frame_encoder_keyframe_due(&enc);
+		
+		if (!test_encode(&enc, &frame, keyframe, max_length, &packets))
+			continue;
+		
+		// Frame which didn't fit the queue is dropped on the device and
+		// never reaches the decoder
+		if (test_random() % 1000 < drop_permille)
+			continue;
+		
+		frame_encoder_commit(&enc, &frame, keyframe);
+		
+		for (uint8_t channel = 0; channel < TEST_CHANNELS; channel++)
+		{
+			if (mask & ((uint64_t)1 << channel))
+			{
+				sent[channel] = frame_codec_limit(values[channel]);
+				committed_values++;
+			}
+		}
+		
+		if (keyframe)
+			lost_since_keyframe = false;
+		
+		bool complete = true;
+		
+		for (uint8_t part = 0; part < packets.parts; part++)
+		{
+			frame_codec_part_t    decoded;
+			frame_decode_result_t result;
+			
+			if (test_random() % 1000 < loss_permille)
+			{
+				// Device sees lost packet and asks for keyframe
+				frame_encoder_keyframe_request(&enc);
+				lost_since_keyframe = true;
+				complete = false;
+				continue;
+			}
+			
+			result = frame_decoder_part_decode(&dec, packets.data[part], packets.length[part], &decoded);
+			
+			CHECK(result != FRAME_DECODE_INVALID);
+			CHECK(decoded.sequence == (uint16_t)sequence);
+			CHECK(decoded.timestamp == ((sequence * 3277) & 0xFFFFFF));
+			CHECK(decoded.last == (part == packets.parts - 1));
+			
+			if (result == FRAME_DECODE_SKIPPED)
+			{
+				skipped_parts++;
+				complete = false;
+				continue;
+			}
+			
+			// Decoder in sync never follows a frame with lost packet
+			CHECK(!lost_since_keyframe || keyframe);
+		}
+		
+		if (!complete)
+			continue;
+		
+		frames_ok++;
+		
+		for (uint8_t channel = 0; channel < TEST_CHANNELS; channel++)
+		{
+			if (dec.value[channel] != sent[channel])
+				mismatches++;
+		}
+	}
+	
+	printf("packet %3u, dropped %2u/1000, lost %2u/1000: %5u frames decoded, %4u parts skipped\n",
+		   max_length, drop_permille, loss_permille, frames_ok, skipped_parts);
+	
+	CHECK(mismatches == 0);
+	CHECK(frames_ok > TEST_FRAMES / 2);
+	CHECK(enc.stats.values == committed_values);
+	
+	if (loss_permille == 0)
+		CHECK(skipped_parts == 0);
+}
+
+/**@brief Keyframe sends the channels not read with their last value. */
+static void test_keyframe_fill(void)
+{
+	static test_packets_t packets;
+	frame_encoder_t       enc;
+	frame_decoder_t       dec;
+	frame_codec_part_t    decoded;
+	int32_t               values[TEST_CHANNELS];
+	
+	for (uint8_t channel = 0; channel < TEST_CHANNELS; channel++)
+		values[channel] = 1000 * channel - 5000;
+	
+	frame_codec_frame_t frame =
+	{
+		.sequence     = 1,
+		.channel_mask = 0xFFFF,
+		.p_values     = values
+	};
+	
+	frame_encoder_init(&enc, TEST_CHANNELS, 0);
+	frame_decoder_init(&dec, TEST_CHANNELS);
+	
+	CHECK(frame_encoder_keyframe_due(&enc));
+	CHECK(test_encode(&enc, &frame, true, TEST_PACKET_MAX, &packets) && packets.parts == 1);
+	frame_encoder_commit(&enc, &frame, true);
+	CHECK(frame_decoder_part_decode(&dec, packets.data[0], packets.length[0], &decoded) == FRAME_DECODE_OK);
+	
+	// Interval 0 sends keyframes on request only
+	CHECK(!frame_encoder_keyframe_due(&enc));
+	
+	values[3]          = 77;
+	frame.sequence     = 2;
+	frame.channel_mask = 1 << 3;
+	
+	frame_encoder_keyframe_request(&enc);
+	CHECK(test_encode(&enc, &frame, true, TEST_PACKET_MAX, &packets) && packets.parts == 1);
+	frame_encoder_commit(&enc, &frame, true);
+	
+	// Decoder which missed everything before syncs on the keyframe alone
+	frame_decoder_init(&dec, TEST_CHANNELS);
+	CHECK(frame_decoder_part_decode(&dec, packets.data[0], packets.length[0], &decoded) == FRAME_DECODE_OK);
+	CHECK(decoded.keyframe && decoded.last && decoded.channel_mask == 0xFFFF);
+	
+	for (uint8_t channel = 0; channel < TEST_CHANNELS; channel++)
+		CHECK(dec.value[channel] == ((channel == 3) ? 77 : 1000 * channel - 5000));
+	
+	// Truncated packet is rejected
+	CHECK(frame_decoder_part_decode(&dec, packets.data[0], packets.length[0] - 1, &decoded) == FRAME_DECODE_INVALID);
+	CHECK(frame_decoder_part_decode(&dec, packets.data[0], 4, &decoded) == FRAME_DECODE_INVALID);
+}
+
+int main(void)
+{
+	test_varint();
+	test_keyframe_fill();
+	
+	// 20 byte payload of the default ATT MTU splits every frame
+	test_round_trip(20, 0, 0);
+	test_round_trip(TEST_PACKET_MAX, 0, 0);
+	test_round_trip(20, 50, 0);
+	test_round_trip(20, 0, 20);
+	test_round_trip(TEST_PACKET_MAX, 50, 20);
+	
+	return check_result();
+}
@@ -0,0 +1,286 @@
+/**
+ * @file
+ * test_frame_ring.c
+ *
+ * @brief Host test of the frame ring
+ *
+ * This file checks the overflow policies of the frame ring and the
+ * consumer's compare-exchange, which has to fail and read again when the
+ * producer drops the oldest frame while the consumer copies it. 
+ *
+ * Interrupt is modelled by the copy itself: memcpy() of frame_ring.c is
+ * wrapped, and the copy out of the ring is stopped in the middle to push
+ * a burst of frames, like producer interrupt preempting the main loop.
+ * Then producer and consumer run in separate threads, which is harsher
+ * than the device, as the producer also runs concurrently with the
+ * consumer's exchange. Every word of the frame is derived from it's
+ * sequence, so a frame overwritten during the copy is seen as torn.
+ *
+ * Build and run from the repository root:
+ *
+ *     gcc -O2 -Wall -Wextra -pthread -ITests/Stubs -IInc -Wl,--wrap=memcpy \
+ *         Tests/test_frame_ring.c Src/frame_ring.c -o test_frame_ring
+ *     ./test_frame_ring
+ *
+ */
+
+#include <stdio.h>
+#include <pthread.h>
+#include "frame_ring.h"
+#include "check.h"
+
+#define TEST_FRAME_WORDS			15
+#define TEST_RING_SIZE				4			/**< Small ring, so it overflows all the time */
+#define TEST_STRESS_FRAMES			2000000
+#define TEST_STRESS_RUNS			4
+#define TEST_PREEMPT_POPS			100000
+
+/**@brief Test frame, every word is derived from the sequence. */
+typedef struct
+{
+	uint32_t		sequence;
+	uint32_t		words[TEST_FRAME_WORDS];
+} test_frame_t;
+
+FRAME_RING_DEF(m_ring, test_frame_t, TEST_RING_SIZE);
+
+static volatile bool		m_producer_done;
+
+static bool					m_preempt;				/**< Copy out of the ring is interrupted by the producer */
+static bool					m_in_interrupt;
+static uint32_t				m_ring_copies;			/**< Copies out of the ring, retries included */
+static uint32_t				m_next_sequence;
+static uint32_t				m_random = 1;
+
+void * __real_memcpy(void * p_dst, void const * p_src, size_t size);
+
+
+static void test_frame_fill(test_frame_t * p_frame, uint32_t sequence)
+{
+	p_frame->sequence = sequence;
+	for (uint32_t i = 0; i < TEST_FRAME_WORDS; i++)
+		p_frame->words[i] = sequence * 2654435761u + i;
+}
+
+static bool test_frame_intact(test_frame_t const * p_frame)
+{
+	for (uint32_t i = 0; i < TEST_FRAME_WORDS; i++)
+	{
+		if (p_frame->words[i] != p_frame->sequence * 2654435761u + i)
+			return false;
+	}
+	
+	return true;
+}
+
+static uint32_t test_random(void)
+{
+	m_random = m_random * 1103515245u + 12345u;
+	return m_random >> 16;
+}
+
+/**@brief Producer interrupt, pushes a burst of up to two rings of frames. */
+static void test_interrupt(void)
+{
+	uint32_t     burst = test_random() % (2 * TEST_RING_SIZE + 1);
+	test_frame_t frame;
+	
+	m_in_interrupt = true;
+	
+	for (uint32_t i = 0; i < burst; i++)
+	{
+		test_frame_fill(&frame, m_next_sequence++);
+		(void)frame_ring_push(&m_ring, &frame);
+	}
+	
+	m_in_interrupt = false;
+}
+
+/**@brief Copy of frame_ring.c. Copy out of the ring is split in halves and
+ *        the producer interrupt runs between them. */
+void * __wrap_memcpy(void * p_dst, void const * p_src, size_t size)
+{
+	uint8_t const * p_buffer = (uint8_t const *)CONCAT_2(m_ring, _buffer);
+	uint8_t const * p_byte   = (uint8_t const *)p_src;
+	
+	if (!m_preempt || m_in_interrupt || p_byte < p_buffer || p_byte >= p_buffer + sizeof(CONCAT_2(m_ring, _buffer)))
+		return __real_memcpy(p_dst, p_src, size);
+	
+	m_ring_copies++;
+	
+	__real_memcpy(p_dst, p_src, size / 2);
+	test_interrupt();
+	__real_memcpy((uint8_t *)p_dst + size / 2, p_byte + size / 2, size - size / 2);
+	
+	return p_dst;
+}
+
+/**@brief Pushes frames 1..n and checks the policy takes every one. */
+static void test_policy(frame_ring_policy_t policy, uint8_t decimation, uint32_t n,
+						uint32_t const * p_expected, uint32_t expected_count)
+{
+	test_frame_t frame;
+	uint32_t     popped = 0;
+	
+	frame_ring_init(&m_ring, policy, decimation);
+	
+	for (uint32_t sequence = 1; sequence <= n; sequence++)
+	{
+		test_frame_fill(&frame, sequence);
+		(void)frame_ring_push(&m_ring, &frame);
+	}
+	
+	while (frame_ring_pop(&m_ring, &frame))
+	{
+		CHECK(test_frame_intact(&frame));
+		CHECK(popped < expected_count && frame.sequence == p_expected[popped]);
+		popped++;
+	}
+	
+	CHECK(popped == expected_count);
+}
+
+/**@brief Pops with the producer interrupting every copy, frames must be
+ *        whole and in order. */
+static void test_preempt(void)
+{
+	test_frame_t       frame;
+	frame_ring_stats_t stats;
+	uint32_t           last   = 0;
+	uint32_t           popped   = 0;
+	uint32_t           torn     = 0;
+	uint32_t           reorders = 0;
+	
+	frame_ring_init(&m_ring, FRAME_RING_DROP_OLDEST, 1);
+	m_next_sequence = 1;
+	m_ring_copies   = 0;
+	m_preempt       = true;
+	
+	while (popped < TEST_PREEMPT_POPS)
+	{
+		if (!frame_ring_pop(&m_ring, &frame))
+		{
+			test_interrupt();
+			continue;
+		}
+		
+		if (!test_frame_intact(&frame))
+			torn++;
+		if (frame.sequence <= last)
+			reorders++;
+		
+		last = frame.sequence;
+		popped++;
+	}
+	
+	m_preempt = false;
+	frame_ring_stats_get(&m_ring, &stats);
+	
+	printf("preempted pops: popped %u, retried %u, overruns %u\n",
+		   popped, m_ring_copies - popped, stats.overruns);
+	
+	CHECK(torn == 0);
+	CHECK(reorders == 0);
+	CHECK(stats.popped == popped);
+	CHECK(stats.pushed == m_next_sequence - 1);
+	CHECK(popped + frame_ring_count(&m_ring) + stats.overruns == stats.pushed);
+	
+	// Exchange has failed and the frame was read again
+	CHECK(m_ring_copies > popped);
+}
+
+static void * test_producer(void * p_arg)
+{
+	test_frame_t frame;
+	
+	(void)p_arg;
+	
+	for (uint32_t sequence = 1; sequence <= TEST_STRESS_FRAMES; sequence++)
+	{
+		test_frame_fill(&frame, sequence);
+		(void)frame_ring_push(&m_ring, &frame);
+	}
+	
+	__atomic_store_n(&m_producer_done, true, __ATOMIC_RELEASE);
+	
+	return NULL;
+}
+
+/**@brief Pops concurrently with the producer, frames must be whole and in order. */
+static void test_stress(frame_ring_policy_t policy)
+{
+	pthread_t          producer;
+	test_frame_t       frame;
+	frame_ring_stats_t stats;
+	uint32_t           last     = 0;
+	uint32_t           popped   = 0;
+	uint32_t           torn     = 0;
+	uint32_t           reorders = 0;
+	
+	frame_ring_init(&m_ring, policy, FRAME_RING_DECIMATION);
+	m_producer_done = false;
+	
+	CHECK(pthread_create(&producer, NULL, test_producer, NULL) == 0);
+	
+	for (;;)
+	{
+		bool done = __atomic_load_n(&m_producer_done, __ATOMIC_ACQUIRE);
+		
+		if (frame_ring_pop(&m_ring, &frame))
+		{
+			if (!test_frame_intact(&frame))
+				torn++;
+			if (frame.sequence <= last)
+				reorders++;
+			
+			last = frame.sequence;
+			popped++;
+		}
+		else if (done)
+		{
+			break;
+		}
+	}
+	
+	pthread_join(producer, NULL);
+	frame_ring_stats_get(&m_ring, &stats);
+	
+	printf("policy %d: pushed %u, popped %u, overruns %u, decimated %u\n",
+		   policy, stats.pushed, popped, stats.overruns, stats.decimated);
+	
+	CHECK(torn == 0);
+	CHECK(reorders == 0);
+	CHECK(stats.popped == popped);
+	CHECK(frame_ring_count(&m_ring) == 0);
+	CHECK(popped <= stats.pushed);
+	CHECK(stats.pushed + stats.decimated + ((policy == FRAME_RING_DROP_OLDEST) ? 0 : stats.overruns) == TEST_STRESS_FRAMES);
+	
+	// Frame dropped by the producer is counted as overrun, exchange failed
+	// because the consumer freed the slot first is counted too
+	if (policy == FRAME_RING_DROP_OLDEST)
+		CHECK(stats.pushed - popped <= stats.overruns);
+	
+	CHECK(stats.peak <= TEST_RING_SIZE);
+}
+
+int main(void)
+{
+	static uint32_t const newest[]   = {1, 2, 3, 4};
+	static uint32_t const oldest[]   = {7, 8, 9, 10};
+	static uint32_t const decimate[] = {1, 2, 3, 5};
+	
+	test_policy(FRAME_RING_DROP_NEWEST, 1, 10, newest, 4);
+	test_policy(FRAME_RING_DROP_OLDEST, 1, 10, oldest, 4);
+	test_policy(FRAME_RING_DECIMATE, 2, 10, decimate, 4);
+	
+	test_preempt();
+	
+	for (uint32_t run = 0; run < TEST_STRESS_RUNS; run++)
+	{
+		test_stress(FRAME_RING_DROP_OLDEST);
+		test_stress(FRAME_RING_DROP_NEWEST);
+		test_stress(FRAME_RING_DECIMATE);
+	}
+	
+	return check_result();
+}
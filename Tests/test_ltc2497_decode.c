@@ -0,0 +1,171 @@
+/**
+ * @file
+ * test_ltc2497_decode.c
+ *
+ * @brief Host test of the LTC2497 result decoding
+ *
+ * This file checks the decoding of every edge code of the LTC2497
+ * result: over and under range, plus and minus zero, plus and minus full
+ * scale, the sub-LSB bits, rounding of the conversion to microvolts and
+ * the batch decoding against the single one.
+ *
+ * Build and run from the repository root:
+ *
+ *     gcc -O2 -Wall -Wextra -ITests/Stubs -IInc Tests/test_ltc2497_decode.c Src/LTC2497.c -o test_ltc2497_decode
+ *     ./test_ltc2497_decode
+ *
+ */
+
+#include <stdio.h>
+#include "LTC2497.h"
+#include "app_timer.h"
+#include "nrf_delay.h"
+#include "check.h"
+
+/**@brief Edge code of the result. */
+typedef struct
+{
+	uint32_t		raw;				/**< 24 bits read from the chip */
+	int32_t			code;
+	uint8_t			status;
+	int32_t			uv;					/**< At 5 V reference */
+} test_code_t;
+
+/**@brief Result words from the datasheet table, SIG and MSB bits decide the range. */
+static test_code_t const m_codes[] =
+{
+	{0xC00000,  65536, LTC2497_STATUS_OVERRANGE,   2500000},		// VIN >= FS
+	{0xFFFFC0, 131071, LTC2497_STATUS_OVERRANGE,   4999962},		// SIG and MSB set, rest isn't expected from the chip
+	{0xBFFFC0,  65535, LTC2497_STATUS_OK,          2499962},		// FS - 1 LSB
+	{0x800040,      1, LTC2497_STATUS_OK,               38},
+	{0x800000,      0, LTC2497_STATUS_OK,                0},		// +0
+	{0x80003F,      0, LTC2497_STATUS_OK,                0},		// Sub-LSB bits are dropped
+	{0x7FFFC0,     -1, LTC2497_STATUS_OK,              -38},		// -0
+	{0x7FFF80,     -2, LTC2497_STATUS_OK,              -76},
+	{0x400000, -65536, LTC2497_STATUS_OK,         -2500000},		// -FS
+	{0x3FFFC0, -65537, LTC2497_STATUS_UNDERRANGE, -2500038},		// VIN < -FS
+	{0x000000,-131072, LTC2497_STATUS_UNDERRANGE, -5000000},
+};
+
+
+/**@brief Bus, timer and delay aren't used by the decoding. */
+ret_code_t twi_perform(twi_transaction_t const * p_transaction)
+{
+	(void)p_transaction;
+	return NRF_ERROR_NOT_SUPPORTED;
+}
+
+ret_code_t twi_schedule(twi_transaction_t const * p_transaction)
+{
+	(void)p_transaction;
+	return NRF_ERROR_NOT_SUPPORTED;
+}
+
+uint32_t app_timer_cnt_get(void)
+{
+	return 0;
+}
+
+uint32_t app_timer_cnt_diff_compute(uint32_t ticks_to, uint32_t ticks_from)
+{
+	return (ticks_to - ticks_from) & APP_TIMER_MAX_CNT_VAL;
+}
+
+void nrf_delay_ms(uint32_t ms_time)
+{
+	(void)ms_time;
+}
+
+static void test_raw_put(uint32_t raw, uint8_t * p_data)
+{
+	p_data[0] = (uint8_t)(raw >> 16);
+	p_data[1] = (uint8_t)(raw >> 8);
+	p_data[2] = (uint8_t)raw;
+	p_data[3] = 0xA5;				// Fourth byte is repeated data, it's ignored
+}
+
+static void test_edge_codes(void)
+{
+	for (uint32_t i = 0; i < ARRAY_SIZE(m_codes); i++)
+	{
+		uint8_t data[LTC2497_DATA_LENGTH];
+		uint8_t status = 0xFF;
+		int32_t code;
+		
+		test_raw_put(m_codes[i].raw, data);
+		code = ltc2497_code_get(data, &status);
+		
+		if (code != m_codes[i].code || status != m_codes[i].status)
+			printf("0x%06X: code %d, status %u\n", m_codes[i].raw, code, status);
+		
+		CHECK(code == m_codes[i].code);
+		CHECK(status == m_codes[i].status);
+		CHECK(ltc2497_code_get(data, NULL) == code);
+		CHECK(ltc2497_code_to_uv(code, LTC2497_VREF_UV) == m_codes[i].uv);
+	}
+}
+
+static void test_rounding(void)
+{
+	// Full scale is VREF/2
+	CHECK(ltc2497_code_to_uv(LTC2497_CODE_FULL_SCALE, LTC2497_VREF_UV) == LTC2497_VREF_UV / 2);
+	CHECK(ltc2497_code_to_uv(-LTC2497_CODE_FULL_SCALE, LTC2497_VREF_UV) == -LTC2497_VREF_UV / 2);
+	CHECK(ltc2497_code_to_uv(LTC2497_CODE_FULL_SCALE, 4096000) == 2048000);
+	
+	// 1 LSB is 38.15 uV at 5 V, rounded to nearest
+	CHECK(ltc2497_code_to_uv(3, LTC2497_VREF_UV) == 114);
+	CHECK(ltc2497_code_to_uv(-3, LTC2497_VREF_UV) == -114);
+	CHECK(ltc2497_code_to_uv(4, LTC2497_VREF_UV) == 153);
+	CHECK(ltc2497_code_to_uv(-4, LTC2497_VREF_UV) == -153);
+	
+	// LSB of 65536 uV reference is exactly 0.5 uV, halves are rounded up
+	CHECK(ltc2497_code_to_uv(1, 65536) == 1);
+	CHECK(ltc2497_code_to_uv(-1, 65536) == 0);
+	CHECK(ltc2497_code_to_uv(3, 65536) == 2);
+	CHECK(ltc2497_code_to_uv(-3, 65536) == -1);
+	CHECK(ltc2497_code_to_uv(0, 65536) == 0);
+	
+	// Largest codes with 5.5 V reference, maximum of the chip
+	CHECK(ltc2497_code_to_uv(131071, 5500000) == 5499958);
+	CHECK(ltc2497_code_to_uv(-131072, 5500000) == -5500000);
+	
+	// Temperature sensor gives 1400 uV per kelvin
+	CHECK(ltc2497_uv_to_temp(420000) == 300 << LTC2497_TEMP_Q);
+	CHECK(ltc2497_uv_to_temp(420700) == (300 << LTC2497_TEMP_Q) + (1 << (LTC2497_TEMP_Q - 1)));
+}
+
+static void test_batch(void)
+{
+	uint8_t data[ARRAY_SIZE(m_codes)][LTC2497_DATA_LENGTH];
+	int32_t codes[ARRAY_SIZE(m_codes)];
+	int32_t uv[ARRAY_SIZE(m_codes)];
+	uint8_t status[ARRAY_SIZE(m_codes)];
+	uint8_t count = (uint8_t)ARRAY_SIZE(m_codes);
+	
+	for (uint8_t i = 0; i < count; i++)
+		test_raw_put(m_codes[i].raw, data[i]);
+	
+	ltc2497_decode_batch((uint8_t const (*)[LTC2497_DATA_LENGTH])data, count, LTC2497_VREF_UV, codes, uv, status);
+	
+	for (uint8_t i = 0; i < count; i++)
+	{
+		CHECK(codes[i] == m_codes[i].code);
+		CHECK(uv[i] == m_codes[i].uv);
+		CHECK(status[i] == m_codes[i].status);
+	}
+	
+	// Codes and status are optional
+	ltc2497_decode_batch((uint8_t const (*)[LTC2497_DATA_LENGTH])data, count, LTC2497_VREF_UV, NULL, uv, NULL);
+	
+	for (uint8_t i = 0; i < count; i++)
+		CHECK(uv[i] == m_codes[i].uv);
+}
+
+int main(void)
+{
+	test_edge_codes();
+	test_rounding();
+	test_batch();
+	
+	return check_result();
+}